@@ -486,10 +486,13 @@ int main(int argc, const char * const *argv) {
                     streams[numStreams-1] = stream;
                 }
                 const char *name = 0;
+                uint32_t loadFlags = 0;
 
                 // example:
                 //  --filter stdin { --name stdinput --bufferSize 5012 }
                 //
+                // --process in the brackets is for the loader too.
+                //
                 int fargc = 0; // 4
                 const char * const *fargv = 0; // points to --name
                 ++i;
@@ -512,6 +515,8 @@ int main(int argc, const char * const *argv) {
                                 ++fargc;
                             }
                         } else {
+                            if(strcmp(argv[i],"--process") == 0)
+                                loadFlags |= QS_FILTER_PROCESS;
                             ++i;
                             ++fargc;
                         }
@@ -526,8 +531,8 @@ int main(int argc, const char * const *argv) {
                     fprintf(stderr, "}\n");
                 }
 
-                filters[numFilters-1] = qsStreamFilterLoad(stream,
-                        arg, name, fargc, (const char **) fargv);
+                filters[numFilters-1] = qsStreamFilterLoadWithFlags(stream,
+                        arg, name, fargc, (const char **) fargv, loadFlags);
                 if(!filters[numFilters-1]) return 1; // error
 
                 // next
@@ -674,6 +679,24 @@ int main(int argc, const char * const *argv) {
 
                 break;
 
+            case 'T':
+
+                if(!arg) {
+                    fprintf(stderr, "Bad --trace option\n\n");
+                    return usage(STDERR_FILENO);
+                }
+                if(!stream) {
+                    fprintf(stderr, "--trace with no filters loaded\n");
+                    return 1;
+                }
+                if(qsStreamTrace(stream, arg))
+                    return 1; // error
+
+                ++i;
+                arg = 0;
+
+                break;
+
             case 'S':
 
                 if(!arg) {
@@ -116,6 +116,46 @@ extern "C" {
 
 
 
+/** Register a pre-filter-input callback function
+ *
+ * When the controller or the associated filter are unloaded this callback
+ * is removed.
+ *
+ * This must be called in one of the optional controller loaded functions:
+ * construct(), preStart(), postStart(), preStop(), or postStop().
+ *
+ * Each controller may have only one pre-input filter callback per filter.
+ *
+ * \param filter is the filter those input() function that is of concern.
+ *
+ * \param callback is the function that is called just before each filter
+ * input() is called, from the same thread, without the stream mutex lock.
+ * Since the filter may have input() called by more than one thread at a
+ * time, if it is multi-threaded, \p callback must be thread safe.  The
+ * lenIn[] argument is the number of bytes that input() will be able to
+ * read on each input port.  If a callback already exists, the new
+ * callback will replace the old callback.
+ *
+ * If \p callback returns non-zero the callback will be removed.
+ *
+ * If qsAddPreFilterInput() is called with \p callback zero the callback
+ * will be removed.
+ *
+ * \param userData is passed to the \p callback function each time it is
+ * called.
+ *
+ * \return 0 on success, and non-zero on failure.
+ */
+extern
+int qsAddPreFilterInput(struct QsFilter *filter,
+        int (*callback)(
+            struct QsFilter *filter,
+            const size_t lenIn[],
+            const bool isFlushing[],
+            uint32_t numInputs, uint32_t numOutputs,
+            void *userData), void *userData);
+
+
 /** Register a post-filter-input callback function
  *
  * When the controller or the associated filter are unloaded this callback
@@ -128,10 +168,13 @@ extern "C" {
  *
  * \param filter is the filter those input() function that is of concern.
  *
- * \param callback is the function that is called before each filter
- * input() is called.  \p callback() will be called with \p len that
- * reflects changes from the filter's input() call.  If a callback already
- * exists, the new callback will replace the old callback.
+ * \param callback is the function that is called just after each filter
+ * input() returns, from the same thread, without the stream mutex lock.
+ * Since the filter may have input() called by more than one thread at a
+ * time, if it is multi-threaded, \p callback must be thread safe.
+ * \p callback() will be called with \p len that reflects changes from
+ * the filter's input() call.  If a callback already exists, the new
+ * callback will replace the old callback.
  *
  * If \p callback returns non-zero the callback will be removed.  The
  * len[] argument will be the set to the number of bytes that have been
@@ -159,6 +202,138 @@ int qsAddPostFilterInput(struct QsFilter *filter,
             void *userData), void *userData);
 
 
+/** Trace the latency of data flowing through a filter
+ *
+ * Every \p sampleEvery input() calls, a source filter marks the first
+ * byte that it writes to each output with the time.  When a filter
+ * that has latency tracing reads past a marked byte, \p callback is
+ * called, and the time is passed on to the first bytes that the filter
+ * writes in that input() call.  In this way sampled latencies are
+ * measured for each connection and from the sources, through the filter
+ * graph, to the sinks.  The filters that are between must have latency
+ * tracing too, or the samples stop there.
+ *
+ * Only input() calls that make or read a sample read the clock, so the
+ * cost of latency tracing is small, and nothing is done for filters that
+ * do not have it.
+ *
+ * This must be called in one of the optional controller loaded
+ * functions: construct(), preStart(), preStop(), or postStop(); not while
+ * the stream is flowing.  Each filter may have only one latency callback,
+ * and it is removed when the controller or the filter are unloaded.
+ *
+ * \param filter is the filter to trace.
+ *
+ * \param sampleEvery is the number of input() calls between samples, if
+ * the filter is a source.
+ *
+ * \param callback is called with the stream mutex lock, from the thread
+ * that called the \p filter input(), each time the filter reads past a
+ * sample on input port \p inputPortNum.  \p edgeLatency is the time in
+ * seconds since the filter that feeds that port wrote the sample.
+ * \p sourceLatency is the time in seconds since the source wrote it.
+ * \p callback should be quick.  If \p callback is 0 latency tracing is
+ * removed from the filter.
+ *
+ * \param userData is passed to the \p callback function each time it is
+ * called.
+ *
+ * \return 0 on success.
+ */
+extern
+int qsAddFilterLatency(struct QsFilter *filter, uint32_t sampleEvery,
+        void (*callback)(struct QsFilter *filter, uint32_t inputPortNum,
+            double edgeLatency, double sourceLatency, void *userData),
+        void *userData);
+
+
+
+/** Get how full the connection from a filter output to a reader is
+ *
+ * This may be called from any thread, while the stream is flowing,
+ * without stopping the stream.  The length is read without a lock, so
+ * it may be a little old.  It may be called after the stream is ready
+ * and the controller postStart() is called, until the controller
+ * postStop() is called.
+ *
+ * \param filter is the filter that writes the output.
+ *
+ * \param outputPortNum is the output port number of \p filter.
+ *
+ * \param readerIndex is the index of the reader of the output, from 0
+ * to the number of readers minus 1.  Each reader is a filter input port
+ * that reads from the output.
+ *
+ * \param readFilter if not 0 is set to the reading filter.
+ *
+ * \param inputPortNum if not 0 is set to the reading filter input port.
+ *
+ * \param length if not 0 is set to the number of bytes that are written
+ * to the output and not read yet by the reader.
+ *
+ * \param maxLength if not 0 is set to the number of bytes that the
+ * reader can have before the output is full, and the writing filter
+ * input() is not called.
+ *
+ * \return 0 on success, 1 if there is no reader with \p readerIndex,
+ * and less than 0 if there is no such output or the stream is not
+ * ready.
+ */
+extern
+int qsFilterOutputOccupancy(struct QsFilter *filter,
+        uint32_t outputPortNum, uint32_t readerIndex,
+        struct QsFilter **readFilter, uint32_t *inputPortNum,
+        size_t *length, size_t *maxLength);
+
+
+
+/** Set the number of worker threads for the next stream launch
+ *
+ * This lets a controller, like one that tunes the stream, replace the
+ * \p maxThreads argument that the app passes to qsStreamLaunch(), for
+ * the next launch only.  This must be called in the controller
+ * preStart().
+ *
+ * \param stream is the stream to tune.
+ *
+ * \param maxThreads is the number of threads to use.  If 0, the
+ * qsStreamLaunch() argument is used.
+ */
+extern
+void qsStreamTuneThreads(struct QsStream *stream, uint32_t maxThreads);
+
+
+/** Make a filter output write promise larger
+ *
+ * After the filter start() is called, the output maxWrite (see
+ * qsCreateOutputBuffer()) is made at least \p maxWrite.  This makes the
+ * ring buffer larger.  It can't make the filter write more in an input()
+ * call, but it will let more data be written before the output is full.
+ * The filter promise is never made smaller.  This must be called in the
+ * controller preStart(), and is for the next stream run only.
+ *
+ * \return 0 on success, and non-zero if there is no such port.
+ */
+extern
+int qsFilterTuneOutput(struct QsFilter *filter, uint32_t outputPortNum,
+        size_t maxWrite);
+
+
+/** Make a filter input read promise larger
+ *
+ * After the filter start() is called, the input maxRead (see
+ * qsSetInputReadPromise()) is made at least \p maxRead.  This makes the
+ * ring buffer larger, and lets input() be called with more data.  The
+ * filter promise is never made smaller.  This must be called in the
+ * controller preStart(), and is for the next stream run only.
+ *
+ * \return 0 on success, and non-zero if there is no such port.
+ */
+extern
+int qsFilterTuneInput(struct QsFilter *filter, uint32_t inputPortNum,
+        size_t maxRead);
+
+
 
 #ifdef __cplusplus
 }
@@ -42,6 +42,12 @@
 #define QS_DEFAULTMAXWRITE         ((size_t) 1024)
 
 
+/** An alignment for qsSetInputType() and qsSetOutputType() that is good
+ * for any current SIMD vector instructions, like AVX-512.
+ */
+#define QS_SIMDALIGNMENT           ((size_t) 64)
+
+
 /** In general the idea of threshold is related to input triggering.
  * In the simplest case we can set a input channel threshold.
  */
@@ -312,6 +318,72 @@ extern
 void qsAdvanceInput(uint32_t inputPortNum, size_t len);
 
 
+/** A stream tag
+ *
+ * A stream tag is a key and value that marks a byte in a stream, like
+ * the time that a sample was taken, a change of center frequency, or the
+ * start and end of a burst.  Tags travel beside the data, so unlike
+ * parameters, they stay with the bytes they mark.  See qsOutputTag() and
+ * qsGetInputTags().
+ */
+struct QsTag {
+
+    /** the offset in bytes from the buffer pointer.  For qsGetInputTags()
+     * it is from the input buffer that was passed to input(). */
+    size_t offset;
+
+    /** the tag key.  Only the pointer is passed, so it must stay valid
+     * while the stream is running, like a string constant. */
+    const char *key;
+
+    /** the tag value */
+    double value;
+};
+
+
+/** mark an output byte with a tag
+ *
+ * qsOutputTag() can only be called in a filter input() function.  The
+ * tag marks the byte at \p offset bytes from the pointer that
+ * qsGetOutputBuffer() returned in this input() call, and that byte must
+ * be written with qsOutput() in this input() call.  The readers of this
+ * output get the tag with qsGetInputTags() in the input() call that has
+ * that byte in its input buffer.  Tags are passed through pass-through
+ * buffers, without the pass-through filter doing anything.
+ *
+ * Streams that do not use tags do not pay for them.
+ *
+ * \param outputPortNum the output port number.
+ *
+ * \param offset the offset in bytes from the output buffer pointer.
+ *
+ * \param key is the tag key.  Only the pointer is passed, so it must
+ * stay valid while the stream is running, like a string constant.
+ *
+ * \param value is the tag value.
+ */
+extern
+void qsOutputTag(uint32_t outputPortNum, size_t offset,
+        const char *key, double value);
+
+
+/** get the tags in the current input buffer
+ *
+ * qsGetInputTags() can only be called in a filter input() function.
+ *
+ * \param inputPortNum the input port number.
+ *
+ * \param tags is set to point to an array of the tags that mark bytes in
+ * the input buffer that was passed to input(), in order of offset.  The
+ * array is valid until input() returns.  A tag is seen again in the next
+ * input() call if the filter did not advance past the byte it marks.
+ *
+ * \return the number of tags in the \p tags array.
+ */
+extern
+uint32_t qsGetInputTags(uint32_t inputPortNum, const struct QsTag **tags);
+
+
 /** set the current filters input threshold
  *
  * Set the minimum input needed in order for current filters input()
@@ -374,6 +446,53 @@ void qsSetInputReadPromise(uint32_t inputPortNum, size_t len);
 extern
 void qsCreateOutputBuffer(uint32_t outputPortNum, size_t maxWriteLen);
 
+
+/** Declare the element type that is read from an input port
+ *
+ * qsSetInputType() can only be called in the filter's start() function.
+ * After calling it, the input lengths passed to the filter's input() for
+ * this port will always be a multiple of \p elementSize and of \p
+ * alignment, and the input buffer pointer will always be aligned to
+ * \p alignment bytes; so the filter may use aligned vector loads without
+ * dealing with partial elements.  In turn, the filter must only call
+ * qsAdvanceInput() with a multiple of that same length.
+ *
+ * If the filter that feeds this port declared the type of it's output
+ * with qsSetOutputType() and the element sizes, or type names, do not
+ * match, qsStreamReady() will fail.
+ *
+ * \param inputPortNum the input port number.
+ *
+ * \param typeName a name for the element type, like "float" or
+ * "complex float", or 0 to check only the element size.  This string
+ * must stay valid until the filter's stop() is called.
+ *
+ * \param elementSize the size of an element in bytes.
+ *
+ * \param alignment the alignment of the buffer pointer in bytes.  It
+ * must be 0 or a power of 2 that is not larger than the page size,
+ * like 32 or 64 (QS_SIMDALIGNMENT) for SIMD instructions.  0 is the same
+ * as aligning to whole elements.
+ */
+extern
+void qsSetInputType(uint32_t inputPortNum, const char *typeName,
+        size_t elementSize, size_t alignment);
+
+
+/** Declare the element type that is written to an output port
+ *
+ * qsSetOutputType() can only be called in the filter's start() function.
+ * After calling it, the pointer returned by qsGetOutputBuffer() for this
+ * port will always be aligned to \p alignment bytes, so long as the
+ * filter only calls qsOutput() with lengths that are a multiple of both
+ * \p elementSize and \p alignment, which is required.
+ *
+ * See qsSetInputType() for the meaning of the arguments.
+ */
+extern
+void qsSetOutputType(uint32_t outputPortNum, const char *typeName,
+        size_t elementSize, size_t alignment);
+
 /** create a "pass-through" buffer
  *
  * A pass-through buffer shared the memory mapping between the input port
@@ -446,6 +565,35 @@ extern
 const char* qsGetFilterName(void);
 
 
+/** Set a pointer that is kept for this filter
+ *
+ * The pointer may be gotten with qsGetFilterUserData().  quickstream
+ * does nothing with it, so the filter module is responsible for cleaning
+ * up whatever it points to, typically in destroy().  This lets a filter
+ * module keep state for each filter that loads it, so that the module
+ * does not need static data that is unique to the filter.
+ *
+ * qsSetFilterUserData() can only be called in a filter module in it's
+ * construct(), start(), stop(), and destroy() functions.
+ *
+ * \param userData the pointer to keep for this filter.
+ */
+extern
+void qsSetFilterUserData(void *userData);
+
+
+/** Get the pointer that was set with qsSetFilterUserData()
+ *
+ * qsGetFilterUserData() can be called in a filter module in it's
+ * construct(), start(), input(), stop(), and destroy() functions.
+ *
+ * \return the pointer that was last set with qsSetFilterUserData() for
+ * this filter, or 0 if it was not set.
+ */
+extern
+void *qsGetFilterUserData(void);
+
+
 struct QsApp;
 struct QsStream;
 
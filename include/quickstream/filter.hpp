@@ -10,6 +10,9 @@
 #include <inttypes.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <alloca.h>
+
+#include "filter.h"
 
 /** \file
  */
@@ -75,51 +78,322 @@ class QsFilter {
  */
 #define QS_LOAD_FILTER_MODULE(ClassName) \
     extern "C" {\
+    static class QsFilter *f;\
     int construct(int argc, const char **argv) {\
         f = new ClassName(argc, argv);\
         return 0;\
     }\
+    int input(void *buffers[], const size_t lens[],\
+            const bool isFlushing[],\
+            uint32_t numInPorts, uint32_t numOutPorts) {\
+        return f->input(buffers, lens, isFlushing, numInPorts, numOutPorts);\
+    }\
+    int start(uint32_t numInPorts, uint32_t numOutPorts) {\
+        return f->start(numInPorts, numOutPorts);\
+    }\
+    int stop(uint32_t numInPorts, uint32_t numOutPorts) {\
+        return f->stop(numInPorts, numOutPorts);\
+    }\
+    void help(FILE *file) {\
+        f->help(file);\
+    }\
+    int destroy(void) {\
+        delete f;\
+        f = 0;\
+        return 0;\
+    }\
 }
 
 
-#ifndef DOXYGEN_SHOULD_SKIP_THIS
 
-extern "C" {
+/** \brief the quickstream C++ template filter module interfaces
+ *
+ * The classes in this namespace let you write a C++ filter module with
+ * the port element types known at compile time, and without any
+ * virtual functions.  The filter module class inherits
+ * qs::Filter<ClassName, qs::In<T>, qs::Out<U> > and the CPP macro
+ * QS_FILTER_MODULE(ClassName) makes the C filter module functions that
+ * call it.  Each filter that loads the module gets its own object, which
+ * is kept with qsSetFilterUserData().
+ *
+ * Below is an example C++ template quickstream filter module:
+ * \include copyCPP.cpp
+ */
+namespace qs {
 
-static class QsFilter *f;
 
-int input(void *buffers[], const size_t lens[],
-        const bool isFlushing[],
-        uint32_t numInPorts, uint32_t numOutPorts) {
+/** Used as a port count to mean any number of ports */
+static const uint32_t Any = UINT32_MAX;
 
-    return f->input(buffers, lens, isFlushing, numInPorts, numOutPorts);
-}
 
-int start(uint32_t numInPorts, uint32_t numOutPorts) {
+/** A pointer and the number of elements it points to
+ *
+ * This is like C++20 std::span, but we do not require C++20.
+ */
+template <typename T>
+struct Span {
+
+    T *ptr;
+    size_t len; // in number of elements of T
+
+    /** \return a pointer to the first element */
+    T *data(void) const { return ptr; };
+    /** \return the number of elements */
+    size_t size(void) const { return len; };
+    /** \return true if there are no elements */
+    bool empty(void) const { return len == 0; };
+    T &operator[](size_t i) const { return ptr[i]; };
+    T *begin(void) const { return ptr; };
+    T *end(void) const { return ptr + len; };
+};
 
-    return f->start(numInPorts, numOutPorts);
-}
 
-int stop(uint32_t numInPorts, uint32_t numOutPorts) {
+/** Declares the input ports of a qs::Filter
+ *
+ * \tparam T the type of the elements read from all the input ports.
+ *
+ * \tparam N the number of input ports that the filter must have, or
+ * qs::Any for any number of input ports.
+ *
+ * \tparam Alignment the input buffer alignment in bytes, like
+ * QS_SIMDALIGNMENT.  See qsSetInputType().
+ */
+template <typename T, uint32_t N = Any, size_t Alignment = 0>
+struct In {
+    typedef T Type;
+    static const uint32_t numPorts = N;
+    static const size_t alignment = Alignment;
+};
 
-    return f->stop(numInPorts, numOutPorts);
-}
 
-void help(FILE *file) {
+/** Declares the output ports of a qs::Filter
+ *
+ * \tparam T the type of the elements written to all the output ports.
+ *
+ * \tparam N the number of output ports that the filter must have, or
+ * qs::Any for any number of output ports.
+ *
+ * \tparam Alignment the output buffer alignment in bytes, like
+ * QS_SIMDALIGNMENT.  See qsSetOutputType().
+ */
+template <typename T, uint32_t N = Any, size_t Alignment = 0>
+struct Out {
+    typedef T Type;
+    static const uint32_t numPorts = N;
+    static const size_t alignment = Alignment;
+};
+
 
-    f->help(file);
-}
+/** For a filter with no input ports, a source */
+typedef In<uint8_t, 0> NoIn;
 
-int destroy(void) {
+/** For a filter with no output ports, a sink */
+typedef Out<uint8_t, 0> NoOut;
 
-    delete f;
-    f = 0;
-}
 
+/** The base class template that a C++ template filter module inherits
+ *
+ * \headerfile filter.hpp "quickstream/filter.hpp"
+ *
+ * This uses the curiously recurring template pattern (CRTP) so that
+ * calls from the C filter module functions to the ClassName methods
+ * are resolved at compile time.
+ *
+ * The ClassName class must have a constructor that takes (int argc,
+ * const char **argv) and must define:
+ *
+ * \code
+ * int input(const qs::Span<const InType> in[], const bool isFlushing[],
+ *         uint32_t numInPorts, uint32_t numOutPorts);
+ * \endcode
+ *
+ * The in[] lengths are in number of elements, not bytes.  The port
+ * element sizes are declared with qsSetInputType() and qsSetOutputType()
+ * before ClassName::start() is called, so quickstream only passes whole
+ * elements and checks that connected ports agree.
+ *
+ * ClassName may also define start(), stop(), and a static help() with
+ * the same arguments as the methods in this class, which will hide the
+ * do nothing versions here.
+ *
+ * \tparam ClassName the class that inherits this class.
+ * \tparam Ins the input ports declared with qs::In.
+ * \tparam Outs the output ports declared with qs::Out.
+ */
+template <class ClassName, class Ins = In<uint8_t>, class Outs = Out<uint8_t> >
+class Filter {
+
+    public:
 
-} // extern "C"
+        /** The type of the elements read from input ports */
+        typedef typename Ins::Type InType;
+        /** The type of the elements written to output ports */
+        typedef typename Outs::Type OutType;
+
+
+        /**
+         * \details \copydetails CFilterAPI::start()
+         */
+        int start(uint32_t numInPorts, uint32_t numOutPorts) {
+            return 0;
+        };
+
+        /**
+         * \details \copydetails CFilterAPI::stop()
+         */
+        int stop(uint32_t numInPorts, uint32_t numOutPorts) {
+            return 0;
+        };
+
+        /**
+         * \details \copydetails CFilterAPI::help()
+         */
+        static void help(FILE *file) { };
+
+
+    protected:
+
+        /** qsCreateOutputBuffer() with the length in elements */
+        static void createOutputBuffer(uint32_t outputPortNum,
+                size_t maxWrite) {
+            qsCreateOutputBuffer(outputPortNum, maxWrite*sizeof(OutType));
+        };
+
+        /** qsSetInputReadPromise() with the length in elements */
+        static void setInputReadPromise(uint32_t inputPortNum, size_t len) {
+            qsSetInputReadPromise(inputPortNum, len*sizeof(InType));
+        };
+
+        /** qsGetOutputBuffer() with the lengths in elements */
+        static Span<OutType> getOutputBuffer(uint32_t outputPortNum,
+                size_t maxLen, size_t minLen) {
+            Span<OutType> span = {
+                (OutType *) qsGetOutputBuffer(outputPortNum,
+                        maxLen*sizeof(OutType), minLen*sizeof(OutType)),
+                maxLen
+            };
+            return span;
+        };
+
+        /** qsOutput() with the length in elements */
+        static void output(uint32_t outputPortNum, size_t len) {
+            qsOutput(outputPortNum, len*sizeof(OutType));
+        };
+
+        /** qsAdvanceInput() with the length in elements */
+        static void advanceInput(uint32_t inputPortNum, size_t len) {
+            qsAdvanceInput(inputPortNum, len*sizeof(InType));
+        };
+
+
+    public:
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+        // These are called from the C filter module functions that are
+        // made by QS_FILTER_MODULE().
+
+        static ClassName *_self(void) {
+            return static_cast<ClassName *>(qsGetFilterUserData());
+        };
+
+        static int _construct(int argc, const char **argv) {
+            qsSetFilterUserData(new ClassName(argc, argv));
+            return 0;
+        };
+
+        static int _destroy(void) {
+            delete _self();
+            qsSetFilterUserData(0);
+            return 0;
+        };
+
+        static int _start(uint32_t numInPorts, uint32_t numOutPorts) {
+            if(Ins::numPorts != Any && Ins::numPorts != numInPorts) {
+                fprintf(stderr, "filter \"%s\" needs %" PRIu32
+                        " inputs, %" PRIu32 " connected\n",
+                        qsGetFilterName(), Ins::numPorts, numInPorts);
+                return -1; // error
+            }
+            if(Outs::numPorts != Any && Outs::numPorts != numOutPorts) {
+                fprintf(stderr, "filter \"%s\" needs %" PRIu32
+                        " outputs, %" PRIu32 " connected\n",
+                        qsGetFilterName(), Outs::numPorts, numOutPorts);
+                return -1; // error
+            }
+            // Byte ports are left untyped so they may connect to any
+            // port.
+            if(sizeof(InType) > 1 || Ins::alignment > 1)
+                for(uint32_t i=0; i<numInPorts; ++i)
+                    qsSetInputType(i, 0, sizeof(InType), Ins::alignment);
+            if(sizeof(OutType) > 1 || Outs::alignment > 1)
+                for(uint32_t i=0; i<numOutPorts; ++i)
+                    qsSetOutputType(i, 0, sizeof(OutType), Outs::alignment);
+            return _self()->start(numInPorts, numOutPorts);
+        };
+
+        static int _stop(uint32_t numInPorts, uint32_t numOutPorts) {
+            return _self()->stop(numInPorts, numOutPorts);
+        };
+
+        static void _help(FILE *file) {
+            ClassName::help(file);
+        };
+
+        static int _input(void *buffers[], const size_t lens[],
+                const bool isFlushing[],
+                uint32_t numInPorts, uint32_t numOutPorts) {
+            // There are at most _QS_MAX_CHANNELS input ports, so this is
+            // not a large stack allocation.
+            Span<const InType> *in = (Span<const InType> *)
+                alloca((numInPorts?numInPorts:1)*sizeof(*in));
+            for(uint32_t i=0; i<numInPorts; ++i) {
+                // The input ports are typed in _start(), so the flow
+                // only gives us whole elements.  A trailing partial
+                // element at the end of the stream is never passed to
+                // us; qsStreamStop() warns about it.
+                in[i].ptr = (const InType *) buffers[i];
+                in[i].len = lens[i]/sizeof(InType);
+            }
+            return _self()->input(in, isFlushing, numInPorts, numOutPorts);
+        };
 
 #endif // #ifndef DOXYGEN_SHOULD_SKIP_THIS
+};
+
+} // namespace qs
+
+
+/** C++ loader CPP (C preprocessor) macro for a qs::Filter class
+ *
+ * This makes the C filter module functions that create a ClassName
+ * object for each filter that loads the module, and call its methods.
+ * Use it once in the filter module source, without a semicolon after it.
+ */
+#define QS_FILTER_MODULE(ClassName) \
+    extern "C" {\
+    int construct(int argc, const char **argv) {\
+        return ClassName::_construct(argc, argv);\
+    }\
+    int destroy(void) {\
+        return ClassName::_destroy();\
+    }\
+    int start(uint32_t numInPorts, uint32_t numOutPorts) {\
+        return ClassName::_start(numInPorts, numOutPorts);\
+    }\
+    int stop(uint32_t numInPorts, uint32_t numOutPorts) {\
+        return ClassName::_stop(numInPorts, numOutPorts);\
+    }\
+    int input(void *buffers[], const size_t lens[],\
+            const bool isFlushing[],\
+            uint32_t numInPorts, uint32_t numOutPorts) {\
+        return ClassName::_input(buffers, lens, isFlushing,\
+                numInPorts, numOutPorts);\
+    }\
+    void help(FILE *file) {\
+        ClassName::_help(file);\
+    }\
+}
 
 
 #endif // #ifndef __qsfilter_hpp__
@@ -193,6 +193,46 @@ qsParameterCreate(const char *pName, enum QsParameterType type,
         void *userData);
 
 
+/** qsParameterCreateDeferred() is called in a filter construct() to
+ * create a parameter that is set in the filter input() thread
+ *
+ * This is like qsParameterCreate() except that qsParameterSet() does not
+ * call \p setCallback.  qsParameterSet() just stages the value, without
+ * blocking, from any thread, and \p setCallback is called with the
+ * latest staged value from the thread that calls the filter input(),
+ * just before it calls input().  So the filter needs no locks to share
+ * the parameter state between \p setCallback and input(), and a change
+ * takes effect between two input() calls, at a well defined place in the
+ * stream.  If the parameter is set more than once between two input()
+ * calls only the last value is applied.  Values that are set while the
+ * stream is not flowing are applied before the first input() call in
+ * the next flow.
+ *
+ * \p setCallback may call qsParameterPush() and the other functions
+ * that may be called in input().
+ *
+ * Only parameters of type None, QsDouble and QsUint64 can be deferred.
+ *
+ * A filter that calls qsSetThreadSafe() with more than one thread cannot
+ * have deferred parameters, since more than one thread may be in its
+ * input() at a time.  If the filter is loaded with \ref
+ * QS_FILTER_PROCESS \p setCallback is called in the helper process,
+ * just before the helper process calls input().
+ *
+ * \see qsParameterCreate() for the other arguments.
+ *
+ * \return a pointer to an opaque parameter object, or 0 if the parameter
+ * already exists, the filter is multi-threaded, or other error. */
+extern
+struct QsParameter *
+qsParameterCreateDeferred(const char *pName, enum QsParameterType type,
+        int (*setCallback)(struct QsParameter *parameter,
+            void *value, const char *pName,
+            void *userData),
+        void (*cleanup)(const char *pName, void *userData),
+        void *userData);
+
+
 struct QsFilter;
 struct QsStream;
 struct QsApp;
@@ -297,6 +337,10 @@ qsParameterCreateForFilter(struct QsFilter *filter,
 /** bit flag to mark parameter get callback to not get added more than
  * once. */
 #define QS_KEEP_ONE        (04)
+/** bit flag to mark parameter get callback to be called from a
+ * quickstream notifier thread, and not from the thread that pushes the
+ * parameter. */
+#define QS_ASYNC           (010)
 
 /** Register a callback to get a parameter value from outside the filter
  * module
@@ -350,6 +394,17 @@ qsParameterCreateForFilter(struct QsFilter *filter,
  *  added more than once.  The address of the \p getCallback is what
  *  defines the callback.
  *
+ *  - QS_ASYNC: By default the get callback is called in the thread that
+ *  pushes the parameter value, which is often a stream worker thread in
+ *  a filter input() call.  If flags includes the bit QS_ASYNC the value
+ *  is queued, without blocking, and the get callback is called from a
+ *  quickstream notifier thread.  If the parameter is pushed again before
+ *  the get callback is called, the get callback just gets the latest
+ *  value.  The values that are pushed before qsStreamStop() returns are
+ *  delivered before it calls the controller postStop() functions.  Only
+ *  parameters of type None, QsDouble and QsUint64 can be gotten with
+ *  QS_ASYNC.
+ *
  * Calling users getCallback() function should not block.
  *
  * If the getCallback returns non-zero the callback will be removed.
@@ -201,22 +201,174 @@ struct QsDictionary {
     char *key; // strdup() the key.
 
     void (*freeValueOnDestroy)(void *);
+
+    // If this dictionary is from qsDictionaryCreateArena() all its nodes
+    // and strings are allocated from this, else it's 0 and they are
+    // malloc()ed.
+    struct Arena *arena;
+};
+
+
+// Arena memory for a dictionary.
+//
+// The node children arrays and the key and suffix strings of a dictionary
+// are cut from big slabs, so that they are close together and not all
+// over the heap.  Memory that is freed by qsDictionaryRemove() goes on a
+// free list for its size and is used again.  All the slabs are freed at
+// once in qsDictionaryDestroy().
+
+#define SLAB_SIZE         ((size_t) 16*1024)
+#define ARENA_ALIGN       ((size_t) 16)
+// Freed memory larger than this is not used again until the dictionary
+// is destroyed.
+#define NUM_SIZE_CLASSES  (64)
+
+
+struct Slab {
+    struct Slab *next;
+    _Alignas(ARENA_ALIGN) char mem[];
 };
 
 
+struct Arena {
+
+    struct Slab *slabs;
+
+    // The unused memory at the end of the newest slab.
+    char *ptr, *end;
+
+    // Free lists for each size, ARENA_ALIGN, 2*ARENA_ALIGN, ...
+    void *freeLists[NUM_SIZE_CLASSES];
+
+    // Set if any node had a freeValueOnDestroy(); if not we do not need
+    // to look at the nodes when we destroy the dictionary.
+    bool haveFreeValues;
+};
+
+
+static void *
+Allocate(struct Arena *a, size_t size) {
+
+    if(!a) {
+        void *ptr = malloc(size);
+        ASSERT(ptr, "malloc(%zu) failed", size);
+        return ptr;
+    }
+
+    size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+    size_t i = size/ARENA_ALIGN - 1;
+
+    if(i < NUM_SIZE_CLASSES && a->freeLists[i]) {
+        void *ptr = a->freeLists[i];
+        a->freeLists[i] = *(void **) ptr;
+        return ptr;
+    }
+
+    if(a->ptr + size > a->end) {
+        size_t len = (size > SLAB_SIZE)?size:SLAB_SIZE;
+        struct Slab *slab = malloc(sizeof(*slab) + len);
+        ASSERT(slab, "malloc(%zu) failed", sizeof(*slab) + len);
+        slab->next = a->slabs;
+        a->slabs = slab;
+        a->ptr = slab->mem;
+        a->end = slab->mem + len;
+    }
+
+    void *ptr = a->ptr;
+    a->ptr += size;
+    return ptr;
+}
+
+
+// size must be the size that the memory was allocated with.
+static void
+Deallocate(struct Arena *a, void *ptr, size_t size) {
+
+    if(!a) {
+        free(ptr);
+        return;
+    }
+
+    size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+    size_t i = size/ARENA_ALIGN - 1;
+
+    if(i < NUM_SIZE_CLASSES) {
+        *(void **) ptr = a->freeLists[i];
+        a->freeLists[i] = ptr;
+    }
+}
+
+
+static inline struct QsDictionary *
+AllocateChildren(struct Arena *a) {
+
+    struct QsDictionary *children = Allocate(a, 4*sizeof(*children));
+    memset(children, 0, 4*sizeof(*children));
+    for(int i=0; i<4; ++i)
+        children[i].arena = a;
+    return children;
+}
+
+
+static inline void
+FreeChildrenArray(struct Arena *a, struct QsDictionary *children) {
+
+#if DEBUG
+    memset(children, 0, 4*sizeof(*children));
+#endif
+    Deallocate(a, children, 4*sizeof(*children));
+}
+
+
+// For key and suffix strings.
+static inline void
+FreeString(struct Arena *a, char *str) {
+
+    Deallocate(a, str, strlen(str) + 1);
+}
+
+
 struct QsDictionary *qsDictionaryCreate(void) {
 
     struct QsDictionary *d = calloc(1, sizeof(*d));
     ASSERT(d, "calloc(1,%zu) failed", sizeof(*d));
 
-    struct QsDictionary *children = calloc(4, sizeof(*children));
-    ASSERT(children, "calloc(%d,%zu) failed", 4, sizeof(*children));
-    d->children = children;
+    d->children = AllocateChildren(0);
 
     return d;
 }
 
 
+struct QsDictionary *qsDictionaryCreateArena(void) {
+
+    struct Arena *a = calloc(1, sizeof(*a));
+    ASSERT(a, "calloc(1,%zu) failed", sizeof(*a));
+
+    struct QsDictionary *d = Allocate(a, sizeof(*d));
+    memset(d, 0, sizeof(*d));
+    d->arena = a;
+    d->children = AllocateChildren(a);
+
+    return d;
+}
+
+
+// Calls the freeValueOnDestroy() functions of an arena dictionary.
+static
+void FreeValues(struct QsDictionary *children) {
+
+    for(struct QsDictionary *child = children + 4 - 1;
+            child >= children; --child) {
+        if(child->children)
+            FreeValues(child->children);
+        if(child->key && child->freeValueOnDestroy) {
+            child->freeValueOnDestroy((void *) child->value);
+            child->freeValueOnDestroy = 0;
+        }
+    }
+}
+
+
 static
 void FreeChildren(struct QsDictionary *children) {
 
@@ -257,6 +409,8 @@ void qsDictionarySetFreeValueOnDestroy(struct QsDictionary *dict,
     DASSERT(dict);
     DASSERT(dict->key);
     dict->freeValueOnDestroy = freeValueOnDestroy;
+    if(dict->arena && freeValueOnDestroy)
+        dict->arena->haveFreeValues = true;
 }
 
 
@@ -264,6 +418,25 @@ void qsDictionaryDestroy(struct QsDictionary *dict) {
 
     DASSERT(dict);
 
+    if(dict->arena) {
+        struct Arena *a = dict->arena;
+        // This must be the root node, which has no key.
+        DASSERT(!dict->key);
+        if(a->haveFreeValues && dict->children)
+            FreeValues(dict->children);
+        // The root node is in a slab too.
+        while(a->slabs) {
+            struct Slab *slab = a->slabs;
+            a->slabs = slab->next;
+            free(slab);
+        }
+#if DEBUG
+        memset(a, 0, sizeof(*a));
+#endif
+        free(a);
+        return;
+    }
+
     if(dict->children) {
         FreeChildren(dict->children);
         dict->children = 0;
@@ -390,7 +563,8 @@ IsCharacter(const char *s, uint32_t count) {
 }
 
 
-// Returns malloc() allocated string.
+// Returns a string allocated from arena a, or malloc() allocated if a is
+// 0.
 //
 // Converts in parts of 4 characters from the end.
 //
@@ -401,7 +575,7 @@ IsCharacter(const char *s, uint32_t count) {
 // Output: \3\2ey
 //
 static inline
-char *Compress(const char *suffix, size_t count_in) {
+char *Compress(struct Arena *a, const char *suffix, size_t count_in) {
 
     DASSERT(suffix);
     DASSERT(*suffix);
@@ -410,7 +584,8 @@ char *Compress(const char *suffix, size_t count_in) {
     size_t len = 0;
     size_t count = count_in;
 
-    while(*s++) {
+    // Count the same way that we convert below.
+    while(*s) {
  
         if(IsCharacter(s, count)) {
             count += 4;
@@ -423,8 +598,7 @@ char *Compress(const char *suffix, size_t count_in) {
         ++len;
     }
 
-    char *str = malloc(len+1);
-    ASSERT(str, "malloc(%zu) failed", len+1);
+    char *str = Allocate(a, len+1);
     char *mem = str;
     // Reset count for another run at the input string.
     count = count_in;
@@ -452,10 +626,11 @@ char *Compress(const char *suffix, size_t count_in) {
 
 
 static inline
-char *Strdup(const char *str) {
+char *Strdup(struct Arena *a, const char *str) {
 
-    char *s = strdup(str);
-    ASSERT(s, "strdup(%p) failed", str);
+    size_t len = strlen(str) + 1;
+    char *s = Allocate(a, len);
+    memcpy(s, str, len);
     return s;
 }
 
@@ -509,6 +684,9 @@ int qsDictionaryInsert(struct QsDictionary *node,
             return -1;
         }
 
+    // All the nodes and strings of this dictionary come from here.
+    struct Arena *a = node->arena;
+
     // We put the key input the form like: "he" = \1\3\3\2 \2\2\3\2
     char *key = Expand(key_in);
 
@@ -566,7 +744,7 @@ int qsDictionaryInsert(struct QsDictionary *node,
                         return 1;
                     }
                     node->value = value;
-                    node->key = Strdup(key_in);
+                    node->key = Strdup(a, key_in);
                     free(eSuffix);
                     free(key);
                     return 0;
@@ -591,10 +769,7 @@ int qsDictionaryInsert(struct QsDictionary *node,
                     // value and the old children.
                     //
                     // New node children:
-                    struct QsDictionary *children = calloc(4,
-                            sizeof(*children));
-                    ASSERT(children, "calloc(%d,%zu) failed",
-                            4, sizeof(*children));
+                    struct QsDictionary *children = AllocateChildren(a);
 
                     // The first node keeps the same child memory as node.
                     struct QsDictionary *n2 = children + (*e) - 1;
@@ -607,12 +782,12 @@ int qsDictionaryInsert(struct QsDictionary *node,
                     if(*(e+1))
                         // Copy the remains of the old suffix starting at
                         // the next character.
-                        n2->suffix = Compress(e+1, count+1);
+                        n2->suffix = Compress(a, e+1, count+1);
 
                     char *oldSuffix = node->suffix;
                     node->value = value;
                     if(idict) *idict = node;
-                    node->key = Strdup(key_in);
+                    node->key = Strdup(a, key_in);
                     if(e == eSuffix) {
                         // There where no matching chars in suffix and the
                         // char pointers never advanced.
@@ -623,11 +798,11 @@ int qsDictionaryInsert(struct QsDictionary *node,
                         // char and then dup it.
                         *(char *) e = '\0'; // It's okay we copied it
                         // above.  We have less characters for this node.
-                        node->suffix = Compress(eSuffix,
+                        node->suffix = Compress(a, eSuffix,
                                 count - (e - eSuffix));
                     }
                     node->children = children;
-                    free(oldSuffix);
+                    FreeString(a, oldSuffix);
                     free(eSuffix);
                     free(key);
                     return 0; // success
@@ -642,10 +817,7 @@ int qsDictionaryInsert(struct QsDictionary *node,
                 // New node children:
                 //
                 // 2 of these children will be used in this bifurcation.
-                struct QsDictionary *children =
-                        calloc(4, sizeof(*children));
-                ASSERT(children, "calloc(%d,%zu) failed",
-                        4, sizeof(*children));
+                struct QsDictionary *children = AllocateChildren(a);
 
                 char *oldSuffix = node->suffix;
                 struct QsDictionary *n1 = children + (*e) - 1;
@@ -657,17 +829,17 @@ int qsDictionaryInsert(struct QsDictionary *node,
                 n1->children = node->children;
                 n2->value = value;
                 if(idict) *idict = n2;
-                n2->key = Strdup(key_in);
+                n2->key = Strdup(a, key_in);
                 node->children = children;
                 node->value = 0;
                 node->key = 0;
 
                 if(*(e+1))
-                    n1->suffix = Compress(e+1, count+1);
+                    n1->suffix = Compress(a, e+1, count+1);
 
                 ++c;
                 if(*c)
-                    n2->suffix = Compress(c, count+1);
+                    n2->suffix = Compress(a, c, count+1);
 
                 if(e == eSuffix)
                     node->suffix = 0;
@@ -675,10 +847,10 @@ int qsDictionaryInsert(struct QsDictionary *node,
                     // No need to worry, we copied this above, so now we
                     // came hack it up.
                     *((char *)(e)) = '\0';
-                    node->suffix = Compress(eSuffix, count - (e - eSuffix));
+                    node->suffix = Compress(a, eSuffix, count - (e - eSuffix));
                 }
 
-                free(oldSuffix);
+                FreeString(a, oldSuffix);
                 free(eSuffix);
                 free(key);
                 return 0; // success
@@ -697,28 +869,27 @@ int qsDictionaryInsert(struct QsDictionary *node,
 
         if(node->key == 0) {
             DASSERT(node->suffix == 0);
-            node->suffix = Compress(c, count);
+            node->suffix = Compress(a, c, count);
             if(idict) *idict = node;
             node->value = value;
             DASSERT(node->key == 0);
-            node->key = Strdup(key_in);
+            node->key = Strdup(a, key_in);
 
             free(key);
             return 0; // success
         }
 
-        struct QsDictionary *children = calloc(4, sizeof(*children));
-        ASSERT(children, "calloc(%d,%zu) failed", 4, sizeof(*children));
+        struct QsDictionary *children = AllocateChildren(a);
         node->children = children;
 
         // go to this character (*c) node.
         node = children + (*c) - 1;
         if(idict) *idict = node;
         node->value = value;
-        node->key = Strdup(key_in);
+        node->key = Strdup(a, key_in);
         // add any suffix characters if needed.
         if(*(c+1))
-            node->suffix = Compress(c+1, count+1);
+            node->suffix = Compress(a, c+1, count+1);
 
         free(key);
         return 0; // success
@@ -737,7 +908,7 @@ int qsDictionaryInsert(struct QsDictionary *node,
     node->value = value;
     if(idict) *idict = node;
     DASSERT(node->key == 0);
-    node->key = Strdup(key_in);
+    node->key = Strdup(a, key_in);
     free(key);
     return 0; // success done
 }
@@ -895,7 +1066,12 @@ struct QsDictionary
         return 0;
     }
 
-    DASSERT(node->key);
+    if(!node->key) {
+        // We ended at a branch point, so key is just the start of other
+        // keys.
+        DSPEW("No key=\"%s\" found", key);
+        return 0;
+    }
 
     // This DASSERT() will not be true for *qsDictionaryFindDict():
     //DASSERT(strcmp(key, node->key) == 0);
@@ -1164,6 +1340,7 @@ AbsorbChild(struct QsDictionary *parent, struct QsDictionary *child,
         int childIndex) {
 
     DASSERT(parent->key == 0);
+    struct Arena *a = parent->arena;
     // Absorb this one child up to this parent.
     struct QsDictionary *nodeChildren = parent->children;
 
@@ -1175,8 +1352,7 @@ AbsorbChild(struct QsDictionary *parent, struct QsDictionary *child,
     size_t len = ((parent->suffix)?strlen(parent->suffix):0) +
         ((child->suffix)?strlen(child->suffix):0) + 2;
 
-    char *suffix = malloc(len);
-    ASSERT(suffix, "malloc(%zu) failed", len);
+    char *suffix = Allocate(a, len);
     sprintf(suffix, "%s%c%s",
             (parent->suffix)?(parent->suffix):"",
             childIndex+1,
@@ -1186,9 +1362,9 @@ AbsorbChild(struct QsDictionary *parent, struct QsDictionary *child,
 
 
     if(parent->suffix)
-        free(parent->suffix);
+        FreeString(a, parent->suffix);
     if(child->suffix)
-        free(child->suffix);
+        FreeString(a, child->suffix);
 
     // The only thing left to do is compress the suffix, but we must first
     // figure out where suffix boundaries of that divide the regular
@@ -1228,17 +1404,17 @@ AbsorbChild(struct QsDictionary *parent, struct QsDictionary *child,
         // function.
         //
         parent->suffix = suffix;
-        free(nodeChildren);
+        FreeChildrenArray(a, nodeChildren);
         return;
     }
 
     if(!esuffix)
         esuffix = Expand(suffix);
 
-    parent->suffix = Compress(esuffix, l);
+    parent->suffix = Compress(a, esuffix, l);
     free(esuffix);
-    free(suffix);
-    free(nodeChildren);
+    FreeString(a, suffix);
+    FreeChildrenArray(a, nodeChildren);
     //DSPEW("l=%zu parent suffix=\"%s\"", l, STRING(parent->suffix));
 }
 
@@ -1268,12 +1444,13 @@ void PruneNodeDown(struct QsDictionary *node) {
         node->freeValueOnDestroy = 0;
     }
 
-    free(node->key);
+    FreeString(node->arena, node->key);
     node->key = 0;
     node->value = 0;
 
     if(!node->children) {
-        free(node->suffix);
+        if(node->suffix)
+            FreeString(node->arena, node->suffix);
         node->suffix = 0;
         return; // stop pruning down, we may prune up later.
     }
@@ -1335,7 +1512,7 @@ PruneUp(struct QsDictionary *parent) {
         // Absorb this one child up to this parent.
         AbsorbChild(parent, oneChild, childIndex);
     else if(numChildren == 0) {
-        free(parent->children);
+        FreeChildrenArray(parent->arena, parent->children);
         parent->children = 0;
     }
 }
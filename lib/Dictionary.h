@@ -9,6 +9,15 @@ extern
 struct QsDictionary *qsDictionaryCreate(void);
 
 
+// Like qsDictionaryCreate() but the nodes and key strings of this
+// dictionary are allocated from big slabs that are kept with the
+// dictionary, so that lookups touch fewer cache lines, and
+// qsDictionaryDestroy() frees the slabs and does not have to free each
+// node.  Memory from qsDictionaryRemove() is used again by later inserts.
+extern
+struct QsDictionary *qsDictionaryCreateArena(void);
+
+
 extern
 void qsDictionaryDestroy(struct QsDictionary *dict);
 
@@ -118,3 +127,22 @@ void qsDictionarySetValue(struct QsDictionary *dict, void *value);
 // Get the value for the node at "dict".
 extern
 void *qsDictionaryGetValue(const struct QsDictionary *dict);
+
+
+
+// See DictionaryFreeze.c.
+struct QsFrozenDictionary;
+
+// Makes a read-only hash table copy of the key/value entries that are in
+// dict now.  Changes to dict after this are not seen in the copy, so the
+// user must stop using it when dict changes.
+extern
+struct QsFrozenDictionary *qsDictionaryFreeze(const struct QsDictionary *dict);
+
+// Returns element value for key or 0 if not found.
+extern
+void *qsFrozenDictionaryFind(const struct QsFrozenDictionary *fd,
+        const char *key);
+
+extern
+void qsFrozenDictionaryDestroy(struct QsFrozenDictionary *fd);
@@ -0,0 +1,217 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <inttypes.h>
+
+#include "Dictionary.h"
+#include "../lib/debug.h"
+
+
+// A read-only copy of a Dictionary in a flat hash table.
+//
+// The trie in Dictionary.c uses little memory, but a lookup goes through
+// a node for about every character of the key, and the nodes are all
+// over the heap.  When the entries will not change for a while, like the
+// filters and their parameters while a stream is flowing, we can make
+// this table, and a lookup is a hash of the key and then, most of the
+// time, one table entry and one key string.
+//
+// The table is open addressing with linear probing, and it is at most
+// half full.  We try a few hash seeds and keep the one that gives the
+// shortest longest probe sequence, so that a lookup of a key that is not
+// there is bounded too.  With few keys we often get a perfect hash where
+// every key is in its first slot.
+
+
+// From MurmurHash1.c
+extern
+uint32_t MurmurHash1(const void *key, int len, uint32_t seed);
+
+
+#define NUM_SEEDS  (16)
+
+
+struct FrozenEntry {
+
+    const char *key; // 0 if the entry is not used.
+    const void *value;
+    uint32_t hash;
+    uint32_t length; // strlen(key)
+};
+
+
+struct QsFrozenDictionary {
+
+    uint32_t mask; // The number of entries minus 1
+    // The most entries that we look at to find a key.
+    uint32_t maxProbe;
+    uint32_t seed;
+
+    struct FrozenEntry *entries;
+
+    // All the keys, one after the other, in one allocation.
+    char *keys;
+};
+
+
+struct Collect {
+    struct FrozenEntry *entries;
+    uint32_t num;
+    size_t keysLength;
+};
+
+
+static int
+Count(const char *key, void *value, struct Collect *c) {
+
+    c->keysLength += strlen(key) + 1;
+    return 0;
+}
+
+
+static int
+Collect(const char *key, void *value, struct Collect *c) {
+
+    struct FrozenEntry *e = c->entries + c->num++;
+    e->key = key;
+    e->value = value;
+    e->length = strlen(key);
+    return 0;
+}
+
+
+// Returns the longest probe sequence, or 0 if there are no keys.
+static uint32_t
+Build(struct FrozenEntry *table, uint32_t mask,
+        struct FrozenEntry *entries, uint32_t num, uint32_t seed) {
+
+    memset(table, 0, (mask + 1)*sizeof(*table));
+    uint32_t maxProbe = 0;
+
+    for(uint32_t i=0; i<num; ++i) {
+        struct FrozenEntry *e = entries + i;
+        e->hash = MurmurHash1(e->key, e->length, seed);
+        uint32_t probe = 1;
+        uint32_t j = e->hash;
+        while(table[j & mask].key) {
+            ++j;
+            ++probe;
+        }
+        table[j & mask] = *e;
+        if(probe > maxProbe)
+            maxProbe = probe;
+    }
+
+    return maxProbe;
+}
+
+
+struct QsFrozenDictionary *
+qsDictionaryFreeze(const struct QsDictionary *dict) {
+
+    DASSERT(dict);
+
+    struct Collect c = { 0, 0, 0 };
+    uint32_t num = qsDictionaryForEach(dict,
+            (int (*) (const char *, void *, void *)) Count, &c);
+
+    struct QsFrozenDictionary *fd = calloc(1, sizeof(*fd));
+    ASSERT(fd, "calloc(1,%zu) failed", sizeof(*fd));
+
+    // At most half full.
+    uint32_t len = 2;
+    while(len < 2*num)
+        len <<= 1;
+    fd->mask = len - 1;
+
+    fd->entries = calloc(len, sizeof(*fd->entries));
+    ASSERT(fd->entries, "calloc(%" PRIu32 ",%zu) failed",
+            len, sizeof(*fd->entries));
+
+    if(num) {
+        c.entries = malloc(num*sizeof(*c.entries));
+        ASSERT(c.entries, "malloc(%zu) failed", num*sizeof(*c.entries));
+        qsDictionaryForEach(dict,
+                (int (*) (const char *, void *, void *)) Collect, &c);
+        DASSERT(c.num == num);
+
+        // Copy the keys so that the table does not point into the trie.
+        fd->keys = malloc(c.keysLength);
+        ASSERT(fd->keys, "malloc(%zu) failed", c.keysLength);
+        char *k = fd->keys;
+        for(uint32_t i=0; i<num; ++i) {
+            memcpy(k, c.entries[i].key, c.entries[i].length + 1);
+            c.entries[i].key = k;
+            k += c.entries[i].length + 1;
+        }
+
+        struct FrozenEntry *table = malloc(len*sizeof(*table));
+        ASSERT(table, "malloc(%zu) failed", len*sizeof(*table));
+
+        fd->maxProbe = UINT32_MAX;
+        for(uint32_t seed=0; seed<NUM_SEEDS && fd->maxProbe > 1;
+                ++seed) {
+            uint32_t maxProbe = Build(table, fd->mask, c.entries, num,
+                    seed);
+            if(maxProbe < fd->maxProbe) {
+                struct FrozenEntry *tmp = fd->entries;
+                fd->entries = table;
+                table = tmp;
+                fd->maxProbe = maxProbe;
+                fd->seed = seed;
+            }
+        }
+
+        free(table);
+        free(c.entries);
+    }
+
+    DSPEW("Froze %" PRIu32 " keys in %" PRIu32 " entries with"
+            " seed %" PRIu32 " and longest probe %" PRIu32,
+            num, len, fd->seed, fd->maxProbe);
+
+    return fd;
+}
+
+
+void *qsFrozenDictionaryFind(const struct QsFrozenDictionary *fd,
+        const char *key) {
+
+    DASSERT(fd);
+    DASSERT(key);
+
+    size_t len = strlen(key);
+    uint32_t hash = MurmurHash1(key, len, fd->seed);
+
+    uint32_t j = hash;
+    for(uint32_t i=0; i<fd->maxProbe; ++i, ++j) {
+        const struct FrozenEntry *e = fd->entries + (j & fd->mask);
+        if(!e->key)
+            return 0;
+        // Most of the time the hash rules out the keys that are not it,
+        // so memcmp() is called about once.
+        if(e->hash == hash && e->length == len &&
+                memcmp(e->key, key, len) == 0)
+            return (void *) e->value;
+    }
+
+    return 0;
+}
+
+
+void qsFrozenDictionaryDestroy(struct QsFrozenDictionary *fd) {
+
+    DASSERT(fd);
+
+    if(fd->keys)
+        free(fd->keys);
+#ifdef DEBUG
+    memset(fd->entries, 0, (fd->mask + 1)*sizeof(*fd->entries));
+#endif
+    free(fd->entries);
+#ifdef DEBUG
+    memset(fd, 0, sizeof(*fd));
+#endif
+    free(fd);
+}
+
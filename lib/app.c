@@ -63,7 +63,7 @@ struct QsApp *qsAppCreate(void) {
     app->type = _QS_APP_TYPE;
     app->id = _qsAppCount++;
 
-    app->controllers = qsDictionaryCreate();
+    app->controllers = qsDictionaryCreateArena();
     DASSERT(app->controllers);
 
     return app;
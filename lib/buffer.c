@@ -13,6 +13,7 @@
 #include "./debug.h"
 #include "./qs.h"
 #include "../include/quickstream/filter.h"
+#include "../include/quickstream/controller.h"
 
 
 // Allocate all buffer structures for all filters in the stream.
@@ -90,6 +91,9 @@ void FreeBuffers(struct QsFilter *f) {
         DASSERT(output->readers);
         DASSERT(output->buffer);
 
+        TagsFreeOutput(output);
+        LatencyFreeOutput(output);
+
         if(output->prev) {
             // This is a "pass through" buffer so there is nothing to
             // free.  This pointed to an up stream filter output buffer.
@@ -230,6 +234,7 @@ void MapRingBuffers(struct QsFilter *f) {
 
         // Initialize the writer
         output->writePtr = output->buffer->end - output->buffer->mapLength;
+        output->writeCount = 0;
 
         DASSERT(output->numReaders);
         DASSERT(output->readers);
@@ -238,6 +243,7 @@ void MapRingBuffers(struct QsFilter *f) {
             // Initialize the readers
             output->readers[j].readPtr = output->writePtr;
             output->readers[j].buffer = output->buffer;
+            output->readers[j].output = output;
         }
     }
 
@@ -251,3 +257,36 @@ void MapRingBuffers(struct QsFilter *f) {
                 MapRingBuffers(output->readers[j].filter);
     }
 }
+
+
+int qsFilterOutputOccupancy(struct QsFilter *f, uint32_t outputPortNum,
+        uint32_t readerIndex, struct QsFilter **readFilter,
+        uint32_t *inputPortNum, size_t *length, size_t *maxLength) {
+
+    DASSERT(f);
+
+    if(outputPortNum >= f->numOutputs || !f->outputs)
+        return -1; // error
+    struct QsOutput *output = f->outputs + outputPortNum;
+    if(!output->readers || !output->buffer)
+        // The stream is not ready.
+        return -1; // error
+
+    if(readerIndex >= output->numReaders)
+        return 1; // no more readers
+
+    struct QsReader *reader = output->readers + readerIndex;
+
+    if(readFilter)
+        *readFilter = reader->filter;
+    if(inputPortNum)
+        *inputPortNum = reader->inputPortNum;
+    if(length)
+        // This is read without a stream mutex lock, so it may be a
+        // little old, but it's never torn.
+        *length = __atomic_load_n(&reader->readLength, __ATOMIC_RELAXED);
+    if(maxLength)
+        *maxLength = output->maxLength;
+
+    return 0; // success
+}
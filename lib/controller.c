@@ -12,6 +12,7 @@
 
 // The public installed user interfaces:
 #include "../include/quickstream/app.h"
+#include "../include/quickstream/controller.h"
 
 // Private interfaces.
 #include "debug.h"
@@ -349,7 +350,7 @@ struct QsController *qsAppControllerLoad(struct QsApp *app,
     }
     app->last = c;
 
-    c->parameters = qsDictionaryCreate();
+    c->parameters = qsDictionaryCreateArena();
 
 
     // We need thread specific data to tell what controller this is when
@@ -450,6 +451,7 @@ int qsControllerUnload(struct QsController *c) {
                 qsDictionaryRemove(f->preInputCallbacks, c->name);
             if(f->postInputCallbacks)
                 qsDictionaryRemove(f->postInputCallbacks, c->name);
+            LatencyFree(f, c);
         }
 
 
@@ -462,3 +464,59 @@ int qsControllerUnload(struct QsController *c) {
 
     return 0; // success
 }
+
+
+// The tuning functions must be called from a controller preStart(), when
+// the filter ports are set up and the filter start() is not called yet.
+static inline
+void CheckTuning(struct QsStream *s) {
+
+    DASSERT(s);
+    struct QsController *c = pthread_getspecific(_qsControllerKey);
+    ASSERT(c, "Not called from a controller");
+    ASSERT(c->mark == _QS_IN_PRESTART, "Controller \"%s\" did not"
+            " call this in preStart()", c->name);
+    ASSERT(s->app == c->app, "stream is from a different app than"
+            " controller \"%s\"", c->name);
+}
+
+
+void qsStreamTuneThreads(struct QsStream *s, uint32_t maxThreads) {
+
+    CheckTuning(s);
+    s->tuneMaxThreads = maxThreads;
+}
+
+
+int qsFilterTuneOutput(struct QsFilter *f, uint32_t outputPortNum,
+        size_t maxWrite) {
+
+    DASSERT(f);
+    CheckTuning(f->stream);
+
+    if(outputPortNum >= f->numOutputs) {
+        ERROR("filter \"%s\" has no output port %" PRIu32,
+                f->name, outputPortNum);
+        return -1; // error
+    }
+
+    f->outputs[outputPortNum].tuneMaxWrite = maxWrite;
+    return 0; // success
+}
+
+
+int qsFilterTuneInput(struct QsFilter *f, uint32_t inputPortNum,
+        size_t maxRead) {
+
+    DASSERT(f);
+    CheckTuning(f->stream);
+
+    if(inputPortNum >= f->numInputs) {
+        ERROR("filter \"%s\" has no input port %" PRIu32,
+                f->name, inputPortNum);
+        return -1; // error
+    }
+
+    f->readers[inputPortNum]->tuneMaxRead = maxRead;
+    return 0; // success
+}
@@ -1,16 +1,27 @@
 
-// Controllers may setup post filter input() callbacks.
+// Controllers may setup pre and post filter input() callbacks.
 // The filters keep a list of these:
 //
 struct ControllerCallback {
 
-    int (*callback)(
-            struct QsFilter *filter,
-            const size_t lenIn[],
-            const size_t lenOut[],
-            const bool isFlushing[],
-            uint32_t numInputs, uint32_t numOutputs,
-            void *userData);
+    union {
+        // Post-input callback from qsAddPostFilterInput().
+        int (*callback)(
+                struct QsFilter *filter,
+                const size_t lenIn[],
+                const size_t lenOut[],
+                const bool isFlushing[],
+                uint32_t numInputs, uint32_t numOutputs,
+                void *userData);
+
+        // Pre-input callback from qsAddPreFilterInput().
+        int (*preCallback)(
+                struct QsFilter *filter,
+                const size_t lenIn[],
+                const bool isFlushing[],
+                uint32_t numInputs, uint32_t numOutputs,
+                void *userData);
+    };
     void *userData;
 
     // This is used to mark that a non-zero value was returned from the
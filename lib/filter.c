@@ -22,12 +22,26 @@
 #include "GetPath.h"
 #include "filterAPI.h"
 #include "LoadDSOFromTmpFile.h"
+#include "filterRegistry.h"
 
 
 int qsFilterPrintHelp(const char *filterName, FILE *f) {
 
     if(f == 0) f = stderr;
 
+    const struct QsStaticFilter *module = FindStaticFilter(filterName);
+
+    if(module) {
+        if(!module->help) {
+            ERROR("Static filter module \"%s\" has no help() provided",
+                    module->name);
+            return 1; // error
+        }
+        fprintf(f, "\nfilter (static) name=%s\n\n", module->name);
+        module->help(f);
+        return 0; // success
+    }
+
     char *path = GetPluginPath("filters/", filterName);
 
     void *handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
@@ -59,9 +73,9 @@ int qsFilterPrintHelp(const char *filterName, FILE *f) {
 }
 
 
-struct QsFilter *qsStreamFilterLoad(struct QsStream *s,
+struct QsFilter *qsStreamFilterLoadWithFlags(struct QsStream *s,
         const char *fileName, const char *_loadName,
-        int argc, const char **argv) {
+        int argc, const char **argv, uint32_t flags) {
 
     DASSERT(_qsMainThread == pthread_self(), "Not main thread");
     DASSERT(s);
@@ -126,10 +140,60 @@ struct QsFilter *qsStreamFilterLoad(struct QsStream *s,
     }
 
 
-    char *path = GetPluginPath("filters/", fileName);
+    const struct QsStaticFilter *module = FindStaticFilter(fileName);
+    char *path;
+    void *handle = 0;
+    int (* construct)(int argc, const char **argv);
+    struct QsFilter *f;
 
+    if(module) {
+        //
+        // This filter module is linked into the program, so there is no
+        // DSO to load.  Since there is just one copy of the module's
+        // static data there can only be one filter using it at a time.
+        //
+        for(struct QsStream *ss = s->app->streams; ss; ss = ss->next)
+            for(struct QsFilter *ff = ss->filters; ff; ff = ff->next)
+                if(ff->module == module) {
+                    ERROR("Static filter module \"%s\" is in use by "
+                            "filter \"%s\"", module->name, ff->name);
+                    return 0;
+                }
+
+        path = strdup(module->name);
+        ASSERT(path, "strdup() failed");
+
+        f = AllocAndAddToFilterList(s, loadName);
+
+        construct = module->construct;
+        f->start = module->start;
+        f->stop = module->stop;
+        // qsFilterRegisterStatic() made sure there is an input().
+        f->input = module->input;
+        DASSERT(f->input);
+
+        if(!module->help) {
+#ifdef QS_FILTER_REQUIRE_HELP
+            ERROR("no help() provided in static filter module \"%s\"",
+                    module->name);
+            goto cleanup;
+#else
+            WARN("Filter \"%s\" static module \"%s\" does not provide a "
+                "help() function.",
+                f->name, module->name);
+#endif
+        }
 
-    void *handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+        f->module = module;
+
+        goto loaded;
+    }
+
+
+    path = GetPluginPath("filters/", fileName);
+
+
+    handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
 
     if(!handle) {
         ERROR("Failed to dlopen(\"%s\",): %s", path, dlerror());
@@ -159,12 +223,11 @@ struct QsFilter *qsStreamFilterLoad(struct QsStream *s,
     }
 
 
-    struct QsFilter *f = AllocAndAddToFilterList(s, loadName);
+    f = AllocAndAddToFilterList(s, loadName);
 
     // If "construct", "destroy", "start", or "stop"
     // are not present, that's okay, they are optional.
-    int (* construct)(int argc, const char **argv) =
-        dlsym(handle, "construct");
+    construct = dlsym(handle, "construct");
     f->start = dlsym(handle, "start");
     f->stop = dlsym(handle, "stop");
 
@@ -196,6 +259,7 @@ struct QsFilter *qsStreamFilterLoad(struct QsStream *s,
 #endif
     }
 
+loaded:
 
     f->app = s->app;
     f->stream = s;
@@ -203,7 +267,7 @@ struct QsFilter *qsStreamFilterLoad(struct QsStream *s,
     f->dlhandle = handle;
 
     // Create a parameters dictionary:
-    f->parameters = qsDictionaryCreate();
+    f->parameters = qsDictionaryCreateArena();
     ASSERT(f->parameters);
 
     DASSERT(f->stream->dict);
@@ -266,6 +330,15 @@ struct QsFilter *qsStreamFilterLoad(struct QsStream *s,
         //else Success.
     }
 
+    if(flags & QS_FILTER_PROCESS) {
+        if(f->maxThreads > 1) {
+            WARN("filter \"%s\" input() will not be multi-threaded in "
+                    "a helper process", f->name);
+            f->maxThreads = 1;
+        }
+        ProcessInit(f);
+    }
+
 
     INFO("Successfully loaded module Filter %s with name \"%s\"",
             path, f->name);
@@ -284,6 +357,15 @@ cleanup:
 
 
 
+struct QsFilter *qsStreamFilterLoad(struct QsStream *s,
+        const char *fileName, const char *loadName,
+        int argc, const char **argv) {
+
+    return qsStreamFilterLoadWithFlags(s, fileName, loadName,
+            argc, argv, 0);
+}
+
+
 struct QsFilter *qsFilterGetFromName(struct QsStream *stream,
         const char *filterName) {
 
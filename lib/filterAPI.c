@@ -55,6 +55,13 @@ void qsOutput(uint32_t outputPortNum, const size_t len) {
     DASSERT(output->numReaders);
 
 
+    // Check for this user error.  Writing part of a granule would
+    // leave the write pointer unaligned.
+    ASSERT(len % output->granule == 0,
+            "Filter \"%s\" output port %" PRIu32 " length %zu is not"
+            " a multiple of %zu", f->name, outputPortNum, len,
+            output->granule);
+
     // This is all this function needed to do.
     j->outputLens[outputPortNum] += len;
 
@@ -116,10 +123,17 @@ void qsAdvanceInput(uint32_t inputPortNum, size_t len) {
 
     DASSERT(inputPortNum < f->numInputs);
 
-    j->advanceLens[inputPortNum] += len;
-
     DASSERT(f->readers);
 
+    // Check for this user error.  Reading part of a granule would leave
+    // the read pointer unaligned.
+    ASSERT(len % f->readers[inputPortNum]->granule == 0,
+            "Filter \"%s\" input port %" PRIu32 " advance length %zu"
+            " is not a multiple of %zu", f->name, inputPortNum, len,
+            f->readers[inputPortNum]->granule);
+
+    j->advanceLens[inputPortNum] += len;
+
     // Check if the buffer is being over-read.  If the filter really read
     // this much data than it will have read past the write pointer.
     ASSERT(j->advanceLens[inputPortNum] <=
@@ -210,6 +224,80 @@ void qsCreateOutputBuffer(uint32_t outputPortNum, size_t maxWriteLen) {
 }
 
 
+// Returns the least common multiple of the element size and the
+// alignment, which is the smallest length that can be read or written
+// and keep the element boundaries and alignment.
+static inline
+size_t GetGranule(size_t elementSize, size_t alignment) {
+
+    // These are filter API user errors.
+    ASSERT(elementSize, "The element size cannot be 0");
+    ASSERT((alignment & (alignment - 1)) == 0,
+            "alignment=%zu is not a power of 2", alignment);
+    ASSERT(alignment <= (size_t) getpagesize(),
+            "alignment=%zu is larger than the page size", alignment);
+
+    if(alignment < 2 || elementSize % alignment == 0)
+        return elementSize;
+
+    // alignment is a power of 2, so we just need the factors of 2 that
+    // are not in elementSize.
+    size_t granule = elementSize;
+    while(granule % alignment)
+        granule *= 2;
+    return granule;
+}
+
+
+void qsSetInputType(uint32_t inputPortNum, const char *typeName,
+        size_t elementSize, size_t alignment) {
+
+    // We only call this in the main thread in start().
+    DASSERT(_qsMainThread == pthread_self(), "Not main thread");
+    struct QsFilter *f = pthread_getspecific(_qsKey);
+    DASSERT(f);
+    ASSERT(f->mark == _QS_IN_START, "Not in filter start()");
+    struct QsStream *s = f->stream;
+    DASSERT(s);
+    ASSERT(s->flags & _QS_STREAM_START, "Stream is not starting");
+    DASSERT(!(s->flags & _QS_STREAM_STOP), "Stream is stopping");
+    // This would be a user error.
+    ASSERT(inputPortNum < f->numInputs);
+    DASSERT(f->readers);
+
+    struct QsReader *r = f->readers[inputPortNum];
+    r->typeName = typeName;
+    r->elementSize = elementSize;
+    r->granule = GetGranule(elementSize, alignment);
+
+    // The threshold and read promise get rounded up to a multiple of
+    // granule after all the filter start()s are called.
+}
+
+
+void qsSetOutputType(uint32_t outputPortNum, const char *typeName,
+        size_t elementSize, size_t alignment) {
+
+    // We only call this in the main thread in start().
+    DASSERT(_qsMainThread == pthread_self(), "Not main thread");
+    struct QsFilter *f = pthread_getspecific(_qsKey);
+    DASSERT(f);
+    ASSERT(f->mark == _QS_IN_START, "Not in filter start()");
+    struct QsStream *s = f->stream;
+    DASSERT(s);
+    ASSERT(s->flags & _QS_STREAM_START, "Stream is not starting");
+    DASSERT(!(s->flags & _QS_STREAM_STOP), "Stream is stopping");
+    // This would be a user error.
+    ASSERT(outputPortNum < f->numOutputs);
+    DASSERT(f->outputs);
+
+    struct QsOutput *output = f->outputs + outputPortNum;
+    output->typeName = typeName;
+    output->elementSize = elementSize;
+    output->granule = GetGranule(elementSize, alignment);
+}
+
+
 static inline
 struct QsOutput *FindFeedOutput(struct QsFilter *feed, struct QsFilter *fed,
         uint32_t fedInPort) {
@@ -362,12 +450,40 @@ const char* qsGetFilterName(void) {
 }
 
 
+void qsSetFilterUserData(void *userData) {
+
+    DASSERT(_qsMainThread == pthread_self(), "Not main thread");
+    struct QsFilter *f = pthread_getspecific(_qsKey);
+    ASSERT(f, "qsSetFilterUserData() not called in a filter module");
+    ASSERT(f->mark == _QS_IN_CONSTRUCT || f->mark == _QS_IN_DESTROY ||
+            f->mark == _QS_IN_START || f->mark == _QS_IN_STOP,
+            "f->mark=%" PRIx32, f->mark);
+
+    f->userData = userData;
+}
+
+
+void *qsGetFilterUserData(void) {
+
+    // This may be called in input() so it could be a job or a filter in
+    // thread specific data.
+    struct QsFilter *f = GetFilter();
+    ASSERT(f, "qsGetFilterUserData() not called in a filter module");
+
+    return f->userData;
+}
+
+
 struct QsFilter *qsFilterFromName(struct QsStream *stream,
         const char *filterName) {
 
     DASSERT(stream);
     DASSERT(stream->dict);
 
+    if(stream->frozenFilters)
+        return (struct QsFilter *)
+            qsFrozenDictionaryFind(stream->frozenFilters, filterName);
+
     return (struct QsFilter *) qsDictionaryFind(stream->dict, filterName);
 }
 
@@ -389,6 +505,10 @@ void qsSetThreadSafe(uint32_t maxThreads) {
     // use of maxThreads=0, so that there is at least one thread.
     if(maxThreads == 0) f->maxThreads = 1;
     else f->maxThreads = maxThreads;
+
+    ASSERT(f->maxThreads == 1 || !f->numDeferredParameters,
+            "Filter \"%s\" with deferred parameters cannot be"
+            " multi-threaded", f->name);
 }
 
 
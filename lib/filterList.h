@@ -42,9 +42,17 @@ void FreeFilter(struct QsFilter *f) {
     DASSERT(f->app);
     DASSERT(f->stream);
 
+    // Kill the helper process, if there is one still running.
+    ProcessFree(f);
+
+    if(f->dlhandle || f->module) {
+        int (* destroy)(void);
+        if(f->dlhandle)
+            destroy = dlsym(f->dlhandle, "destroy");
+        else
+            // This filter module is linked into the program.
+            destroy = f->module->destroy;
 
-    if(f->dlhandle) {
-        int (* destroy)(void) = dlsym(f->dlhandle, "destroy");
         if(destroy) {
 
             struct QsFilter *oldFilter = pthread_getspecific(_qsKey);
@@ -91,7 +99,7 @@ void FreeFilter(struct QsFilter *f) {
         }
 
         dlerror(); // clear error
-        if(dlclose(f->dlhandle))
+        if(f->dlhandle && dlclose(f->dlhandle))
             WARN("dlclose(%p): %s", f->dlhandle, dlerror());
             // TODO: So what can I do.
     }
@@ -100,6 +108,7 @@ void FreeFilter(struct QsFilter *f) {
         qsDictionaryDestroy(f->preInputCallbacks);
     if(f->postInputCallbacks)
         qsDictionaryDestroy(f->postInputCallbacks);
+    LatencyFree(f, 0);
 
 
 #ifdef DEBUG
@@ -144,6 +153,7 @@ void DestroyFilter(struct QsStream *s, struct QsFilter *f) {
         // This will cleanup all the parameter data using the qsDictionary
         // SetFreeValueOnDestroy thingy.
         qsDictionaryDestroy(f->parameters);
+    FreeParameterIndex(f);
 
     ASSERT(0 == qsDictionaryRemove(s->dict, f->name),
             "Can't remove filter \"%s\" from source dict", f->name);
@@ -0,0 +1,103 @@
+#include <string.h>
+#include <stdlib.h>
+#include <alloca.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+// The public installed user interfaces:
+#include "../include/quickstream/app.h"
+
+// Private interfaces.
+#include "debug.h"
+#include "Dictionary.h"
+#include "qs.h"
+#include "filterRegistry.h"
+
+
+// Statically linked filter modules are kept in a process wide dictionary
+// keyed by the filter module name.  It's not part of any app because
+// filters may be registered from a library constructor before main() is
+// called, and the code and static data in a filter module is process
+// wide anyway.
+//
+// This dictionary is never destroyed.  It just holds pointers to the
+// users static data.
+//
+static struct QsDictionary *registry = 0;
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+int qsFilterRegisterStatic(const struct QsStaticFilter *filter) {
+
+    DASSERT(filter);
+
+    if(!filter->name || !filter->name[0]) {
+        ERROR("A static filter module needs a name");
+        return -1;
+    }
+    if(!filter->input) {
+        // We must have a input() function.
+        ERROR("Static filter module \"%s\" has no input() function",
+                filter->name);
+        return -2;
+    }
+    if(strlen(filter->name) > _QS_FILTER_MAXNAMELEN) {
+        ERROR("Static filter module name \"%s\" is too long",
+                filter->name);
+        return -3;
+    }
+
+    CHECK(pthread_mutex_lock(&mutex));
+
+    if(!registry)
+        registry = qsDictionaryCreate();
+
+    int ret = qsDictionaryInsert(registry, filter->name, filter, 0);
+
+    CHECK(pthread_mutex_unlock(&mutex));
+
+    if(ret < 0) {
+        // qsDictionaryInsert() spewed already.
+        return -4;
+    }
+    if(ret)
+        NOTICE("Static filter module \"%s\" is already registered",
+                filter->name);
+    else
+        DSPEW("Registered static filter module \"%s\"", filter->name);
+
+    return ret;
+}
+
+
+const struct QsStaticFilter *FindStaticFilter(const char *name) {
+
+    DASSERT(name);
+    DASSERT(name[0]);
+
+    const struct QsStaticFilter *filter = 0;
+
+    CHECK(pthread_mutex_lock(&mutex));
+
+    if(!registry) {
+        // Nothing was ever registered, which is the common case.
+        CHECK(pthread_mutex_unlock(&mutex));
+        return 0;
+    }
+
+    filter = qsDictionaryFind(registry, name);
+
+    size_t len = strlen(name);
+    if(!filter && len > 3 && strcmp(name + len - 3, ".so") == 0) {
+        // Try it without the ".so" suffix.
+        char *key = alloca(len - 2);
+        memcpy(key, name, len - 3);
+        key[len - 3] = '\0';
+        if(key[0])
+            filter = qsDictionaryFind(registry, key);
+    }
+
+    CHECK(pthread_mutex_unlock(&mutex));
+
+    return filter;
+}
@@ -0,0 +1,9 @@
+
+// The statically linked filter module registry.  See
+// qsFilterRegisterStatic() in app.h.
+//
+// Returns the registered filter module for the name, with or without a
+// ".so" suffix, or 0 if there is none.
+//
+extern
+const struct QsStaticFilter *FindStaticFilter(const char *name);
@@ -7,11 +7,13 @@
 #include <inttypes.h>
 #include <pthread.h>
 #include <stdatomic.h>
+#include <time.h>
 
 
 #include "debug.h"
 #include "qs.h"
 #include "flowJobLists.h"
+#include "trace.h"
 #include "../include/quickstream/filter.h"
 #include "controllerCallbacks.h"
 #include "Dictionary.h"
@@ -124,8 +126,11 @@ bool CheckFilterInputCallable(struct QsFilter *f) {
             struct QsFilter *rf = reader->filter;
             uint32_t inPort = reader->inputPortNum;
 
-            if(rf->readers[inPort]->readLength >= output->maxLength) {
-                // We have at least one clogged output reader.  It has a
+            if(rf->readers[inPort]->readLength >= output->maxLength &&
+                    !rf->mark) {
+                // We have at least one clogged output reader.  A reader
+                // filter that is finished will never read, so it does not
+                // clog.  It has a
                 // full amount that it can read.  And so we will not be
                 // able to call input().  Otherwise we could overrun the
                 // read pointer with the write pointer.
@@ -156,21 +161,50 @@ bool CheckFilterInputCallable(struct QsFilter *f) {
 }
 
 
-static void
-PostInputCallback(const char *key, struct  ControllerCallback *cb,
-        struct QsJob *j) {
-
-    struct QsFilter *f = j->filter;
+// This is called without a stream mutex lock, from the thread that is
+// about to call the filter input().  If the filter input() is thread
+// safe more than one thread may be in here, so the callbacks array is not
+// changed while the stream flows.  A callback that returned non-zero is
+// marked by its atomic returnValue and skipped, and qsStreamStop() removes
+// it from the filter preInputCallbacks dictionary.
+static inline
+void PreInputCallbacks(struct QsFilter *f, struct QsJob *j) {
+
+    for(uint32_t i=0; i<f->numPreInputCBs; ++i) {
+        struct ControllerCallback *cb = f->preInputCBs[i];
+        if(atomic_load(&cb->returnValue))
+            // It's finished.
+            continue;
+        int ret = cb->preCallback(f, j->inputLens,
+                j->isFlushing, f->numInputs, f->numOutputs,
+                cb->userData);
+        if(ret)
+            atomic_store(&cb->returnValue, ret);
+    }
+}
 
-    // Note: we can't edit the list of callbacks while the stream is
-    // running.  We just made it simple that way.
 
-    if(!cb->returnValue)
-        cb->returnValue = cb->callback(f,
+// This is called without a stream mutex lock, from the thread that just
+// called the filter input().  The job lengths that we pass are not
+// changed until this thread calls input() again.  Like in
+// PreInputCallbacks() the callbacks array is not changed, and the
+// callbacks that are finished are skipped.
+static inline
+void PostInputCallbacks(struct QsFilter *f, struct QsJob *j) {
+
+    for(uint32_t i=0; i<f->numPostInputCBs; ++i) {
+        struct ControllerCallback *cb = f->postInputCBs[i];
+        if(atomic_load(&cb->returnValue))
+            // It's finished.
+            continue;
+        int ret = cb->callback(f,
                 j->advanceLens, // input lengths
                 j->outputLens,  // output lengths
-            j->isFlushing, f->numInputs, f->numOutputs,
-            cb->userData);
+                j->isFlushing, f->numInputs, f->numOutputs,
+                cb->userData);
+        if(ret)
+            atomic_store(&cb->returnValue, ret);
+    }
 }
 
 
@@ -219,10 +253,35 @@ bool RunInput(struct QsStream *s, struct QsFilter *f, struct QsJob *j) {
     // At this point this filter/thread owns this job.
     //
     int inputRet;
+    uint64_t traceBegin = 0, traceEnd = 0, traceLock = 0;
+
+    if(f->numDeferredParameters && !f->process &&
+            atomic_load_explicit(&f->deferredPending,
+                memory_order_relaxed))
+        // Apply qsParameterSet() values for this filter.  A filter with
+        // a helper process has them applied in the helper process.
+        ApplyDeferredParameters(f);
+
+    if(f->numPreInputCBs)
+        // Call all controller preInput callbacks for this filter.
+        PreInputCallbacks(f, j);
+
+    if(s->trace)
+        traceBegin = TraceTime();
 
     inputRet = f->input(j->inputBuffers, j->inputLens,
             j->isFlushing, f->numInputs, f->numOutputs);
 
+    if(s->trace)
+        traceEnd = TraceTime();
+
+    if(f->numPostInputCBs)
+        // Call all controller postInput callbacks for this filter,
+        // before we get the stream mutex lock.
+        PostInputCallbacks(f, j);
+
+    if(s->trace)
+        traceLock = TraceTime();
 
     // Note: all these "for" loop iteration are through just the number of
     // inputs and outputs to and from the filter.  Usually there'll be
@@ -271,9 +330,14 @@ bool RunInput(struct QsStream *s, struct QsFilter *f, struct QsJob *j) {
 
 
     // STREAM LOCK
-    CHECK(pthread_mutex_lock(&s->mutex));
+    StreamLock(s, QS_LOCK_RUNINPUT);
+
+    if(s->trace) {
+        TraceAdd(s->trace, QS_TRACE_INPUT, traceBegin, traceEnd, f, j);
+        TraceAdd(s->trace, QS_TRACE_MUTEX, traceLock, TraceTime(), f, 0);
+    }
 
-    CheckLockFilter(f);
+    CheckLockFilter(f, QS_LOCK_FILTER_RUNINPUT);
 
     // Advance the output write pointers and see if we can write more.
     //
@@ -298,6 +362,7 @@ bool RunInput(struct QsStream *s, struct QsFilter *f, struct QsJob *j) {
         output->writePtr += j->outputLens[i];
         if(output->writePtr >= output->buffer->end)
             output->writePtr -= output->buffer->mapLength;
+        output->writeCount += j->outputLens[i];
 
         for(uint32_t k=output->numReaders-1; k!=-1; --k) {
             struct QsReader *reader = output->readers + k;
@@ -313,7 +378,7 @@ bool RunInput(struct QsStream *s, struct QsFilter *f, struct QsJob *j) {
             rf->readers[inPort]->readLength += j->outputLens[i];
 
             if(rf->readers[inPort]->readLength >= output->maxLength &&
-                    outputsHungry)
+                    !rf->mark && outputsHungry)
                 // We have at least one clogged output reader.  It has
                 // a full amount that it can read.  And so we will not
                 // be continuing to call input().  Otherwise we could
@@ -322,6 +387,10 @@ bool RunInput(struct QsStream *s, struct QsFilter *f, struct QsJob *j) {
         }
     }
 
+    if(j->numOutputTags)
+        // Move the tags from this input() call to the outputs.
+        TagsCommit(f, j);
+
 
     // Advance the read pointers that feed this filter, f; and tally the
     // readers remaining length.
@@ -354,7 +423,7 @@ bool RunInput(struct QsStream *s, struct QsFilter *f, struct QsJob *j) {
         // input() function decide when it wants to use the data that has
         // been inputted to it.
         //
-                    || f->readers[i]->readLength > j->inputLens[i]
+                    || GetReadableLength(f->readers[i]) > j->inputLens[i]
 #endif
                     ) && inputAdvanced == false)
             inputAdvanced = true;
@@ -371,13 +440,18 @@ bool RunInput(struct QsStream *s, struct QsFilter *f, struct QsJob *j) {
  
         //j->inputLens[i] = f->readers[i]->readLength;
 
-        if(j->inputLens[i] >= r->maxRead)
-            // This filter module is not written correctly.
+        if(j->inputLens[i] >= r->maxRead && inputRet == 0)
+            // This filter module is not written correctly.  If input()
+            // returned non-zero it will not be called again, so it
+            // does not matter.
             ASSERT(j->advanceLens[i],
                     "The filter \"%s\" did not keep it's read promise"
                     " for input port %" PRIu32,
                     f->name, i);
 
+        if(f->latency && j->advanceLens[i])
+            LatencyAdvance(f, i, j->advanceLens[i]);
+
         // Advance read pointer 
         r->readPtr += j->advanceLens[i];
         // Record the length that we have left to read up to the write
@@ -393,6 +467,11 @@ bool RunInput(struct QsStream *s, struct QsFilter *f, struct QsJob *j) {
     }
 
 
+    if(f->latency)
+        // Make latency samples for what this input() call wrote.
+        LatencyCommit(f, j);
+
+
     if(f->numInputs == 0) {
         // We pretend we got the needed input if there are no inputs (a
         // source).
@@ -424,13 +503,6 @@ bool RunInput(struct QsStream *s, struct QsFilter *f, struct QsJob *j) {
     }
 
 
-    if(f->postInputCallbacks)
-        // Call all controller postInput callbacks for this filter.
-        qsDictionaryForEach(f->postInputCallbacks,
-            (int (*) (const char *key, void *value,
-                void *userData)) PostInputCallback, j);
-
-
     bool ret = true;
 
     if(inputRet || f->mark) {
@@ -446,9 +518,10 @@ bool RunInput(struct QsStream *s, struct QsFilter *f, struct QsJob *j) {
         //
         for(uint32_t i=f->numInputs-1; i!=-1; --i) {
 
-            j->inputLens[i] = f->readers[i]->readLength;
+            j->inputLens[i] = GetReadableLength(f->readers[i]);
             j->advanceLens[i] = 0;
             j->inputBuffers[i] = f->readers[i]->readPtr;
+            GetInputTags(f, j, i);
         }
 
         for(uint32_t i=f->numOutputs-1; i!=-1; --i)
@@ -576,7 +649,7 @@ bool RunInput(struct QsStream *s, struct QsFilter *f, struct QsJob *j) {
         // stream mutex lock at the start of this function.
         //
         // STREAM UNLOCK
-        CHECK(pthread_mutex_unlock(&s->mutex));
+        StreamUnlock(s);
     // else
     //    We return with the STREAM LOCK
 
@@ -632,11 +705,19 @@ struct QsJob *GetWork(struct QsStream *s) {
                 " thread(s) waiting for work",
                 s->numIdleThreads, s->numThreads);
 
+        uint64_t traceBegin = 0;
+        if(s->trace)
+            traceBegin = TraceTime();
+
         // STREAM UNLOCK  -- at wait
         // wait
-        CHECK(pthread_cond_wait(&s->cond, &s->mutex));
+        StreamCondWait(s, &s->cond, QS_LOCK_GETWORK);
         // STREAM LOCK  -- when woken.
 
+        if(s->trace)
+            TraceAdd(s->trace, QS_TRACE_IDLE, traceBegin, TraceTime(),
+                    0, 0);
+
         // Remove ourselves from the numIdleThreads.
         --s->numIdleThreads;
 
@@ -666,7 +747,7 @@ void *RunningWorkerThread(struct QsWorkPermit *p) {
 
 
     // STREAM LOCK
-    CHECK(pthread_mutex_lock(&s->mutex));
+    StreamLock(s, QS_LOCK_WORKER);
 
     // numWorkerThreads is almost the same as numThreads but counts after
     // mutex lock.  We need this numWorkerThreads counter, because it
@@ -702,7 +783,7 @@ void *RunningWorkerThread(struct QsWorkPermit *p) {
 
 
         // If f is not a multi-threaded filter than this does nothing.
-        CheckLockFilter(f);
+        CheckLockFilter(f, QS_LOCK_FILTER_WORKER);
 
         // We need to set get the current read pointer into the current
         // job, j and find the total length that can be read.
@@ -712,14 +793,16 @@ void *RunningWorkerThread(struct QsWorkPermit *p) {
             // time this filter had input() called.
             //
             j->inputBuffers[i] = f->readers[i]->readPtr;
-            j->inputLens[i] = f->readers[i]->readLength;
+            // Only whole element granules, if the port is typed.
+            j->inputLens[i] = GetReadableLength(f->readers[i]);
+            GetInputTags(f, j, i);
         }
 
         // Ya, undo that lock.
         CheckUnlockFilter(f);
 
         // STREAM UNLOCK
-        CHECK(pthread_mutex_unlock(&s->mutex));
+        StreamUnlock(s);
  
 
         // This thread can now read and write to this job, j, without a
@@ -780,7 +863,7 @@ void *RunningWorkerThread(struct QsWorkPermit *p) {
     --s->numWorkerThreads;
 
     // STREAM UNLOCK
-    CHECK(pthread_mutex_unlock(&s->mutex));
+    StreamUnlock(s);
 
     free(p);
 
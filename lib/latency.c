@@ -0,0 +1,278 @@
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+
+// The public installed user interfaces:
+#include "../include/quickstream/app.h"
+#include "../include/quickstream/controller.h"
+
+
+// Private interfaces.
+#include "debug.h"
+#include "qs.h"
+
+
+// In this file is the sampled end-to-end latency tracing code.
+//
+// A controller turns on latency tracing for a filter with
+// qsAddFilterLatency().  Every sampleEvery input() calls, a source filter
+// writes a latency sample to each output that it wrote to in that call.
+// A sample is the absolute offset (see QsOutput::writeCount) of the
+// first byte that was written in that call, the time that it was written
+// (the edge time), and the same time as the origin time.  When a reading
+// filter advances its input past the sample offset, we have the latency
+// of that connection (edge), and the latency from the source (origin).
+// If the reading filter has outputs, the origin time is passed on, as a
+// new sample, to the first bytes that the filter writes in the same
+// input() call.  So samples flow from sources to sinks through the graph,
+// one connection at a time.
+//
+// All this is done with the stream mutex lock in RunInput(), just after
+// the output write pointers and input read pointers are advanced, so
+// that nothing else needs a lock.  Only input() calls that make or match
+// a sample read the clock, so it's cheap enough to leave on.
+//
+// Samples are kept in a ring in the output, in offset order, and are
+// removed when no reader can see them, just like stream tags in tags.c.
+// A reader only looks at the samples from its own pass-through level, so
+// that each connection has its own latency.
+
+
+// The first allocated size of a sample ring.
+#define LATENCY_MINSIZE  ((uint32_t) 8)
+
+
+// A latency sample with an absolute offset.
+struct QsLatencySample {
+    uint64_t offset;
+    double edgeTime, originTime; // seconds CLOCK_MONOTONIC
+};
+
+
+// The samples for an output.  It is accessed with a stream mutex lock.
+struct QsLatencyRing {
+    struct QsLatencySample *samples;
+    uint32_t size; // power of 2
+    uint32_t first, num;
+};
+
+
+// The latency state for a filter.
+struct QsLatency {
+
+    // The controller that added it.
+    struct QsController *controller;
+
+    void (*callback)(struct QsFilter *filter, uint32_t inputPortNum,
+            double edgeLatency, double sourceLatency, void *userData);
+    void *userData;
+
+    // For source filters, a sample is made every sampleEvery input()
+    // calls.
+    uint32_t sampleEvery, count;
+
+    // The origin time of the oldest sample that the filter consumed in
+    // the current input() call, or 0 if none.
+    double origin;
+};
+
+
+static inline
+double GetTime(void) {
+
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + 1.0e-9 * t.tv_nsec;
+}
+
+
+int qsAddFilterLatency(struct QsFilter *f, uint32_t sampleEvery,
+        void (*callback)(struct QsFilter *filter, uint32_t inputPortNum,
+            double edgeLatency, double sourceLatency, void *userData),
+        void *userData) {
+
+    DASSERT(f);
+    struct QsController *c = pthread_getspecific(_qsControllerKey);
+    ASSERT(c);
+    DASSERT(c->name);
+    DASSERT(c->mark == _QS_IN_CCONSTRUCT ||
+            c->mark == _QS_IN_CDESTROY ||
+            c->mark == _QS_IN_PRESTART ||
+            c->mark == _QS_IN_POSTSTART ||
+            c->mark == _QS_IN_PRESTOP ||
+            c->mark == _QS_IN_POSTSTOP);
+    DASSERT(f->stream);
+    ASSERT(f->stream->app == c->app, "filter \"%s\" is from a"
+            " different app than controller \"%s\"",
+            f->name, c->name);
+    // We can't change it while the stream is flowing.
+    ASSERT(!(f->stream->flags & _QS_STREAM_LAUNCHED),
+            "filter \"%s\" latency cannot be changed while the stream"
+            " is flowing", f->name);
+
+    if(!callback) {
+        LatencyFree(f, 0);
+        return 0;
+    }
+
+    if(!f->latency) {
+        f->latency = calloc(1, sizeof(*f->latency));
+        ASSERT(f->latency, "calloc(1,%zu) failed", sizeof(*f->latency));
+    } else if(f->latency->controller != c)
+        INFO("Controller \"%s\" replaced filter \"%s\" latency callback",
+                c->name, f->name);
+
+    f->latency->controller = c;
+    f->latency->callback = callback;
+    f->latency->userData = userData;
+    f->latency->sampleEvery = sampleEvery?sampleEvery:1;
+    f->latency->count = 0;
+    f->latency->origin = 0;
+
+    return 0; // success
+}
+
+
+static inline
+void AddSample(struct QsOutput *output, uint64_t offset,
+        double edgeTime, double originTime) {
+
+    struct QsLatencyRing *r = output->latency;
+    if(!r) {
+        r = output->latency = calloc(1, sizeof(*r));
+        ASSERT(r, "calloc(1,%zu) failed", sizeof(*r));
+    }
+
+    // Remove the samples that no reader can see any more.
+    while(r->num && r->samples[r->first].offset +
+            output->buffer->mapLength <= output->writeCount) {
+        r->first = (r->first + 1) & (r->size - 1);
+        --r->num;
+    }
+
+    if(r->num == r->size) {
+        uint32_t size = r->size?(2*r->size):LATENCY_MINSIZE;
+        struct QsLatencySample *samples = malloc(size*sizeof(*samples));
+        ASSERT(samples, "malloc(%zu) failed", size*sizeof(*samples));
+        for(uint32_t i=0; i<r->num; ++i)
+            samples[i] = r->samples[(r->first + i) & (r->size - 1)];
+        free(r->samples);
+        r->samples = samples;
+        r->size = size;
+        r->first = 0;
+    }
+
+    // Samples are added in offset order, since one filter writes the
+    // output.
+    struct QsLatencySample *s =
+        r->samples + ((r->first + r->num++) & (r->size - 1));
+    s->offset = offset;
+    s->edgeTime = edgeTime;
+    s->originTime = originTime;
+}
+
+
+// Match the samples that filter, f, advanced past on input port, port.
+// This is called just before the reader readLength is reduced by len.
+//
+// There must be a stream mutex lock to call this.
+void LatencyAdvance(struct QsFilter *f, uint32_t port, size_t len) {
+
+    struct QsReader *reader = f->readers[port];
+    struct QsLatencyRing *r = reader->output->latency;
+    if(!r || !r->num) return;
+
+    uint64_t start = reader->output->writeCount - reader->readLength;
+    uint64_t end = start + len;
+
+    // Go from the newest sample back to the first one we advanced past.
+    uint32_t i = r->num;
+    while(i && r->samples[(r->first + i - 1) & (r->size - 1)].offset
+            >= end)
+        --i;
+    if(!i || r->samples[(r->first + i - 1) & (r->size - 1)].offset
+            < start)
+        // No samples in this advance.
+        return;
+    while(i && r->samples[(r->first + i - 1) & (r->size - 1)].offset
+            >= start)
+        --i;
+
+    double t = GetTime();
+    struct QsLatency *l = f->latency;
+
+    for(; i<r->num; ++i) {
+        struct QsLatencySample *s =
+            r->samples + ((r->first + i) & (r->size - 1));
+        if(s->offset >= end) break;
+        l->callback(f, port, t - s->edgeTime, t - s->originTime,
+                l->userData);
+        if(!l->origin || s->originTime < l->origin)
+            l->origin = s->originTime;
+    }
+}
+
+
+// Make samples for the input() call in job, j.  This is called after
+// LatencyAdvance() is called for all the filter, f, inputs.
+//
+// There must be a stream mutex lock to call this.
+void LatencyCommit(struct QsFilter *f, struct QsJob *j) {
+
+    struct QsLatency *l = f->latency;
+    double origin = l->origin;
+
+    if(!f->numOutputs) {
+        // A sink; the samples stop here.
+        l->origin = 0;
+        return;
+    }
+
+    if(!f->numInputs) {
+        if(++l->count < l->sampleEvery) return;
+        l->count = 0;
+    } else if(!origin)
+        return;
+
+    double t = 0;
+
+    for(uint32_t i=0; i<f->numOutputs; ++i) {
+        if(!j->outputLens[i]) continue;
+        if(!t) {
+            t = GetTime();
+            if(!origin) origin = t;
+        }
+        struct QsOutput *output = f->outputs + i;
+        // The first byte that was written in this input() call.
+        AddSample(output, output->writeCount - j->outputLens[i],
+                t, origin);
+    }
+
+    if(t)
+        // Keep the origin until the filter writes some output.
+        l->origin = 0;
+}
+
+
+void LatencyFreeOutput(struct QsOutput *output) {
+
+    if(!output->latency) return;
+
+    free(output->latency->samples);
+    free(output->latency);
+    output->latency = 0;
+}
+
+
+void LatencyFree(struct QsFilter *f, struct QsController *c) {
+
+    if(!f->latency) return;
+    if(c && f->latency->controller != c) return;
+
+    free(f->latency);
+    f->latency = 0;
+}
@@ -0,0 +1,208 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "../include/quickstream/app.h"
+
+#include "./debug.h"
+#include "./qs.h"
+
+
+// In this file is the code that measures the stream mutex and filter
+// mutex lock contention, that qsStreamLockStats() turns on.
+//
+// Each lock first tries pthread_mutex_trylock(); if that fails the mutex
+// was held by another thread and we time how long pthread_mutex_lock()
+// waits.  The time the lock is held is measured from the lock to the
+// unlock, and is counted for the site that locked it.  The thread keeps
+// the lock time and site in thread local storage between the lock and
+// the unlock, since the stream mutex is often locked in one function and
+// unlocked in another.
+//
+// The statistics are changed only while this thread has the stream mutex
+// lock (the filter mutex is only locked with the stream mutex locked), so
+// they need no lock of their own.
+
+
+static const char *siteNames[QS_LOCK_NUMSITES] = {
+    [QS_LOCK_RUNINPUT] = "RunInput",
+    [QS_LOCK_WORKER] = "RunningWorkerThread",
+    [QS_LOCK_GETWORK] = "GetWork",
+    [QS_LOCK_FLOW] = "nThreadFlow",
+    [QS_LOCK_WAIT] = "qsStreamWait",
+    [QS_LOCK_FILTER_RUNINPUT] = "RunInput filter mutex",
+    [QS_LOCK_FILTER_WORKER] = "RunningWorkerThread filter mutex"
+};
+
+
+// Counts in nanoseconds.
+struct QsLockSite {
+    uint64_t count, contended;
+    uint64_t wait, hold;
+    uint64_t condWaits, condWait;
+};
+
+
+struct QsLockProfile {
+
+    struct QsLockSite sites[QS_LOCK_NUMSITES];
+
+    // Filled in from sites[] in qsStreamGetLockStats().
+    struct QsLockStats stats[QS_LOCK_NUMSITES];
+};
+
+
+// When and where this thread locked the stream mutex and the filter
+// mutex.
+static __thread uint64_t streamLockTime, filterLockTime;
+static __thread uint32_t streamLockSite, filterLockSite;
+
+
+// Get the time in nanoseconds.
+static inline
+uint64_t GetTime(void) {
+
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return ((uint64_t) t.tv_sec)*1000000000 + t.tv_nsec;
+}
+
+
+void qsStreamLockStats(struct QsStream *s, bool doMeasure) {
+
+    DASSERT(_qsMainThread == pthread_self(), "Not main thread");
+    DASSERT(s);
+    ASSERT(!(s->flags & _QS_STREAM_LAUNCHED),
+            "stream lock statistics cannot be changed while the stream"
+            " is flowing");
+
+    if(!doMeasure) {
+        LockStatsFree(s);
+        return;
+    }
+
+    if(s->lockStats) return;
+
+    s->lockStats = calloc(1, sizeof(*s->lockStats));
+    ASSERT(s->lockStats, "calloc(1,%zu) failed", sizeof(*s->lockStats));
+}
+
+
+const struct QsLockStats *qsStreamGetLockStats(struct QsStream *s,
+        uint32_t *numSites) {
+
+    DASSERT(s);
+
+    if(numSites)
+        *numSites = s->lockStats?QS_LOCK_NUMSITES:0;
+
+    if(!s->lockStats) return 0;
+
+    for(uint32_t i=0; i<QS_LOCK_NUMSITES; ++i) {
+        struct QsLockSite *site = s->lockStats->sites + i;
+        struct QsLockStats *stats = s->lockStats->stats + i;
+        stats->site = siteNames[i];
+        stats->count = site->count;
+        stats->contended = site->contended;
+        stats->waitTime = 1.0e-9 * site->wait;
+        stats->holdTime = 1.0e-9 * site->hold;
+        stats->condWaits = site->condWaits;
+        stats->condWaitTime = 1.0e-9 * site->condWait;
+    }
+
+    return s->lockStats->stats;
+}
+
+
+void LockStatsLock(pthread_mutex_t *mutex, struct QsLockProfile *p,
+        uint32_t site) {
+
+    DASSERT(site < QS_LOCK_NUMSITES);
+
+    uint64_t t = GetTime();
+    struct QsLockSite *ls = p->sites + site;
+
+    int ret = pthread_mutex_trylock(mutex);
+    if(ret == EBUSY) {
+        CHECK(pthread_mutex_lock(mutex));
+        uint64_t now = GetTime();
+        ++ls->contended;
+        ls->wait += now - t;
+        t = now;
+    } else
+        ASSERT(ret == 0, "pthread_mutex_trylock()=%d FAILED", ret);
+
+    ++ls->count;
+
+    if(site >= QS_LOCK_FILTER_RUNINPUT) {
+        filterLockTime = t;
+        filterLockSite = site;
+    } else {
+        streamLockTime = t;
+        streamLockSite = site;
+    }
+}
+
+
+void LockStatsUnlock(pthread_mutex_t *mutex, struct QsLockProfile *p,
+        bool isFilterMutex) {
+
+    uint64_t t = GetTime();
+
+    if(isFilterMutex)
+        p->sites[filterLockSite].hold += t - filterLockTime;
+    else
+        p->sites[streamLockSite].hold += t - streamLockTime;
+
+    CHECK(pthread_mutex_unlock(mutex));
+}
+
+
+// The stream mutex is unlocked while waiting, and when it is locked
+// again that is counted as a lock at site.  The time to lock it again is
+// part of the wait.
+void LockStatsCondWait(pthread_cond_t *cond, pthread_mutex_t *mutex,
+        struct QsLockProfile *p, uint32_t site) {
+
+    DASSERT(site < QS_LOCK_FILTER_RUNINPUT);
+
+    uint64_t t = GetTime();
+    p->sites[streamLockSite].hold += t - streamLockTime;
+
+    CHECK(pthread_cond_wait(cond, mutex));
+
+    uint64_t now = GetTime();
+    struct QsLockSite *ls = p->sites + site;
+    ++ls->condWaits;
+    ls->condWait += now - t;
+    ++ls->count;
+
+    streamLockTime = now;
+    streamLockSite = site;
+}
+
+
+// Called in qsStreamLaunch() so that the statistics are for one flow
+// run.
+void LockStatsReset(struct QsStream *s) {
+
+    DASSERT(s->lockStats);
+    memset(s->lockStats->sites, 0, sizeof(s->lockStats->sites));
+}
+
+
+void LockStatsFree(struct QsStream *s) {
+
+    if(!s->lockStats) return;
+
+#ifdef DEBUG
+    memset(s->lockStats, 0, sizeof(*s->lockStats));
+#endif
+    free(s->lockStats);
+    s->lockStats = 0;
+}
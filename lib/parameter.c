@@ -5,6 +5,8 @@
 #include <stdatomic.h>
 #include <errno.h>
 #include <regex.h>
+#include <unistd.h>
+#include <semaphore.h>
 
 #include "../include/quickstream/filter.h"
 #include "../include/quickstream/parameter.h"
@@ -12,6 +14,7 @@
 #include "Dictionary.h"
 #include "qs.h"
 #include "filterAPI.h" // struct QsJob *GetJob(void){}
+#include "parameter.h"
 
 
 
@@ -48,8 +51,16 @@ const char *GetTypeString(enum QsParameterType type) {
     
     switch (type) {
 
+        case Any:
+            return "any";
+        case None:
+            return "none";
         case QsDouble:
             return "double";
+        case QsUint64:
+            return "uint64";
+        case QsNew:
+            return "new";
         default:
             ASSERT(0, "Unknown enum QsParameterType");
             return 0;
@@ -70,6 +81,26 @@ struct GetCallback {
 };
 
 
+// The state of a parameter that has QS_ASYNC get callbacks.  It is
+// allocated apart from the parameter so that it can outlive the
+// parameter while it is in the async queue.
+struct AsyncParameter {
+
+    // Set to 0 if the parameter is freed while this is queued, and then
+    // the notifier thread frees this.
+    struct QsParameter *parameter;
+
+    // The latest value pushed.  Values of the types that we deliver
+    // asynchronously fit in 64 bits, so coalescing pushes is just
+    // overwriting this.
+    atomic_uint_fast64_t value;
+
+    // Set while this is in the async queue, so that it's there at most
+    // once.
+    atomic_bool queued;
+};
+
+
 struct QsParameter {
 
     enum QsParameterType type;
@@ -85,6 +116,20 @@ struct QsParameter {
     size_t numGetCallbacks;
     struct GetCallback *getCallbacks;
 
+    // The number of getCallbacks with the QS_ASYNC flag, and their
+    // state, or 0 if there are none.
+    size_t numAsyncCallbacks;
+    struct AsyncParameter *async;
+
+    // The filter that owns it, or 0 if a controller owns it.
+    struct QsFilter *filter;
+
+    // For parameters from qsParameterCreateDeferred(), the latest value
+    // from qsParameterSet() that is not applied yet.
+    bool isDeferred;
+    atomic_uint_fast64_t staged;
+    atomic_bool isStaged;
+
     // The root dictionary object that contains this parameter.
     // In either a filter or a controller.
     struct QsDictionary *dict;
@@ -96,12 +141,589 @@ struct QsParameter {
 };
 
 
+//////////////////////////////////////////////////////////////////////////
+// Asynchronous get callback delivery.
+//
+// qsParameterPushByPointer() stores the value in the parameter struct
+// AsyncParameter, and, if it is not queued already, adds it to a bounded
+// lock-free queue.  A notifier thread takes them off the queue and calls
+// the QS_ASYNC get callbacks with the latest value.  So pushes do not
+// block on slow get callbacks, and a get callback that is slower than
+// the pushes gets fewer values, not old ones.
+//
+// The notifier thread runs while there are QS_ASYNC get callbacks.
+//////////////////////////////////////////////////////////////////////////
+
+// A power of 2.  Since a parameter is in the queue at most once this is
+// the most parameters with QS_ASYNC get callbacks that can have values
+// waiting at a time.
+#define ASYNC_QUEUE_LENGTH  ((size_t) 1024)
+
+
+// A bounded multi-producer queue cell, as in Dmitry Vyukov's bounded
+// MPMC queue.  We have just one consumer, the notifier thread.
+static struct AsyncCell {
+    atomic_size_t sequence;
+    struct AsyncParameter *ap;
+} asyncQueue[ASYNC_QUEUE_LENGTH];
+
+static atomic_size_t asyncEnqueuePos;
+// Only the notifier thread uses this.
+static size_t asyncDequeuePos;
+
+// Counts the queued parameters.
+static sem_t asyncSem;
+
+// The number of parameters that are queued, or being delivered.
+static atomic_size_t asyncPending;
+
+// The notifier thread holds this while it calls get callbacks.  The
+// other threads hold it when they change the get callbacks of a
+// parameter that may be queued.  It is recursive so that get callbacks
+// can call qsParameterGet().
+static pthread_mutex_t asyncMutex;
+static pthread_once_t asyncOnce = PTHREAD_ONCE_INIT;
+
+// The number of QS_ASYNC get callbacks in all parameters.  Changed with
+// the asyncMutex lock.
+static size_t totalAsyncCallbacks = 0;
+
+static pthread_t notifierThread;
+static bool notifierRunning = false;
+static atomic_bool notifierQuit;
+
+
+static void AsyncInit(void) {
+
+    pthread_mutexattr_t attr;
+    CHECK(pthread_mutexattr_init(&attr));
+    CHECK(pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE));
+    CHECK(pthread_mutex_init(&asyncMutex, &attr));
+    CHECK(pthread_mutexattr_destroy(&attr));
+
+    for(size_t i=0; i<ASYNC_QUEUE_LENGTH; ++i)
+        atomic_init(&asyncQueue[i].sequence, i);
+
+    CHECK(sem_init(&asyncSem, 0, 0));
+}
+
+
+static inline void AsyncLock(void) {
+    CHECK(pthread_once(&asyncOnce, AsyncInit));
+    CHECK(pthread_mutex_lock(&asyncMutex));
+}
+
+
+static inline void AsyncUnlock(void) {
+    CHECK(pthread_mutex_unlock(&asyncMutex));
+}
+
+
+// Returns false if the queue is full.
+static bool
+AsyncEnqueue(struct AsyncParameter *ap) {
+
+    size_t pos = atomic_load_explicit(&asyncEnqueuePos,
+            memory_order_relaxed);
+    struct AsyncCell *cell;
+
+    while(true) {
+        cell = asyncQueue + (pos & (ASYNC_QUEUE_LENGTH - 1));
+        size_t seq = atomic_load_explicit(&cell->sequence,
+                memory_order_acquire);
+        intptr_t diff = (intptr_t) seq - (intptr_t) pos;
+        if(diff == 0) {
+            if(atomic_compare_exchange_weak_explicit(&asyncEnqueuePos,
+                        &pos, pos + 1, memory_order_relaxed,
+                        memory_order_relaxed))
+                break;
+        } else if(diff < 0)
+            return false; // full
+        else
+            pos = atomic_load_explicit(&asyncEnqueuePos,
+                    memory_order_relaxed);
+    }
+
+    cell->ap = ap;
+    atomic_store_explicit(&cell->sequence, pos + 1, memory_order_release);
+    return true;
+}
+
+
+// Only called by the notifier thread.  Returns 0 if the queue is empty.
+static struct AsyncParameter *
+AsyncDequeue(void) {
+
+    struct AsyncCell *cell = asyncQueue +
+        (asyncDequeuePos & (ASYNC_QUEUE_LENGTH - 1));
+    size_t seq = atomic_load_explicit(&cell->sequence,
+            memory_order_acquire);
+    if(seq != asyncDequeuePos + 1)
+        return 0;
+
+    struct AsyncParameter *ap = cell->ap;
+    atomic_store_explicit(&cell->sequence,
+            asyncDequeuePos + ASYNC_QUEUE_LENGTH, memory_order_release);
+    ++asyncDequeuePos;
+    return ap;
+}
+
+
+// Called from qsParameterPushByPointer() by the thread that owns the
+// parameter, p.  We do not use ap->parameter here, since FreeAsync() may
+// have cleared it.
+static inline void
+AsyncPush(const struct QsParameter *p, const void *value) {
+
+    struct AsyncParameter *ap = p->async;
+    uint64_t bits = 0;
+    if(p->type == QsDouble || p->type == QsUint64)
+        memcpy(&bits, value, sizeof(bits));
+    atomic_store(&ap->value, bits);
+
+    if(atomic_exchange(&ap->queued, true))
+        // It's queued already, and the notifier will get the value that
+        // we just stored.
+        return;
+
+    atomic_fetch_add(&asyncPending, 1);
+
+    if(AsyncEnqueue(ap)) {
+        CHECK(sem_post(&asyncSem));
+        return;
+    }
+
+    // The queue is full.  This value is dropped, but the next push of
+    // this parameter will try again.
+    atomic_store(&ap->queued, false);
+    atomic_fetch_sub(&asyncPending, 1);
+    WARN("Parameter \"%s:%s\" async queue is full",
+            p->filterName, p->pName);
+}
+
+
+// Called by the notifier thread with the asyncMutex lock.
+static void
+AsyncDeliver(struct AsyncParameter *ap) {
+
+    struct QsParameter *p = ap->parameter;
+
+    if(!p) {
+        // The parameter was freed while this was queued.
+#ifdef DEBUG
+        memset(ap, 0, sizeof(*ap));
+#endif
+        free(ap);
+        return;
+    }
+
+    // We must unmark it before reading the value, so that a push that
+    // comes after the read queues it again.
+    atomic_store(&ap->queued, false);
+
+    union {
+        uint64_t bits;
+        double d;
+        uint64_t u;
+    } value;
+    value.bits = atomic_load(&ap->value);
+
+    struct GetCallback *gcs = p->getCallbacks;
+    size_t num = p->numGetCallbacks;
+    for(size_t i=0; i<num; ++i)
+        if(gcs[i].flags & QS_ASYNC)
+            gcs[i].getCallback(&value, p->streamOrApp,
+                    p->filterName, p->pName, p->type, gcs[i].userData);
+}
+
+
+static void *
+Notifier(void *arg) {
+
+    while(true) {
+
+        while(sem_wait(&asyncSem) && errno == EINTR);
+
+        if(atomic_load(&notifierQuit))
+            break;
+
+        AsyncLock();
+        struct AsyncParameter *ap = AsyncDequeue();
+        // There is one sem_post() for each enqueue.
+        DASSERT(ap);
+        if(ap)
+            AsyncDeliver(ap);
+        AsyncUnlock();
+
+        atomic_fetch_sub(&asyncPending, 1);
+    }
+
+    return 0;
+}
+
+
+// Called with the asyncMutex lock.
+static void
+StartNotifier(void) {
+
+    if(notifierRunning) return;
+
+    atomic_store(&notifierQuit, false);
+    CHECK(pthread_create(&notifierThread, 0, Notifier, 0));
+    notifierRunning = true;
+    DSPEW("Started parameter async notifier thread");
+}
+
+
+// Called without the asyncMutex lock, if there are no more QS_ASYNC get
+// callbacks.
+static void
+StopNotifier(void) {
+
+    if(!notifierRunning || totalAsyncCallbacks ||
+            pthread_equal(pthread_self(), notifierThread))
+        return;
+
+    _qsParameterAsyncDrain();
+
+    atomic_store(&notifierQuit, true);
+    CHECK(sem_post(&asyncSem));
+    CHECK(pthread_join(notifierThread, 0));
+    notifierRunning = false;
+    DSPEW("Stopped parameter async notifier thread");
+}
+
+
+// Called with the asyncMutex lock when the parameter has no more
+// QS_ASYNC get callbacks.
+static void
+FreeAsync(struct QsParameter *p) {
+
+    DASSERT(p->async);
+
+    if(atomic_load(&p->async->queued))
+        // The notifier thread will free it.
+        p->async->parameter = 0;
+    else {
+#ifdef DEBUG
+        memset(p->async, 0, sizeof(*p->async));
+#endif
+        free(p->async);
+    }
+    p->async = 0;
+}
+
+
+void _qsParameterAsyncDrain(void) {
+
+    if(!notifierRunning ||
+            pthread_equal(pthread_self(), notifierThread))
+        return;
+
+    while(atomic_load(&asyncPending))
+        usleep(1000);
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+// Parameter name regular expressions.
+//
+// Controllers call qsParameterForEach() and qsParameterDestroyForFilter()
+// with the same few regular expressions for every filter at every start
+// and stop.  So we keep the compiled regular expressions in a cache, and
+// each filter keeps a list of the parameters that match each cached
+// pattern that it has been queried with.  These lists are changed as
+// parameters are created and destroyed, so a query just goes through the
+// parameters that match.
+//////////////////////////////////////////////////////////////////////////
+
+// Patterns past this many are compiled for each query and not indexed.
+#define MAX_CACHED_PATTERNS  ((size_t) 64)
+
+
+struct Pattern {
+    regex_t regex;
+    // If not set this was compiled just for one query and PutPattern()
+    // frees it.
+    bool cached;
+};
+
+
+// The parameters in a filter that match a cached pattern.
+struct PatternMatches {
+    struct Pattern *pattern;
+    // realloc()ed array.
+    struct QsParameter **parameters;
+    uint32_t numParameters;
+    struct PatternMatches *next;
+};
+
+
+// Cached patterns are never freed.
+static struct QsDictionary *patterns = 0;
+static size_t numPatterns = 0;
+static pthread_mutex_t patternsMutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+// Returns true if str can be a dictionary key.
+static inline bool
+IsKey(const char *str) {
+
+    for(; *str; ++str)
+        if(*str < 7 || *str > 126)
+            return false;
+    return true;
+}
+
+
+// Returns 0 if pName is not a valid regular expression.
+static struct Pattern *
+GetPattern(const char *pName) {
+
+    DASSERT(pName);
+    DASSERT(pName[0]);
+
+    bool isKey = IsKey(pName);
+
+    CHECK(pthread_mutex_lock(&patternsMutex));
+
+    struct Pattern *pat = 0;
+    if(patterns && isKey)
+        pat = qsDictionaryFind(patterns, pName);
+    if(pat) {
+        CHECK(pthread_mutex_unlock(&patternsMutex));
+        return pat;
+    }
+
+    pat = calloc(1, sizeof(*pat));
+    ASSERT(pat, "calloc(1,%zu) failed", sizeof(*pat));
+
+    int ret = regcomp(&pat->regex, pName, REG_EXTENDED|REG_NOSUB);
+    if(ret == REG_ESPACE)
+        ASSERT(0, "regcomp(,\"%s\",REG_EXTENDED) failed", pName);
+    if(ret) {
+        CHECK(pthread_mutex_unlock(&patternsMutex));
+        free(pat);
+        ERROR("Bad regular expression \"%s\"", pName);
+        return 0;
+    }
+
+    if(isKey && numPatterns < MAX_CACHED_PATTERNS) {
+        if(!patterns) {
+            patterns = qsDictionaryCreate();
+            ASSERT(patterns);
+        }
+        ASSERT(qsDictionaryInsert(patterns, pName, pat, 0) == 0);
+        pat->cached = true;
+        ++numPatterns;
+    }
+
+    CHECK(pthread_mutex_unlock(&patternsMutex));
+
+    return pat;
+}
+
+
+static inline void
+PutPattern(struct Pattern *pat) {
+
+    if(pat->cached) return;
+
+    regfree(&pat->regex);
+#ifdef DEBUG
+    memset(pat, 0, sizeof(*pat));
+#endif
+    free(pat);
+}
+
+
+static inline bool
+Matches(const struct Pattern *pat, const char *pName) {
+
+    return regexec(&pat->regex, pName, 0, NULL, 0) == 0;
+}
+
+
+static inline void
+AddMatch(struct PatternMatches *pm, struct QsParameter *p) {
+
+    pm->parameters = realloc(pm->parameters,
+            (pm->numParameters + 1)*sizeof(*pm->parameters));
+    ASSERT(pm->parameters, "realloc(,%zu) failed",
+            (pm->numParameters + 1)*sizeof(*pm->parameters));
+    pm->parameters[pm->numParameters++] = p;
+}
+
+
+static int
+AddIfMatches(const char *pName, void *value, struct PatternMatches *pm) {
+
+    if(Matches(pm->pattern, pName))
+        AddMatch(pm, value);
+    return 0;
+}
+
+
+// Returns the list of parameters in filter f that match the cached
+// pattern pat.  The first time a pattern is used with a filter we go
+// through all the filter parameters to make the list.
+static struct PatternMatches *
+GetMatches(struct QsFilter *f, struct Pattern *pat) {
+
+    DASSERT(pat->cached);
+
+    struct PatternMatches *pm = f->patternMatches;
+    while(pm && pm->pattern != pat)
+        pm = pm->next;
+    if(pm) return pm;
+
+    pm = calloc(1, sizeof(*pm));
+    ASSERT(pm, "calloc(1,%zu) failed", sizeof(*pm));
+    pm->pattern = pat;
+
+    qsDictionaryForEach(f->parameters,
+            (int (*) (const char *key, void *value,
+                    void *userData)) AddIfMatches, pm);
+
+    pm->next = f->patternMatches;
+    f->patternMatches = pm;
+
+    return pm;
+}
+
+
+// Add a new filter parameter to the lists of the patterns it matches.
+static void
+IndexParameter(struct QsFilter *f, struct QsParameter *p) {
+
+    if(f->frozenParameters)
+        atomic_store(&f->frozenParametersStale, true);
+
+    for(struct PatternMatches *pm = f->patternMatches; pm; pm = pm->next)
+        if(Matches(pm->pattern, p->pName))
+            AddMatch(pm, p);
+}
+
+
+static void
+UnindexParameter(struct QsFilter *f, struct QsParameter *p) {
+
+    if(f->frozenParameters)
+        atomic_store(&f->frozenParametersStale, true);
+
+    for(struct PatternMatches *pm = f->patternMatches; pm; pm = pm->next) {
+        uint32_t i = 0;
+        while(i < pm->numParameters && pm->parameters[i] != p) ++i;
+        if(i == pm->numParameters) continue;
+        memmove(pm->parameters + i, pm->parameters + i + 1,
+                (pm->numParameters - i - 1)*sizeof(*pm->parameters));
+        if(--pm->numParameters == 0) {
+            free(pm->parameters);
+            pm->parameters = 0;
+        }
+    }
+}
+
+
+// Filter parameters may be found by name in any thread while the
+// stream is flowing, and destroyed in another.  Finding in the frozen
+// copy takes this as a reader, and destroying takes it as a writer to
+// mark the frozen copy stale before the parameter is freed, so a lookup
+// never gets a freed parameter from the frozen copy.
+static pthread_rwlock_t frozenLock = PTHREAD_RWLOCK_INITIALIZER;
+
+
+// While the stream is flowing we use the frozen copy of the filter
+// parameters dictionary, unless parameters have been added or removed
+// since it was made.
+static inline struct QsParameter *
+FindFilterParameter(struct QsFilter *f, const char *pName) {
+
+    struct QsParameter *p;
+
+    if(f->frozenParameters) {
+        CHECK(pthread_rwlock_rdlock(&frozenLock));
+        if(!atomic_load(&f->frozenParametersStale)) {
+            p = qsFrozenDictionaryFind(f->frozenParameters, pName);
+            CHECK(pthread_rwlock_unlock(&frozenLock));
+            return p;
+        }
+        CHECK(pthread_rwlock_unlock(&frozenLock));
+    }
+
+    return qsDictionaryFind(f->parameters, pName);
+}
+
+
+// Called before filter parameters are freed.  After this returns no
+// lookup is using the frozen copy of the filter parameters.  We do not
+// hold the lock while parameters are freed, because that calls cleanup
+// and get callback functions that may find parameters.
+static void
+StaleFrozenParameters(struct QsFilter *f) {
+
+    if(!f || !f->frozenParameters) return;
+
+    CHECK(pthread_rwlock_wrlock(&frozenLock));
+    atomic_store(&f->frozenParametersStale, true);
+    CHECK(pthread_rwlock_unlock(&frozenLock));
+}
+
+
+// Called after all the filter parameters are destroyed.
+void FreeParameterIndex(struct QsFilter *f) {
+
+    while(f->patternMatches) {
+        struct PatternMatches *pm = f->patternMatches;
+        f->patternMatches = pm->next;
+        DASSERT(pm->numParameters == 0);
+        if(pm->parameters)
+            free(pm->parameters);
+#ifdef DEBUG
+        memset(pm, 0, sizeof(*pm));
+#endif
+        free(pm);
+    }
+}
+
+
 static void FreeParameter(struct QsParameter *p) {
 
     DASSERT(p);
     DASSERT(p->pName);
     DSPEW("Freeing Parameter \"%s\"", p->pName);
 
+    if(p->filter)
+        UnindexParameter(p->filter, p);
+
+    if(p->isDeferred) {
+        // Remove it from the filter deferred parameters.
+        struct QsFilter *f = p->filter;
+        uint32_t i = 0;
+        while(i < f->numDeferredParameters &&
+                f->deferredParameters[i] != p) ++i;
+        DASSERT(i < f->numDeferredParameters);
+        if(i < f->numDeferredParameters) {
+            memmove(f->deferredParameters + i,
+                    f->deferredParameters + i + 1,
+                    (f->numDeferredParameters - i - 1)*
+                    sizeof(*f->deferredParameters));
+            if(--f->numDeferredParameters == 0) {
+                free(f->deferredParameters);
+                f->deferredParameters = 0;
+            }
+        }
+    }
+
+    if(p->async) {
+        AsyncLock();
+        DASSERT(totalAsyncCallbacks >= p->numAsyncCallbacks);
+        totalAsyncCallbacks -= p->numAsyncCallbacks;
+        FreeAsync(p);
+        AsyncUnlock();
+        StopNotifier();
+    }
+
     if(p->cleanup)
         p->cleanup(p->pName, p->userData);
 
@@ -125,6 +747,7 @@ static void FreeParameter(struct QsParameter *p) {
 int
 qsParameterDestroy(struct QsParameter *p) {
 
+    StaleFrozenParameters(p->filter);
     return qsDictionaryRemove(p->dict, p->pName);
 }
 
@@ -132,14 +755,14 @@ qsParameterDestroy(struct QsParameter *p) {
 struct RemovalMarker {
 
     struct QsParameter *stack;
-    regex_t regex;
+    struct Pattern *pattern;
 };
 
 
 static int MarkForRemoval(const char *pName, struct QsParameter *p,
         struct RemovalMarker *rm) {
 
-    if(regexec(&rm->regex, pName, 0, NULL, 0) == 0) {
+    if(Matches(rm->pattern, pName)) {
         // This parameter matched.
         //
         // We borrow the setCallback pointer (since we don't need it any
@@ -168,27 +791,39 @@ qsParameterDestroyForFilter(struct QsFilter *f, const char *pName,
     DASSERT(pName);
     DASSERT(pName[0]);
 
+    StaleFrozenParameters(f);
+
     if(! (flags & QS_PNAME_REGEX))
         return qsDictionaryRemove(f->parameters, pName);
 
     // pName is a regex (regular expression string).
 
-    struct RemovalMarker rm = { 0 };
-
-    int ret = regcomp(&rm.regex, pName, REG_EXTENDED);
-    if(ret == REG_ESPACE)
-        ASSERT(0, "regcomp(,\"%s\",REG_EXTENDED) failed", pName);
-    if(ret) {
-        ERROR("Bad regular expression \"%s\"", pName);
+    struct Pattern *pat = GetPattern(pName);
+    if(!pat)
         return -3;
+
+    int count = 0;
+
+    if(pat->cached) {
+        struct PatternMatches *pm = GetMatches(f, pat);
+        // Freeing a parameter removes it from pm.
+        while(pm->numParameters) {
+            ASSERT(qsDictionaryRemove(f->parameters,
+                    pm->parameters[pm->numParameters-1]->pName) == 0);
+            ++count;
+        }
+        return count;
     }
 
+    struct RemovalMarker rm = { 0, pat };
+
     qsDictionaryForEach(f->parameters,
                 (int (*) (const char *key, void *value,
                         void *userData)) MarkForRemoval,
                 &rm);
 
-    int count = 0;
+    PutPattern(pat);
+
     // Now look for "marks", they are in a stack list to remove.
     struct QsParameter *p = rm.stack;
     while(p) {
@@ -241,9 +876,13 @@ int RemoveCallbacksForRestart(const char *key,
 
     DASSERT(p->getCallbacks);
 
+    if(p->async)
+        // The notifier thread may be reading the get callbacks.
+        AsyncLock();
+
     // Squeeze all the getCallbacks that we'll be keeping to a condensed
     // array.
-    size_t newNum=0;
+    size_t newNum=0, newNumAsync=0;
     for(size_t j=0; j<p->numGetCallbacks;) {
         // Keep going until we find one to keep:
         while(j<p->numGetCallbacks &&
@@ -255,6 +894,8 @@ int RemoveCallbacksForRestart(const char *key,
                     sizeof(*p->getCallbacks));
         // else newNum == j so we do not need to copy it.
 
+        if(p->getCallbacks[newNum].flags & QS_ASYNC)
+            ++newNumAsync;
         ++newNum;
         ++j;
     }
@@ -271,8 +912,19 @@ int RemoveCallbacksForRestart(const char *key,
                 sizeof(*p->getCallbacks));
 #endif
         free(p->getCallbacks);
+        p->getCallbacks = 0;
     }
     p->numGetCallbacks = newNum;
+
+    if(p->async) {
+        DASSERT(totalAsyncCallbacks >= p->numAsyncCallbacks - newNumAsync);
+        totalAsyncCallbacks -= p->numAsyncCallbacks - newNumAsync;
+        p->numAsyncCallbacks = newNumAsync;
+        if(!newNumAsync)
+            FreeAsync(p);
+        AsyncUnlock();
+    }
+
     return 0;
 }
 
@@ -283,6 +935,8 @@ _qsParameterRemoveCallbacksForRestart(struct QsFilter *f) {
     qsDictionaryForEach(f->parameters,
             (int (*) (const char *key, void *value,
                     void *userData)) RemoveCallbacksForRestart, 0);
+
+    StopNotifier();
 }
 
 
@@ -344,9 +998,12 @@ qsParameterCreateForFilter(struct QsFilter *f,
     DASSERT(d);
 
     // Create and add the parameter data to this parameter dict
-    return CreateParameter(f->parameters, f->stream,
+    struct QsParameter *p = CreateParameter(f->parameters, f->stream,
             d, f->name, pName, setCallback,
             cleanup, userData, type);
+    p->filter = f;
+    IndexParameter(f, p);
+    return p;
 }
 
 struct QsParameter *
@@ -399,6 +1056,49 @@ qsParameterCreate(const char *pName, enum QsParameterType type,
 }
 
 
+struct QsParameter *
+qsParameterCreateDeferred(const char *pName, enum QsParameterType type,
+        int (*setCallback)(struct QsParameter *parameter,
+            void *value, const char *pName, void *userData),
+        void (*cleanup)(const char *pName, void *userData),
+        void *userData) {
+
+    struct QsFilter *f = GetFilter();
+    ASSERT(f && f->mark == _QS_IN_CONSTRUCT,
+            "qsParameterCreateDeferred() must be called in a filter"
+            " module construct()");
+    ASSERT(setCallback, "A deferred parameter needs a setCallback");
+
+    if(f->maxThreads > 1) {
+        // More than one thread may be calling input(), so there is no
+        // thread that can call setCallback() between input() calls.
+        ERROR("Parameter \"%s:%s\" cannot be deferred in a"
+                " multi-threaded filter", f->name, pName);
+        return 0;
+    }
+
+    if(type != None && type != QsDouble && type != QsUint64) {
+        ERROR("Parameter \"%s:%s\" type \"%s\" cannot be deferred",
+                f->name, pName, GetTypeString(type));
+        return 0;
+    }
+
+    struct QsParameter *p = qsParameterCreateForFilter(f, pName, type,
+            setCallback, cleanup, userData);
+    if(!p) return 0;
+
+    p->isDeferred = true;
+
+    f->deferredParameters = realloc(f->deferredParameters,
+            (f->numDeferredParameters + 1)*sizeof(*f->deferredParameters));
+    ASSERT(f->deferredParameters, "realloc(,%zu) failed",
+            (f->numDeferredParameters + 1)*sizeof(*f->deferredParameters));
+    f->deferredParameters[f->numDeferredParameters++] = p;
+
+    return p;
+}
+
+
 static int
 AddGetCallback(struct QsParameter *p, const char *filterName,
         const char *pName, enum QsParameterType type,
@@ -422,6 +1122,14 @@ AddGetCallback(struct QsParameter *p, const char *filterName,
         return -3; // error
     }
 
+    if((flags & QS_ASYNC) && p->type != None &&
+            p->type != QsDouble && p->type != QsUint64) {
+        ERROR("Parameter \"%s:%s\" type \"%s\" cannot be gotten"
+                " with QS_ASYNC", filterName, pName,
+                GetTypeString(p->type));
+        return -3; // error
+    }
+
     if(flags & QS_KEEP_ONE)
         // Check that we only add this callback just once.
         for(size_t i=p->numGetCallbacks-1; i!=-1; --i)
@@ -430,6 +1138,20 @@ AddGetCallback(struct QsParameter *p, const char *filterName,
                 return 0;
 
 
+    if(flags & QS_ASYNC) {
+        AsyncLock();
+        if(!p->async) {
+            p->async = calloc(1, sizeof(*p->async));
+            ASSERT(p->async, "calloc(1,%zu) failed", sizeof(*p->async));
+            p->async->parameter = p;
+        }
+        ++p->numAsyncCallbacks;
+        ++totalAsyncCallbacks;
+        StartNotifier();
+    } else if(p->async)
+        // The notifier thread may be reading the get callbacks.
+        AsyncLock();
+
     size_t num = p->numGetCallbacks;
 
     p->getCallbacks = realloc(p->getCallbacks,
@@ -442,6 +1164,9 @@ AddGetCallback(struct QsParameter *p, const char *filterName,
     gc->flags = flags;
     ++p->numGetCallbacks;
 
+    if(p->async)
+        AsyncUnlock();
+
     return 1; // success
 }
 
@@ -451,7 +1176,7 @@ struct Check_AddGetCallback_args {
     enum QsParameterType type;
     const char *filterName;
     int numParameters; // number of parameters added
-    regex_t regex; // libc regular expression
+    struct Pattern *pattern;
     int (*getCallback)(
             const void *value,
             void *streamOrApp,
@@ -471,7 +1196,7 @@ int Check_AddGetCallback(const char *pName, struct QsParameter *p,
         return 0;
 
 
-    if(regexec(&args->regex, pName, 0, NULL, 0) == 0) {
+    if(Matches(args->pattern, pName)) {
         // This parameter name matches the regular expression.
         AddGetCallback(p, args->filterName, pName, p->type,
                 args->getCallback, args->userData, args->flags);
@@ -529,20 +1254,16 @@ int qsParameterGet(void *as, const char *filterName,
     args.userData = userData;
     args.flags = flags;
 
-    int ret = regcomp(&args.regex, pName, REG_EXTENDED);
-    if(ret == REG_ESPACE)
-        ASSERT(0, "regcomp(,\"%s\",REG_EXTENDED) failed", pName);
-    if(ret) {
-        ERROR("Bad regular expression \"%s\"", pName);
+    args.pattern = GetPattern(pName);
+    if(!args.pattern)
         return -3;
-    }
 
     qsDictionaryForEach(pDict,
                 (int (*) (const char *key, void *value,
                         void *userData)) Check_AddGetCallback,
                 &args);
 
-    regfree(&args.regex);
+    PutPattern(args.pattern);
 
     return args.numParameters; // success
 }
@@ -587,7 +1308,7 @@ int qsParameterSet(void *sa,
         DASSERT(f->parameters);
 
         // Get the parameter from the Dictionary:
-        p = qsDictionaryFind(f->parameters, pName);
+        p = FindFilterParameter(f, pName);
         if(!p) {
             WARN("Parameter \"%s:%s\" not found", filterName, pName);
             return 2; // error
@@ -622,6 +1343,19 @@ int qsParameterSet(void *sa,
         return 3; // error
     }
 
+    if(p->isDeferred) {
+        // A deferred parameter.  We stage the value, and the thread that
+        // calls the filter input() next calls setCallback() with it.
+        // Only the latest staged value is applied.
+        uint64_t bits = 0;
+        if(type == QsDouble || type == QsUint64)
+            memcpy(&bits, value, sizeof(bits));
+        atomic_store(&p->staged, bits);
+        atomic_store(&p->isStaged, true);
+        atomic_store(&p->filter->deferredPending, true);
+        return 0; // success
+    }
+
     // We need thread specific data to tell what filter this is when
     // setCallback() is called below.  
     CHECK(pthread_once(&keyOnce, MakeKey));
@@ -657,6 +1391,17 @@ int qsParameterPushByPointer(const struct QsParameter *p,
 
     struct GetCallback *gcs = p->getCallbacks;
     size_t num = p->numGetCallbacks;
+
+    if(p->numAsyncCallbacks) {
+        AsyncPush(p, value);
+        for(size_t i=0; i<num; ++i)
+            if(!(gcs[i].flags & QS_ASYNC))
+                gcs[i].getCallback(value, p->streamOrApp,
+                        p->filterName, p->pName, p->type,
+                        gcs[i].userData);
+        return 0;
+    }
+
     for(size_t i=0; i<num; ++i)
         gcs[i].getCallback(value, p->streamOrApp,
                 p->filterName, p->pName, p->type, gcs[i].userData);
@@ -706,18 +1451,14 @@ int qsParameterPush(const char *pName, void *value) {
             return 2; // error
         }
         // We should have p now.
-    }
 
-    if(!f)
+    } else if((f = GetFilter())) {
         // Or it may be called after the filter setCallback() in one of
         // the filter module functions start() stop() or input().
         // GetFilter() is a small wrapper that uses a different pthread
-        // specific variable.
-        f = GetFilter();
-
-    if(f) {
-        // Get the parameter from the Dictionary:
-        p = qsDictionaryFind(f->parameters, pName);
+        // specific variable.  So f is a filter, and this may be while
+        // the stream is flowing.
+        p = FindFilterParameter(f, pName);
         if(!p) {
             WARN("qsParameterPush(\"%s\") calling thread not found",
                     pName);
@@ -766,10 +1507,9 @@ struct ParameterCBArgs {
         const char *filterName, const char *pName, 
         enum QsParameterType type, void *userData);
     bool *done;
-    // Kind of a waste of memory given regex, but regex_t does not have a
-    // null like value.
-    bool useRegex;
-    regex_t regex;
+    // 0 for all parameters.
+    struct Pattern *pattern;
+    size_t count; // number of callback() calls
 };
 
 
@@ -785,9 +1525,9 @@ int ParameterForEach(const char *key, void *value,
 
     if((void *) f != value &&
             (!cbArgs->type || cbArgs->type == p->type) &&
-            ( cbArgs->useRegex &&
-                regexec(&cbArgs->regex, key, 0, NULL, 0) == 0)
+            (!cbArgs->pattern || Matches(cbArgs->pattern, key))
             ) {
+        ++cbArgs->count;
         ret = cbArgs->callback(f->stream, f->name, p->pName,
                 p->type, cbArgs->userData);
         if(ret) *cbArgs->done = true;
@@ -809,7 +1549,7 @@ ForParameterDict(struct QsFilter *f, const char *pName,
     DASSERT(f->parameters);
 
     if(pName && pName[0] && !(flags & QS_PNAME_REGEX)) {
-        struct QsParameter *p = qsDictionaryFind(f->parameters, pName);
+        struct QsParameter *p = FindFilterParameter(f, pName);
         if(!p) {
             WARN("Parameter \"%s:%s\" not found", f->name, pName);
             return 0;
@@ -829,29 +1569,37 @@ ForParameterDict(struct QsFilter *f, const char *pName,
         userData,
         callback,
         done,
-        false
+        0, 0
     };
 
     if(pName && pName[0] && (flags & QS_PNAME_REGEX)) {
-        int ret = regcomp(&args.regex, pName, REG_EXTENDED);
-        if(ret == REG_ESPACE)
-            ASSERT(0, "regcomp(,\"%s\",REG_EXTENDED) failed", pName);
-        if(ret) {
-            ERROR("Bad regular expression \"%s\"", pName);
+        args.pattern = GetPattern(pName);
+        if(!args.pattern)
             return 0;
+    }
+
+    if(args.pattern && args.pattern->cached) {
+        // Just go through the parameters that match.
+        struct PatternMatches *pm = GetMatches(f, args.pattern);
+        for(uint32_t i=0; i<pm->numParameters && !*done;) {
+            struct QsParameter *p = pm->parameters[i];
+            if(ParameterForEach(p->pName, p, &args))
+                break;
+            // The callback may have destroyed this parameter.
+            if(i < pm->numParameters && pm->parameters[i] == p)
+                ++i;
         }
-        args.useRegex = true;
+        return args.count;
     }
 
-    // Subtract 1 for the call with the filter.
-    size_t ret = qsDictionaryForEach(f->parameters, 
+    qsDictionaryForEach(f->parameters,
             (int (*)(const char *, void *, void *))
-            ParameterForEach, &args) - 1;
+            ParameterForEach, &args);
 
-    if(args.useRegex)
-        regfree(&args.regex);
+    if(args.pattern)
+        PutPattern(args.pattern);
 
-    return ret;
+    return args.count;
 }
 
 
@@ -913,3 +1661,73 @@ size_t qsParameterForEach(struct QsApp *app, struct QsStream *s,
     return ForStreamParameters(s, filterName,
             pName, type, callback, userData, &done, flags);
 }
+
+
+static inline void
+ApplyDeferred(struct QsParameter *p, uint64_t bits) {
+
+    union {
+        uint64_t bits;
+        double d;
+        uint64_t u;
+    } value;
+    value.bits = bits;
+
+    // In setCallback() qsParameterPush() finds the filter from the
+    // thread specific job data, as it does in input().
+    p->setCallback(p, &value, p->pName, p->userData);
+}
+
+
+void ApplyDeferredParameters(struct QsFilter *f) {
+
+    DASSERT(f->numDeferredParameters);
+    // The helper process applies them.  See ApplyDeferredValues().
+    DASSERT(!f->process);
+
+    if(!atomic_exchange(&f->deferredPending, false))
+        return;
+
+    for(uint32_t i=0; i<f->numDeferredParameters; ++i) {
+
+        struct QsParameter *p = f->deferredParameters[i];
+
+        if(!atomic_exchange(&p->isStaged, false))
+            continue;
+
+        ApplyDeferred(p, atomic_load(&p->staged));
+    }
+}
+
+
+// Called in this process from the QS_FILTER_PROCESS filter input(), to
+// get the values that the helper process applies with
+// ApplyDeferredValues() before it calls the filter module input().  The
+// helper process has its own copy of the filter module data, so the
+// setCallback() must be called there.
+void TakeDeferredParameters(struct QsFilter *f,
+        struct QsDeferredValue *values) {
+
+    DASSERT(f->numDeferredParameters);
+
+    bool pending = atomic_exchange(&f->deferredPending, false);
+
+    for(uint32_t i=0; i<f->numDeferredParameters; ++i) {
+
+        struct QsParameter *p = f->deferredParameters[i];
+
+        values[i].isSet = pending && atomic_exchange(&p->isStaged, false);
+        if(values[i].isSet)
+            values[i].bits = atomic_load(&p->staged);
+    }
+}
+
+
+// Called in the helper process of a QS_FILTER_PROCESS filter.
+void ApplyDeferredValues(struct QsFilter *f,
+        const struct QsDeferredValue *values) {
+
+    for(uint32_t i=0; i<f->numDeferredParameters; ++i)
+        if(values[i].isSet)
+            ApplyDeferred(f->deferredParameters[i], values[i].bits);
+}
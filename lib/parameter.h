@@ -5,3 +5,8 @@
 // not.
 extern void
 _qsParameterRemoveCallbacksForRestart(struct QsFilter *filter);
+
+
+// Wait for the values pushed to QS_ASYNC get callbacks to be delivered.
+extern void
+_qsParameterAsyncDrain(void);
@@ -31,14 +31,11 @@ static void CleanUpCB(void *ptr) {
 
 
 
-int qsAddPostFilterInput(struct QsFilter *f,
-        int (*callback)(
-            struct QsFilter *filter,
-            const size_t lenIn[],
-            const size_t lenOut[],
-            const bool isFlushing[],
-            uint32_t numInputs, uint32_t numOutputs,
-            void *userData), void *userData) {
+// Add a callback to the filter callback dictionary, *dict, keyed by the
+// controller name.
+static struct ControllerCallback *
+AddCallback(struct QsFilter *f, struct QsDictionary **dict,
+        const char *which) {
 
     DASSERT(f);
     struct QsController *c = pthread_getspecific(_qsControllerKey);
@@ -57,32 +54,152 @@ int qsAddPostFilterInput(struct QsFilter *f,
             " different app than controller \"%s\"",
             f->name, c->name);
 
-    if(!f->postInputCallbacks)
-        f->postInputCallbacks = qsDictionaryCreate();
+    if(!*dict)
+        *dict = qsDictionaryCreate();
 
     struct ControllerCallback *cb = malloc(sizeof(*cb));
     ASSERT(cb, "malloc(%zu) failed", sizeof(*cb));
 
     struct QsDictionary *d = 0;
-    int ret = qsDictionaryInsert(f->postInputCallbacks, c->name, cb, &d);
+    int ret = qsDictionaryInsert(*dict, c->name, cb, &d);
     ASSERT(ret >= 0, "Bad controller name \"%s\"", c->name);
     DASSERT(d);
 
     if(ret) {
         free(cb);
         cb = qsDictionaryGetValue(d);
-        INFO("Replaced PostInput Callback for filter:controller="
-                "\"%s:%s\"", f->name, c->name);
+        INFO("Replaced %s Callback for filter:controller="
+                "\"%s:%s\"", which, f->name, c->name);
     } else {
         DASSERT(ret == 0);
         qsDictionarySetFreeValueOnDestroy(d, CleanUpCB);
-        DSPEW("Added PostInput Callback for filter:controller="
-                "\"%s:%s\"", f->name, c->name);
+        DSPEW("Added %s Callback for filter:controller="
+                "\"%s:%s\"", which, f->name, c->name);
     }
 
+    cb->returnValue = 0;
+
+    return cb;
+}
+
+
+int qsAddPreFilterInput(struct QsFilter *f,
+        int (*callback)(
+            struct QsFilter *filter,
+            const size_t lenIn[],
+            const bool isFlushing[],
+            uint32_t numInputs, uint32_t numOutputs,
+            void *userData), void *userData) {
+
+    if(!callback) {
+        struct QsController *c = pthread_getspecific(_qsControllerKey);
+        ASSERT(c);
+        if(f->preInputCallbacks)
+            qsDictionaryRemove(f->preInputCallbacks, c->name);
+        return 0; // success
+    }
+
+    struct ControllerCallback *cb = AddCallback(f,
+            &f->preInputCallbacks, "PreInput");
+    cb->preCallback = callback;
+    cb->userData = userData;
+
+    return 0; // success
+}
+
+
+int qsAddPostFilterInput(struct QsFilter *f,
+        int (*callback)(
+            struct QsFilter *filter,
+            const size_t lenIn[],
+            const size_t lenOut[],
+            const bool isFlushing[],
+            uint32_t numInputs, uint32_t numOutputs,
+            void *userData), void *userData) {
+
+    if(!callback) {
+        struct QsController *c = pthread_getspecific(_qsControllerKey);
+        ASSERT(c);
+        if(f->postInputCallbacks)
+            qsDictionaryRemove(f->postInputCallbacks, c->name);
+        return 0; // success
+    }
+
+    struct ControllerCallback *cb = AddCallback(f,
+            &f->postInputCallbacks, "PostInput");
     cb->callback = callback;
     cb->userData = userData;
-    cb->returnValue = 0;
 
     return 0; // success
 }
+
+
+// For making the flat array of callbacks from a callback dictionary.
+struct CallbackArray {
+    struct ControllerCallback **cbs;
+    uint32_t num;
+};
+
+
+static int
+AddToArray(const char *key, struct ControllerCallback *cb,
+        struct CallbackArray *a) {
+
+    if(cb->returnValue)
+        // It's finished.
+        return 0;
+
+    a->cbs = realloc(a->cbs, (a->num + 1)*sizeof(*a->cbs));
+    ASSERT(a->cbs, "realloc(,%zu) failed", (a->num + 1)*sizeof(*a->cbs));
+    a->cbs[a->num++] = cb;
+
+    return 0;
+}
+
+
+static void
+MakeArray(struct QsDictionary *callbacks,
+        struct ControllerCallback ***cbs, uint32_t *num) {
+
+    DASSERT(*cbs == 0);
+    DASSERT(*num == 0);
+
+    if(!callbacks) return;
+
+    struct CallbackArray a = { 0, 0 };
+    qsDictionaryForEach(callbacks,
+        (int (*) (const char *key, void *value,
+            void *userData)) AddToArray, &a);
+
+    *cbs = a.cbs;
+    *num = a.num;
+}
+
+
+// Called in qsStreamLaunch() after all the controller preStart() and
+// postStart() calls, which are the last chance to add callbacks before
+// the stream flows.
+void MakeInputCallbackArrays(struct QsFilter *f) {
+
+    MakeArray(f->preInputCallbacks, &f->preInputCBs,
+            &f->numPreInputCBs);
+    MakeArray(f->postInputCallbacks, &f->postInputCBs,
+            &f->numPostInputCBs);
+}
+
+
+// Called in qsStreamStop() after the stream stops flowing, and before
+// the controllers may remove callbacks.
+void FreeInputCallbackArrays(struct QsFilter *f) {
+
+    if(f->preInputCBs) {
+        free(f->preInputCBs);
+        f->preInputCBs = 0;
+    }
+    if(f->postInputCBs) {
+        free(f->postInputCBs);
+        f->postInputCBs = 0;
+    }
+    f->numPreInputCBs = 0;
+    f->numPostInputCBs = 0;
+}
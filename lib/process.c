@@ -0,0 +1,550 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "./debug.h"
+#include "./qs.h"
+#include "../include/quickstream/filter.h"
+
+
+// A filter that is loaded with the QS_FILTER_PROCESS flag has its
+// input() called in a helper process, so that if the filter module
+// crashes, it does not take this process with it.
+//
+// The helper process is fork()ed in qsStreamLaunch(), after the filter
+// start()s are called and the ring buffers are mapped, and before the
+// stream worker threads are started.  Other threads in the program may
+// be running then, and any lock they hold stays locked in the helper
+// process, so ProcessLaunch() warns when there are other threads.  The ring buffers
+// are mapped with MAP_SHARED (see makeRingBuffer.c), so the helper
+// process has them at the same addresses as this process, and the
+// filter module reads and writes them directly, without copying.  The
+// rest of the stream sees an ordinary filter whose input() is
+// ProcessInput(), which passes the buffer pointers and lengths to the
+// helper process in a small shared memory control page, rings a futex
+// doorbell, and waits for the helper to say how much the filter advanced
+// its inputs and wrote to its outputs.  The helper calls the filter
+// stop() and exits when the stream stops.
+//
+// The filter's construct(), start(), and destroy() are called in this
+// process, and the helper process starts each flow with a copy of what
+// the filter module had after start().  Changes that input() makes to
+// the filter module data, like parameter values, stay in the helper
+// process.
+//
+// The qsParameterSet() values of deferred parameters are passed through
+// the control page too, and the helper process calls their
+// setCallback() before it calls input(), since the filter module data
+// that they change is in the helper process.
+//
+// Stream tags are copied through the control page too, up to
+// PROCESS_MAXTAGS of them per input() call.  Tag keys are just pointers,
+// and the helper process has the same memory as this process, so tag
+// keys that are string constants work in both processes.
+
+
+// Values of QsProcessControl::command
+#define PROCESS_INPUT  ((uint32_t) 1)
+#define PROCESS_STOP   ((uint32_t) 2)
+
+// The number of times we look at a doorbell before we sleep on it.  Most
+// input() calls are short, so the caller is likely to catch the answer
+// without a system call.  With one CPU spinning just keeps the other
+// process from running, so ProcessLaunch() sets spins to 0.
+#define SPINS          ((int) 4000)
+
+static int spins = SPINS;
+
+// The most stream tags that can be passed to or from input() in one
+// call.
+#define PROCESS_MAXTAGS  ((uint32_t) 64)
+
+
+// The control page that is shared with the helper process.
+struct QsProcessControl {
+
+    // Doorbells.  request is incremented by this process for each
+    // command, and reply is incremented by the helper process when it
+    // finishes a command.
+    _Atomic uint32_t request, reply;
+    // Set when a process sleeps on a doorbell, so that the other process
+    // only makes a futex wake system call when it needs to.
+    _Atomic uint32_t helperWaiting, parentWaiting;
+
+    uint32_t command;
+    int ret; // Return value from input() or stop().
+
+    // Stream tags.  Input: the input tags.  Output: the tags from
+    // qsOutputTag(), with offsets from the output buffer.
+    uint32_t numTags;
+    struct QsProcessTag {
+        uint32_t port;
+        struct QsTag tag;
+    } tags[PROCESS_MAXTAGS];
+
+    // Input: the qsParameterSet() values of the filter deferred
+    // parameters, that the helper applies before it calls input().  It
+    // points into this control page, after the ports.
+    struct QsDeferredValue *deferred;
+
+    // Input ports are first, then output ports.
+    struct QsProcessPort {
+        // Input: the input buffer.  Output: the write pointer.
+        void *buffer;
+        // Input: the input length.  Output: the length written.
+        size_t len;
+        // Input: the reader readLength, so qsAdvanceInput() can check
+        // the filter.
+        size_t readLength;
+        // Input: the length the filter advanced.
+        size_t advance;
+        bool isFlushing;
+    } ports[];
+};
+
+
+struct QsProcess {
+
+    // The filter module's input() and stop().
+    int (* input)(void *buffer[], const size_t len[],
+            const bool isFlushing[],
+            uint32_t numInputs, uint32_t numOutputs);
+    int (* stop)(uint32_t numInputs, uint32_t numOutputs);
+
+    // Set while the stream is launched.
+    struct QsProcessControl *control;
+    size_t controlLength;
+
+    // pid is 0 if the helper process is not running.
+    pid_t pid;
+};
+
+
+static inline
+void Ring(_Atomic uint32_t *doorbell, _Atomic uint32_t *waiting) {
+
+    atomic_fetch_add(doorbell, 1);
+    if(atomic_load(waiting))
+        // Not FUTEX_PRIVATE_FLAG, the waiter is in another process.
+        syscall(SYS_futex, doorbell, FUTEX_WAKE, INT32_MAX, 0, 0, 0);
+}
+
+
+// Wait for the doorbell to not be val, or for timeout seconds.
+static inline
+void Wait(_Atomic uint32_t *doorbell, uint32_t val,
+        _Atomic uint32_t *waiting, double timeout) {
+
+    for(int i=0; i<spins; ++i)
+        if(atomic_load_explicit(doorbell, memory_order_acquire) != val)
+            return;
+
+    struct timespec ts = {
+        .tv_sec = timeout,
+        .tv_nsec = (timeout - (time_t) timeout)*1.0e9
+    };
+
+    atomic_store(waiting, 1);
+    if(atomic_load(doorbell) == val)
+        syscall(SYS_futex, doorbell, FUTEX_WAIT, val, &ts, 0, 0);
+    atomic_store(waiting, 0);
+}
+
+
+// Returns true if the helper process is gone, and reaps it.
+static
+bool HelperDied(struct QsFilter *f) {
+
+    struct QsProcess *p = f->process;
+    int status;
+
+    if(!p->pid) return true;
+
+    if(waitpid(p->pid, &status, WNOHANG) != p->pid)
+        return false;
+
+    if(WIFSIGNALED(status))
+        ERROR("filter \"%s\" helper process %d was killed by signal %d",
+                f->name, p->pid, WTERMSIG(status));
+    else
+        ERROR("filter \"%s\" helper process %d exited with status %d",
+                f->name, p->pid, WEXITSTATUS(status));
+
+    p->pid = 0;
+    return true;
+}
+
+
+// Send a command to the helper process, and wait for the reply.
+// Returns true if the helper process died.
+static
+bool Call(struct QsFilter *f, uint32_t command) {
+
+    struct QsProcessControl *c = f->process->control;
+
+    uint32_t seq = atomic_load(&c->reply);
+    c->command = command;
+    Ring(&c->request, &c->helperWaiting);
+
+    while(atomic_load_explicit(&c->reply, memory_order_acquire) == seq) {
+        // We wake up now and then to see if the helper is still there.
+        Wait(&c->reply, seq, &c->parentWaiting, 0.1);
+        if(atomic_load(&c->reply) == seq && HelperDied(f))
+            return true;
+    }
+    return false;
+}
+
+
+// Copy input tags to the control page.
+static
+void PutTags(struct QsFilter *f, struct QsProcessControl *c,
+        const struct QsJobInputTags *inputTags, uint32_t numInputs) {
+
+    uint32_t n = 0;
+
+    for(uint32_t i=0; i<numInputs; ++i)
+        for(uint32_t k=0; k<inputTags[i].num; ++k) {
+            if(n == PROCESS_MAXTAGS) {
+                WARN("Filter \"%s\" dropped input tags; more than %"
+                        PRIu32 " in one input() call",
+                        f->name, PROCESS_MAXTAGS);
+                c->numTags = n;
+                return;
+            }
+            c->tags[n].port = i;
+            c->tags[n++].tag = inputTags[i].tags[k];
+        }
+
+    c->numTags = n;
+}
+
+
+// This is the filter input() that the stream sees.
+static
+int ProcessInput(void *buffers[], const size_t lens[],
+        const bool isFlushing[],
+        uint32_t numInputs, uint32_t numOutputs) {
+
+    struct QsJob *j = pthread_getspecific(_qsKey);
+    DASSERT(j);
+    DASSERT(j->magic == _QS_IS_JOB);
+    struct QsFilter *f = j->filter;
+    struct QsProcess *p = f->process;
+    DASSERT(p);
+    DASSERT(p->control);
+
+    if(!p->pid)
+        return -1; // The helper died already.
+
+    struct QsProcessPort *port = p->control->ports;
+
+    for(uint32_t i=0; i<numInputs; ++i, ++port) {
+        port->buffer = buffers[i];
+        port->len = lens[i];
+        port->readLength = f->readers[i]->readLength;
+        port->isFlushing = isFlushing[i];
+        port->advance = 0;
+    }
+    for(uint32_t i=0; i<numOutputs; ++i, ++port) {
+        port->buffer = f->outputs[i].writePtr;
+        port->len = 0;
+    }
+
+    if(j->inputTags)
+        PutTags(f, p->control, j->inputTags, numInputs);
+    else
+        p->control->numTags = 0;
+
+    if(f->numDeferredParameters)
+        TakeDeferredParameters(f, p->control->deferred);
+
+    if(Call(f, PROCESS_INPUT))
+        // The rest of the stream goes on without this filter.
+        return -1;
+
+    // Now do what the filter would have done if it was in this process.
+    port = p->control->ports;
+    for(uint32_t i=0; i<numInputs; ++i, ++port)
+        if(port->advance)
+            qsAdvanceInput(i, port->advance);
+    for(uint32_t i=0; i<numOutputs; ++i, ++port)
+        if(port->len)
+            qsOutput(i, port->len);
+    for(uint32_t i=0; i<p->control->numTags; ++i) {
+        struct QsProcessTag *t = p->control->tags + i;
+        qsOutputTag(t->port, t->tag.offset, t->tag.key, t->tag.value);
+    }
+
+    return p->control->ret;
+}
+
+
+// This is the filter stop() that the stream sees.
+static
+int ProcessStop(uint32_t numInputs, uint32_t numOutputs) {
+
+    struct QsFilter *f = pthread_getspecific(_qsKey);
+    DASSERT(f);
+    DASSERT(f->mark == _QS_IN_STOP);
+    struct QsProcess *p = f->process;
+    DASSERT(p);
+
+    if(!p->control) {
+        // The stream was not launched, so there is no helper process.
+        if(p->stop)
+            return p->stop(numInputs, numOutputs);
+        return 0;
+    }
+
+    int ret = 0;
+
+    if(p->pid) {
+        if(Call(f, PROCESS_STOP))
+            ret = -1;
+        else {
+            ret = p->control->ret;
+            int status;
+            while(waitpid(p->pid, &status, 0) < 0 && errno == EINTR);
+            p->pid = 0;
+        }
+    }
+
+    munmap(p->control, p->controlLength);
+    p->control = 0;
+
+    return ret;
+}
+
+
+// This is the helper process.  It never returns.
+static
+void RunHelper(struct QsFilter *f, pid_t parent) {
+
+    // Die with the parent process.
+    prctl(PR_SET_PDEATHSIG, SIGKILL);
+    if(getppid() != parent)
+        _exit(1);
+
+    // If the filter module crashes this process must die, and not call
+    // a signal catcher from the program that may wait for a debugger.
+    signal(SIGSEGV, SIG_DFL);
+    signal(SIGBUS, SIG_DFL);
+    signal(SIGFPE, SIG_DFL);
+    signal(SIGILL, SIG_DFL);
+
+    struct QsProcess *p = f->process;
+    struct QsProcessControl *c = p->control;
+    uint32_t numInputs = f->numInputs;
+    uint32_t numOutputs = f->numOutputs;
+
+    // This is our copy of the job from the parent process.  The filter
+    // API functions that input() calls just add to the job's lengths.
+    struct QsJob *j = f->jobs;
+    CHECK(pthread_setspecific(_qsKey, j));
+
+    uint32_t seq = 0;
+
+    while(true) {
+
+        while(atomic_load_explicit(&c->request, memory_order_acquire)
+                == seq) {
+            Wait(&c->request, seq, &c->helperWaiting, 1.0);
+            if(getppid() != parent)
+                _exit(1);
+        }
+        ++seq;
+
+        if(c->command == PROCESS_STOP)
+            break;
+
+        DASSERT(c->command == PROCESS_INPUT);
+
+        struct QsProcessPort *port = c->ports;
+
+        for(uint32_t i=0; i<numInputs; ++i, ++port) {
+            j->inputBuffers[i] = port->buffer;
+            j->inputLens[i] = port->len;
+            j->isFlushing[i] = port->isFlushing;
+            j->advanceLens[i] = 0;
+            f->readers[i]->readLength = port->readLength;
+        }
+        for(uint32_t i=0; i<numOutputs; ++i, ++port) {
+            f->outputs[i].writePtr = port->buffer;
+            j->outputLens[i] = 0;
+            // So that qsOutputTag() offsets are from the output buffer.
+            f->outputs[i].writeCount = 0;
+        }
+
+        if(j->inputTags)
+            for(uint32_t i=0; i<numInputs; ++i)
+                j->inputTags[i].num = 0;
+        for(uint32_t i=0; i<c->numTags; ++i)
+            TagsAddInput(j, c->tags[i].port, &c->tags[i].tag);
+        j->numOutputTags = 0;
+
+        if(f->numDeferredParameters)
+            ApplyDeferredValues(f, c->deferred);
+
+        c->ret = p->input(j->inputBuffers, j->inputLens, j->isFlushing,
+                numInputs, numOutputs);
+
+        port = c->ports;
+        for(uint32_t i=0; i<numInputs; ++i, ++port)
+            port->advance = j->advanceLens[i];
+        for(uint32_t i=0; i<numOutputs; ++i, ++port)
+            port->len = j->outputLens[i];
+
+        if(j->numOutputTags > PROCESS_MAXTAGS) {
+            WARN("Filter \"%s\" dropped output tags; more than %"
+                    PRIu32 " in one input() call",
+                    f->name, PROCESS_MAXTAGS);
+            j->numOutputTags = PROCESS_MAXTAGS;
+        }
+        for(uint32_t i=0; i<j->numOutputTags; ++i) {
+            c->tags[i].port = j->outputTags[i].port;
+            c->tags[i].tag.offset = j->outputTags[i].offset;
+            c->tags[i].tag.key = j->outputTags[i].key;
+            c->tags[i].tag.value = j->outputTags[i].value;
+        }
+        c->numTags = j->numOutputTags;
+
+        Ring(&c->reply, &c->parentWaiting);
+    }
+
+    c->ret = 0;
+    if(p->stop) {
+        CHECK(pthread_setspecific(_qsKey, f));
+        f->mark = _QS_IN_STOP;
+        f->stream->flags |= _QS_STREAM_STOP;
+        c->ret = p->stop(numInputs, numOutputs);
+    }
+    fflush(0);
+
+    Ring(&c->reply, &c->parentWaiting);
+
+    // We do not exit() because that would call the parent process's
+    // atexit() functions.
+    _exit(0);
+}
+
+
+void ProcessInit(struct QsFilter *f) {
+
+    DASSERT(f);
+    DASSERT(f->input);
+    DASSERT(!f->process);
+
+    f->process = calloc(1, sizeof(*f->process));
+    ASSERT(f->process, "calloc(1,%zu) failed", sizeof(*f->process));
+
+    f->process->input = f->input;
+    f->process->stop = f->stop;
+    f->input = ProcessInput;
+    f->stop = ProcessStop;
+}
+
+
+// Returns the number of threads in this process, or 0 if we cannot
+// tell.
+static
+uint32_t NumThreads(void) {
+
+    FILE *file = fopen("/proc/self/status", "r");
+    if(!file) return 0;
+    uint32_t num = 0;
+    char line[128];
+    while(fgets(line, sizeof(line), file))
+        if(sscanf(line, "Threads: %" SCNu32, &num) == 1)
+            break;
+    fclose(file);
+    return num;
+}
+
+
+// Called in qsStreamLaunch() after the ring buffers are mapped and the
+// filter jobs are allocated.
+void ProcessLaunch(struct QsStream *s) {
+
+    DASSERT(_qsMainThread == pthread_self(), "Not main thread");
+
+    bool flushed = false;
+
+    if(sysconf(_SC_NPROCESSORS_ONLN) < 2)
+        spins = 0;
+
+    for(struct QsFilter *f = s->filters; f; f = f->next) {
+
+        if(f->stream != s || !f->process) continue;
+
+        struct QsProcess *p = f->process;
+        DASSERT(!p->control);
+        DASSERT(!p->pid);
+        // There is no multi-threaded filter input() in a helper process.
+        DASSERT(f->maxThreads == 1);
+
+        size_t portsLength = sizeof(*p->control) +
+            (f->numInputs + f->numOutputs)*sizeof(*p->control->ports);
+        p->controlLength = portsLength +
+            f->numDeferredParameters*sizeof(*p->control->deferred);
+        p->control = mmap(0, p->controlLength, PROT_READ|PROT_WRITE,
+                MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+        ASSERT(p->control != MAP_FAILED, "mmap() failed");
+        // The helper process has this mapping at the same address.
+        p->control->deferred = (void *) ((uint8_t *) p->control +
+                portsLength);
+
+        if(!flushed) {
+            // So buffered stdio output is not written by both processes.
+            fflush(0);
+            flushed = true;
+            uint32_t numThreads = NumThreads();
+            if(numThreads > 1)
+                WARN("fork()ing filter helper processes with %" PRIu32
+                        " threads running; locks held by other threads"
+                        " will stay locked in the helper processes",
+                        numThreads);
+        }
+
+        pid_t parent = getpid();
+        p->pid = fork();
+        ASSERT(p->pid >= 0, "fork() failed");
+
+        if(p->pid == 0)
+            RunHelper(f, parent);
+
+        INFO("filter \"%s\" running input() in helper process %d",
+                f->name, p->pid);
+    }
+}
+
+
+void ProcessFree(struct QsFilter *f) {
+
+    struct QsProcess *p = f->process;
+    if(!p) return;
+
+    if(p->pid) {
+        kill(p->pid, SIGKILL);
+        while(waitpid(p->pid, 0, 0) < 0 && errno == EINTR);
+    }
+    if(p->control)
+        munmap(p->control, p->controlLength);
+
+    free(p);
+    f->process = 0;
+}
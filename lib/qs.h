@@ -343,6 +343,9 @@ struct QsStream {
 
     // A Dictionary list of the filters keyed by filter name.
     struct QsDictionary *dict;
+    // A read-only copy of dict that is used from qsStreamLaunch() to
+    // qsStreamStop(), or 0.
+    struct QsFrozenDictionary *frozenFilters;
 
     // List of all filters that this stream can use.  Head of a singly
     // linked list.
@@ -352,6 +355,10 @@ struct QsStream {
     // flow/run time, so we need no mutex to access it.
     uint32_t maxThreads; // We will not create more pthreads than this.
 
+    // If not 0, this replaces the maxThreads argument in the next
+    // qsStreamLaunch().  Set by a controller with qsStreamTuneThreads().
+    uint32_t tuneMaxThreads;
+
 
     uint32_t flags; // bit flags that configure the stream
     // example the bit _QS_STREAM_ALLOWLOOPS may be set to allow loops
@@ -363,6 +370,14 @@ struct QsStream {
     //
     uint32_t (*flow)(struct QsStream *s);
 
+    // Set by qsStreamTrace() to record a timeline of the stream flow.
+    // See trace.c.
+    struct QsTrace *trace;
+
+    // Set by qsStreamLockStats() to measure the stream and filter mutex
+    // locks.  See lockStats.c.
+    struct QsLockProfile *lockStats;
+
 
     //////////////////// STREAM MUTEX GROUP ///////////////////////////////
     //
@@ -376,8 +391,8 @@ struct QsStream {
     // lock would not be as good as a simple mutex, given the low
     // probability of inter thread contention on this mutex.
     //
-    // TODO: We can add the mutex contention test with
-    // pthread_mutex_trylock() when we compile with DEBUG.
+    // The contention of this mutex can be measured with
+    // qsStreamLockStats().
     //
     pthread_mutex_t mutex;
     // cond is paired with mutex.
@@ -496,9 +511,55 @@ struct QsFilter {
     // List of controller's qsAddPostFilterInput() callbacks
     struct QsDictionary *postInputCallbacks;
 
+    // Flat arrays of the callbacks in preInputCallbacks and
+    // postInputCallbacks that the flow calls, so that it does not walk
+    // the dictionaries for every input() call.  They are made in
+    // qsStreamLaunch() and freed in qsStreamStop(), and they are not
+    // changed while the stream flows.  Callbacks that returned non-zero
+    // are skipped, and removed in qsStreamStop().
+    struct ControllerCallback **preInputCBs, **postInputCBs;
+    uint32_t numPreInputCBs, numPostInputCBs;
+
+    // Parameters from qsParameterCreateDeferred().  They are only added
+    // and removed when the stream is not flowing.  deferredPending is
+    // set when a qsParameterSet() value is staged in one of them, and
+    // the thread that calls input() next applies it.
+    struct QsParameter **deferredParameters;
+    uint32_t numDeferredParameters;
+    atomic_bool deferredPending;
+
+    // Lists of the parameters that match the parameter name regular
+    // expressions that this filter has been queried with.
+    struct PatternMatches *patternMatches;
+
+    // A read-only copy of parameters that is used from qsStreamLaunch()
+    // to qsStreamStop(), or 0.  If parameters are created or destroyed
+    // while it's in use frozenParametersStale is set, and we go back to
+    // using parameters.
+    struct QsFrozenDictionary *frozenParameters;
+    atomic_bool frozenParametersStale;
+
 
     void *dlhandle; // from dlopen()
 
+    // If the filter module was linked into the program, and registered
+    // with qsFilterRegisterStatic(), this is set and dlhandle is 0.
+    const struct QsStaticFilter *module;
+
+    // If the filter was loaded with the QS_FILTER_PROCESS flag, this is
+    // set and input() is called in a helper process.  See process.c.
+    struct QsProcess *process;
+
+    // Set by a controller with qsAddFilterLatency() to trace latency
+    // through this filter.  See latency.c.
+    struct QsLatency *latency;
+
+    // Set by the filter module with qsSetFilterUserData() and gotten
+    // with qsGetFilterUserData().  It lets a filter module keep a
+    // different state for each filter that loads it, without using
+    // static data in the module.
+    void *userData;
+
     struct QsApp *app;       // This does not change
     struct QsStream *stream; // This stream can be changed
 
@@ -568,6 +629,21 @@ struct QsFilter {
         // outputLens from qsOuput() and qsGetOutputBuffer() calls from in
         // filter input().   Length of this array is filter numOutputs.
         size_t *outputLens; // amount output was advanced in input() call.
+        //
+        // Stream tags, see tags.c.  These stay 0 if no tags are used.
+        //
+        // Tags from qsOutputTag() calls in this input() call, with
+        // absolute offsets.  They go to the output tag rings after
+        // input() returns.
+        struct QsTagRecord *outputTags;
+        uint32_t numOutputTags, outputTagsSize;
+        //
+        // The tags in the input buffers passed to input(), indexed by
+        // input port number.  Allocated when there is a first tag.
+        struct QsJobInputTags {
+            struct QsTag *tags;
+            uint32_t num, size;
+        } *inputTags;
 
         // This will be the pthread_getspecific() data for each flow
         // thread.  Each thread just calls the filter (QsFilter) input()
@@ -629,6 +705,10 @@ struct QsFilter {
         // feedFilter is the filter that is writing to this reader.
         struct QsFilter *feedFilter;
 
+        // The output (at this pass-through level) that this reader is
+        // in.  Set when the ring buffers are mapped.
+        struct QsOutput *output;
+
         struct QsBuffer *buffer;
 
         // This threshold will trigger a filter->input() call, independent
@@ -654,9 +734,26 @@ struct QsFilter {
         //
         size_t maxRead; // Length in bytes.
 
+        // If not 0, maxRead is made at least this after the filter
+        // start() is called.  Set by a controller with
+        // qsFilterTuneInput().
+        size_t tuneMaxRead;
+
         // The input port number that this filter being written to sees in
         // it's input(,,portNum,) call.
         uint32_t inputPortNum;
+
+        // The element type that the reading filter declared with
+        // qsSetInputType() in it's start().  typeName may be 0 and
+        // elementSize is 0 if no type was declared.
+        const char *typeName;
+        size_t elementSize;
+        //
+        // granule is the least common multiple of the element size and
+        // the alignment.  Input lengths passed to input() and advance
+        // lengths are always a multiple of granule, so that readPtr
+        // always stays aligned.  granule is 1 for untyped bytes.
+        size_t granule;
     }
     // array of pointers to readers array that is in feed filters
     // and not all the feed filters are the same filter.
@@ -784,6 +881,32 @@ struct QsOutput {  // points to reader filters
     //
     size_t maxWrite;
 
+    // If not 0, maxWrite is made at least this after the filter start()
+    // is called.  Set by a controller with qsFilterTuneOutput().
+    size_t tuneMaxWrite;
+
+    // The element type that the writing filter declared with
+    // qsSetOutputType() in it's start().  Like in the reader, the output
+    // lengths must be a multiple of granule, so that writePtr always
+    // stays aligned.  granule is 1 for untyped bytes.
+    const char *typeName;
+    size_t elementSize;
+    size_t granule;
+
+    // The total number of bytes written to this output since the
+    // stream started.  It is changed with a stream mutex lock, by the
+    // filter that owns the output.  Stream tag offsets are in these
+    // bytes.  Outputs at all pass-through levels count the same bytes.
+    uint64_t writeCount;
+
+    // Stream tags that the filter that owns this output wrote.  This is
+    // 0 until there is a tag.  See tags.c.
+    struct QsTagRing *tags;
+
+    // Latency samples that the filter that owns this output wrote.  This
+    // is 0 unless latency is traced.  See latency.c.
+    struct QsLatencyRing *latency;
+
     // This is the maximum of maxWrite and all reader maxRead for
     // this output level in the pass-through buffer list.
     //
@@ -886,6 +1009,47 @@ extern
 void SetPerThreadData(struct QsJob *job);
 
 
+// See prePostInputCallbacks.c.
+extern
+void MakeInputCallbackArrays(struct QsFilter *f);
+
+extern
+void FreeInputCallbackArrays(struct QsFilter *f);
+
+
+// See parameter.c.  Called just before the filter input(), from the
+// thread that calls it, without the stream mutex lock.
+extern
+void ApplyDeferredParameters(struct QsFilter *f);
+
+// A staged deferred parameter value, that is passed to the helper
+// process of a QS_FILTER_PROCESS filter.  See process.c.
+struct QsDeferredValue {
+    uint64_t bits;
+    bool isSet;
+};
+
+// See parameter.c.  For filters with a helper process.  The values
+// array is numDeferredParameters long.
+extern
+void TakeDeferredParameters(struct QsFilter *f,
+        struct QsDeferredValue *values);
+extern
+void ApplyDeferredValues(struct QsFilter *f,
+        const struct QsDeferredValue *values);
+
+// See parameter.c.  Called after the filter parameters are destroyed.
+extern
+void FreeParameterIndex(struct QsFilter *f);
+
+// See streamLaunch.c.
+extern
+void FreezeDictionaries(struct QsStream *s);
+
+extern
+void ThawDictionaries(struct QsStream *s);
+
+
 extern
 void ReallocateFilterArgs(struct QsFilter *f, uint32_t num);
 
@@ -951,6 +1115,28 @@ GetNumAllocJobsForFilter(struct QsStream *s, struct QsFilter *f) {
 }
 
 
+// Returns the length in bytes that the reader may be passed in input(),
+// which is the readLength rounded down to a whole number of the
+// reader's declared element granule.
+//
+// The readLength can be more than the overhang mapping when the feeding
+// filter writes more than the read promise, and the memory past the
+// overhang is not the continuation of the ring buffer, so the readable
+// length is no more than the overhang length.
+//
+// There must be a stream mutex lock to call this.
+static inline
+size_t GetReadableLength(const struct QsReader *r) {
+    DASSERT(r->granule);
+    size_t len = r->readLength;
+    if(len > r->buffer->overhangLength)
+        len = r->buffer->overhangLength;
+    if(r->granule == 1)
+        return len;
+    return len - len % r->granule;
+}
+
+
 struct QsWorkPermit {
 
     // The stream that the thread will work for
@@ -982,16 +1168,79 @@ void LaunchWorkerThread(struct QsStream *s) {
 }
 
 
+// The mutex lock call sites that are measured when the stream has lock
+// statistics (s->lockStats).  See lockStats.c.
+#define QS_LOCK_RUNINPUT         ((uint32_t) 0) // flow.c RunInput()
+#define QS_LOCK_WORKER           ((uint32_t) 1) // flow.c RunningWorkerThread()
+#define QS_LOCK_GETWORK          ((uint32_t) 2) // flow.c GetWork()
+#define QS_LOCK_FLOW             ((uint32_t) 3) // streamLaunch.c nThreadFlow()
+#define QS_LOCK_WAIT             ((uint32_t) 4) // streamLaunch.c qsStreamWait()
+#define QS_LOCK_FILTER_RUNINPUT  ((uint32_t) 5) // filter mutex in RunInput()
+#define QS_LOCK_FILTER_WORKER    ((uint32_t) 6) // filter mutex in RunningWorkerThread()
+#define QS_LOCK_NUMSITES         ((uint32_t) 7)
+
+extern
+void LockStatsLock(pthread_mutex_t *mutex, struct QsLockProfile *p,
+        uint32_t site);
+extern
+void LockStatsUnlock(pthread_mutex_t *mutex, struct QsLockProfile *p,
+        bool isFilterMutex);
+extern
+void LockStatsCondWait(pthread_cond_t *cond, pthread_mutex_t *mutex,
+        struct QsLockProfile *p, uint32_t site);
+extern
+void LockStatsReset(struct QsStream *s);
+extern
+void LockStatsFree(struct QsStream *s);
+
+
+// When the stream is not measuring lock statistics these are just
+// pthread_mutex_lock(), pthread_mutex_unlock() and pthread_cond_wait().
+//
+static inline
+void StreamLock(struct QsStream *s, uint32_t site) {
+    if(s->lockStats)
+        LockStatsLock(&s->mutex, s->lockStats, site);
+    else
+        CHECK(pthread_mutex_lock(&s->mutex));
+}
+
+
+static inline
+void StreamUnlock(struct QsStream *s) {
+    if(s->lockStats)
+        LockStatsUnlock(&s->mutex, s->lockStats, false);
+    else
+        CHECK(pthread_mutex_unlock(&s->mutex));
+}
+
+
+static inline
+void StreamCondWait(struct QsStream *s, pthread_cond_t *cond,
+        uint32_t site) {
+    if(s->lockStats)
+        LockStatsCondWait(cond, &s->mutex, s->lockStats, site);
+    else
+        CHECK(pthread_cond_wait(cond, &s->mutex));
+}
+
+
 static inline
-void CheckLockFilter(struct QsFilter *f) {
-    if(f->mutex)
+void CheckLockFilter(struct QsFilter *f, uint32_t site) {
+    if(!f->mutex) return;
+    if(f->stream->lockStats)
+        LockStatsLock(f->mutex, f->stream->lockStats, site);
+    else
         CHECK(pthread_mutex_lock(f->mutex));
 }
 
 
 static inline
 void CheckUnlockFilter(struct QsFilter *f) {
-    if(f->mutex)
+    if(!f->mutex) return;
+    if(f->stream->lockStats)
+        LockStatsUnlock(f->mutex, f->stream->lockStats, true);
+    else
         CHECK(pthread_mutex_unlock(f->mutex));
 }
 
@@ -999,6 +1248,84 @@ extern
 struct QsDictionary *GetStreamDictionary(const struct QsStream *s);
 
 
+// A stream tag with an absolute offset.  See tags.c.
+struct QsTagRecord {
+    uint64_t offset; // in bytes since the stream started
+    const char *key;
+    double value;
+    uint32_t port; // The output port, for tags in jobs.
+};
+
+// The tags for an output.  It is accessed with a stream mutex lock.
+struct QsTagRing {
+    struct QsTagRecord *records;
+    uint32_t size; // power of 2
+    uint32_t first, num;
+};
+
+
+// See tags.c.  These need a stream mutex lock.
+extern
+void TagsCommit(struct QsFilter *f, struct QsJob *j);
+
+extern
+void TagsGetInput(struct QsFilter *f, struct QsJob *j, uint32_t port);
+
+extern
+void TagsAddInput(struct QsJob *j, uint32_t port,
+        const struct QsTag *tag);
+
+extern
+void TagsFreeOutput(struct QsOutput *output);
+
+extern
+void TagsFreeJob(struct QsJob *j);
+
+// Get the tags for the input window of input port, port, into job, j.
+// Without tags in the outputs that feed the port this is just a few
+// pointer checks.
+static inline
+void GetInputTags(struct QsFilter *f, struct QsJob *j, uint32_t port) {
+
+    for(struct QsOutput *o = f->readers[port]->output; o; o = o->prev)
+        if(o->tags) {
+            TagsGetInput(f, j, port);
+            return;
+        }
+
+    if(j->inputTags)
+        j->inputTags[port].num = 0;
+}
+
+
+// See latency.c.  LatencyAdvance() and LatencyCommit() need a stream
+// mutex lock.
+extern
+void LatencyAdvance(struct QsFilter *f, uint32_t port, size_t len);
+
+extern
+void LatencyCommit(struct QsFilter *f, struct QsJob *j);
+
+extern
+void LatencyFreeOutput(struct QsOutput *output);
+
+// If c is not 0, this only frees the latency state that c added.
+extern
+void LatencyFree(struct QsFilter *f, struct QsController *c);
+
+
+// See process.c.  These run filter input()s in helper processes for
+// filters that were loaded with the QS_FILTER_PROCESS flag.
+extern
+void ProcessInit(struct QsFilter *f);
+
+extern
+void ProcessLaunch(struct QsStream *s);
+
+extern
+void ProcessFree(struct QsFilter *f);
+
+
 // Just Frees the malloc allocated memory that is pointed to from the
 // Parameter Dictionary.  The Parameter Dictionary is not destroyed with
 // this.
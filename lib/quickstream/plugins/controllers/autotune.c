@@ -0,0 +1,358 @@
+// quickstream controller module that tunes the number of worker threads
+// and the buffer sizes of a stream, over many runs of the stream.
+//
+// This module works with one stream.
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <stdatomic.h>
+
+
+#include "../../../../include/quickstream/app.h"
+#include "../../../../include/quickstream/filter.h"
+#include "../../../../include/quickstream/controller.h"
+#include "../../../../include/quickstream/parameter.h"
+#include "../../../debug.h"
+
+
+
+#define DEFAULT_FILE         "autotune.conf"
+#define DEFAULT_MAXTHREADS   ((uint32_t) 4)
+
+// The buffer lengths that are tried are these times
+// QS_DEFAULTMAXWRITE.  0 is for the filter's own lengths.
+static const size_t scales[] = { 0, 4, 16, 64 };
+#define NUM_SCALES  (sizeof(scales)/sizeof(scales[0]))
+
+
+
+void help(FILE *f) {
+    fprintf(f,
+"   Usage: autotune\n"
+"\n"
+"   A controller module that tunes a stream.  With the --calibrate option\n"
+"   each run of the stream (from qsStreamReady() to qsStreamStop()) tries\n"
+"   a different configuration, first the number of worker threads from 1\n"
+"   to the --max-threads option, and then, with the best number of\n"
+"   threads, larger buffers.  The buffers are made larger by making the\n"
+"   filter output write and input read promises at least %zu, %zu or\n"
+"   %zu bytes.  After each run the best configuration so far is written\n"
+"   to a file.  Throughput is the number of bytes read by the sink\n"
+"   filters per second.  The stream must be run at least --max-threads\n"
+"   plus %zu times to try all configurations.  After that the best\n"
+"   configuration is used.\n"
+"\n"
+"   Without the --calibrate option the configuration is read from the\n"
+"   file and used for every run.\n"
+"\n"
+"\n                OPTIONS\n"
+"\n"
+"  --calibrate         try configurations in each run and write the\n"
+"                      best one to the file.\n"
+"\n"
+"\n"
+"  --file FILE         the configuration file.  The default FILE is\n"
+"                      " DEFAULT_FILE ".\n"
+"\n"
+"\n"
+"  --latency FLOOR     find the configuration with the smallest mean\n"
+"                      latency from the sources to the sinks, of those\n"
+"                      with a throughput of at least FLOOR bytes per\n"
+"                      second.  By default the configuration with the\n"
+"                      largest throughput is found.  This uses the filter\n"
+"                      latency tracing, so it can't be used with the\n"
+"                      latency controller.\n"
+"\n"
+"\n"
+"  --max-threads N     the largest number of threads to try.  The default\n"
+"                      N is %" PRIu32 ".\n"
+"\n"
+"\n",
+    scales[1]*QS_DEFAULTMAXWRITE,
+    scales[2]*QS_DEFAULTMAXWRITE,
+    scales[3]*QS_DEFAULTMAXWRITE,
+    NUM_SCALES - 1,
+    DEFAULT_MAXTHREADS);
+}
+
+
+struct Config {
+    uint32_t threads;
+    // 0 for the filter's own lengths.
+    size_t bufferLength;
+};
+
+
+struct Result {
+    double throughput; // bytes per second
+    double latency; // mean seconds, or 0 if not measured
+};
+
+
+static const char *file = DEFAULT_FILE;
+static bool calibrate = false;
+static uint32_t maxThreads = DEFAULT_MAXTHREADS;
+// Less than 0 to find the largest throughput.
+static double latencyFloor = -1.0;
+
+// The configuration for this run.
+static struct Config config;
+
+// Calibration state.
+static uint32_t phase = 0; // 0 threads, 1 buffers, 2 done
+static uint32_t step = 0;
+static uint32_t numRuns = 0;
+static struct Config best;
+static struct Result bestResult;
+static bool haveBest = false;
+
+// Set from the first preStart() to the first preStop() of a run.
+static bool running = false;
+
+// Run measurements.
+static atomic_uint_fast64_t sinkBytes;
+static struct timespec startTime;
+static double latencySum;
+static uint64_t latencyCount;
+
+
+
+static bool
+ReadConfig(const char *filename, struct Config *c) {
+
+    FILE *f = fopen(filename, "r");
+    if(!f) {
+        ERROR("fopen(\"%s\", \"r\") failed", filename);
+        return false;
+    }
+
+    memset(c, 0, sizeof(*c));
+    char line[256];
+    while(fgets(line, sizeof(line), f)) {
+        char key[64];
+        unsigned long long value;
+        if(line[0] == '#' ||
+                sscanf(line, "%63s %llu", key, &value) != 2)
+            continue;
+        if(strcmp(key, "threads") == 0)
+            c->threads = value;
+        else if(strcmp(key, "bufferLength") == 0)
+            c->bufferLength = value;
+        else
+            WARN("Unknown key \"%s\" in file \"%s\"", key, filename);
+    }
+
+    fclose(f);
+    return true;
+}
+
+
+static void
+WriteConfig(const char *filename, const struct Config *c,
+        const struct Result *r) {
+
+    FILE *f = fopen(filename, "w");
+    if(!f) {
+        ERROR("fopen(\"%s\", \"w\") failed", filename);
+        return;
+    }
+
+    fprintf(f, "# quickstream autotune configuration\n"
+            "# throughput %lg bytes/second", r->throughput);
+    if(r->latency)
+        fprintf(f, ", latency %lg seconds", r->latency);
+    fprintf(f, "\nthreads %" PRIu32 "\n"
+            "bufferLength %zu\n", c->threads, c->bufferLength);
+
+    fclose(f);
+}
+
+
+// Returns true if result a is better than result b.
+static bool
+IsBetter(const struct Result *a, const struct Result *b) {
+
+    if(latencyFloor < 0.0)
+        return a->throughput > b->throughput;
+
+    bool aOk = a->throughput >= latencyFloor;
+    bool bOk = b->throughput >= latencyFloor;
+    if(aOk != bOk)
+        return aOk;
+    if(!aOk)
+        return a->throughput > b->throughput;
+    return a->latency < b->latency;
+}
+
+
+// Set config to the next configuration to try, or the best if we are
+// done.
+static void
+NextConfig(void) {
+
+    if(phase == 0) {
+        if(++step <= maxThreads) {
+            config.threads = step;
+            config.bufferLength = 0;
+            return;
+        }
+        phase = 1;
+        step = 0;
+    }
+
+    if(phase == 1) {
+        if(++step < NUM_SCALES) {
+            config.threads = best.threads;
+            config.bufferLength = scales[step]*QS_DEFAULTMAXWRITE;
+            return;
+        }
+        phase = 2;
+        INFO("autotune calibration is done after %" PRIu32 " runs",
+                numRuns);
+    }
+
+    config = best;
+}
+
+
+int construct(int argc, const char **argv) {
+
+    file = qsOptsGetString(argc, argv, "file", DEFAULT_FILE);
+    calibrate = qsOptsGetBool(argc, argv, "calibrate");
+    maxThreads = qsOptsGetUint32(argc, argv, "max-threads",
+            DEFAULT_MAXTHREADS);
+    if(maxThreads == 0) maxThreads = 1;
+    latencyFloor = qsOptsGetDouble(argc, argv, "latency", -1.0);
+
+    if(!calibrate && !ReadConfig(file, &config))
+        return -1; // fail
+
+    return 0; // success
+}
+
+
+static int
+SinkInputCB(struct QsFilter *f, const size_t lenIn[],
+        const size_t lenOut[], const bool isFlushing[],
+        uint32_t numInputs, uint32_t numOutputs, void *userData) {
+
+    size_t bytes = 0;
+    for(uint32_t i=0; i<numInputs; ++i)
+        bytes += lenIn[i];
+    atomic_fetch_add_explicit(&sinkBytes, bytes, memory_order_relaxed);
+    return 0;
+}
+
+
+// This is called with the stream mutex lock.  userData is not 0 for
+// sinks.  The other filters just pass the samples on.
+static void
+LatencyCB(struct QsFilter *f, uint32_t inputPortNum,
+        double edgeLatency, double sourceLatency, void *userData) {
+
+    if(!userData) return;
+
+    latencySum += sourceLatency;
+    ++latencyCount;
+}
+
+
+int preStart(struct QsStream *s, struct QsFilter *f,
+        uint32_t numInputs, uint32_t numOutputs) {
+
+    if(!running) {
+        // This is the first filter in this run.
+        running = true;
+        if(calibrate)
+            NextConfig();
+        atomic_store(&sinkBytes, 0);
+        latencySum = 0;
+        latencyCount = 0;
+        ++numRuns;
+        qsStreamTuneThreads(s, config.threads);
+    }
+
+    if(config.bufferLength) {
+        for(uint32_t i=0; i<numOutputs; ++i)
+            qsFilterTuneOutput(f, i, config.bufferLength);
+        for(uint32_t i=0; i<numInputs; ++i)
+            qsFilterTuneInput(f, i, config.bufferLength);
+    }
+
+    if(!calibrate)
+        return 0;
+
+    if(numOutputs == 0)
+        qsAddPostFilterInput(f, SinkInputCB, 0);
+    if(latencyFloor >= 0.0)
+        qsAddFilterLatency(f, 16, LatencyCB,
+                (void *) (uintptr_t) (numOutputs == 0));
+
+    return 0;
+}
+
+
+int postStart(struct QsStream *s, struct QsFilter *f,
+        uint32_t numInputs, uint32_t numOutputs) {
+
+    // The last one is closest to the flow start.
+    clock_gettime(CLOCK_MONOTONIC, &startTime);
+    return 0;
+}
+
+
+int preStop(struct QsStream *s, struct QsFilter *f,
+        uint32_t numInputs, uint32_t numOutputs) {
+
+    if(!running)
+        // We did this for the first filter.
+        return 0;
+    running = false;
+
+    if(!calibrate || phase == 2)
+        return 0;
+
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    double dt = t.tv_sec - startTime.tv_sec +
+        1.0e-9*(t.tv_nsec - startTime.tv_nsec);
+
+    struct Result r;
+    r.throughput = atomic_load(&sinkBytes)/dt;
+    r.latency = latencyCount?(latencySum/latencyCount):0;
+
+    fprintf(stderr, "autotune run %" PRIu32 ": threads %" PRIu32
+            " bufferLength %zu: %lg bytes/second",
+            numRuns, config.threads, config.bufferLength,
+            r.throughput);
+    if(latencyFloor >= 0.0)
+        fprintf(stderr, " latency %lg seconds", r.latency);
+    fprintf(stderr, "\n");
+
+    if(!haveBest || IsBetter(&r, &bestResult)) {
+        best = config;
+        bestResult = r;
+        haveBest = true;
+    }
+
+    WriteConfig(file, &best, &bestResult);
+
+    return 0;
+}
+
+
+int postStop(struct QsStream *s, struct QsFilter *f,
+        uint32_t numInputs, uint32_t numOutputs) {
+
+    if(calibrate) {
+        qsAddPostFilterInput(f, 0, 0);
+        if(latencyFloor >= 0.0)
+            qsAddFilterLatency(f, 0, 0, 0);
+    }
+
+    return 0;
+}
@@ -8,6 +8,10 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <stdatomic.h>
+#ifdef __x86_64__
+#  include <x86intrin.h>
+#endif
 
 
 #include "../../../../include/quickstream/app.h"
@@ -20,10 +24,27 @@
 
 #define DEFAULT_PERIOD  ((double) 0.0)
 
+// The number of per-thread counter slots for each filter.  Threads past
+// this many share slots, which is still correct since the adds are
+// atomic, just slower.
+#define NUM_SLOTS   ((uint32_t) 8)
+#define CACHE_LINE  ((size_t) 64)
+
 
-static clockid_t clockType = CLOCK_MONOTONIC_COARSE;
 static double period = DEFAULT_PERIOD;
 
+// Related to option --benchmark
+static bool benchmark = false;
+
+// Clock ticks per second, from Calibrate(), and the report period in
+// ticks.
+static double ticksPerSecond = 1.0e9;
+static uint64_t periodTicks = 0;
+
+// Threads get counter slots in the order that they first count.
+static atomic_uint nextSlot = 0;
+static __thread uint32_t slot = -1;
+
 
 
 void help(FILE *f) {
@@ -33,8 +54,18 @@ void help(FILE *f) {
 "   A controller module that adds a bytes counter parameter for all\n"
 "   filters and their input and output ports, in all running streams.\n"
 "\n"
+"   Each thread that calls a filter input() adds to its own counters,\n"
+"   which are in a different cache line than the counters of the other\n"
+"   threads.  The counters of all threads are summed when the parameters\n"
+"   are pushed and when the summary is printed.\n"
+"\n"
 "\n                OPTIONS\n"
 "\n"
+"  --benchmark         measure the time that counting takes in each\n"
+"                      filter input() callback and print it in the\n"
+"                      summary.\n"
+"\n"
+"\n"
 "  --printNoSummary    do not print a count summary to stderr.\n"
 "                      By default a summary is printed to stderr\n"
 "\n"
@@ -52,6 +83,7 @@ void help(FILE *f) {
 
 struct Counter {
 
+    // The sum of the per-thread counters, from the last Sum().
     uint64_t count;
     struct QsParameter *parameter;
 };
@@ -61,7 +93,10 @@ struct FilterBytesCounter {
 
     struct QsFilter *filter;
 
-    struct timespec t; // time of the last parameter push.
+    // Clock ticks at the last parameter push.
+    atomic_uint_fast64_t lastPush;
+    // Set while a thread is summing and pushing.
+    atomic_flag pushing;
 
     // ports 0, 1, 2, 3, .. N-1, and Total
     // For just one port it's just Total at element 0.
@@ -69,6 +104,14 @@ struct FilterBytesCounter {
     uint32_t numInputs;
     uint32_t numOutputs;
 
+    // NUM_SLOTS per-thread counter slots of slotSize bytes.  Each slot
+    // has the counts of input ports 0 .. numInputs-1, then output ports
+    // 0 .. numOutputs-1, then the number of callbacks and the clock
+    // ticks in them (with --benchmark).  The slots are cache line
+    // aligned so threads do not share cache lines.
+    uint8_t *slots;
+    size_t slotSize;
+
     // If there is just one input port then there will be one counter for
     // port 0 and the total, but a parameter for each.
     struct Counter *inputCounters; // array of counters
@@ -88,6 +131,85 @@ static bool printSummary = true;
 static uint32_t printingStreamId = -1;
 
 
+// A cheap clock that does not make a system call, if we have one.
+static inline
+uint64_t GetTicks(void) {
+
+#ifdef __x86_64__
+    // We assume the TSC is invariant, as it is on CPUs made in the last
+    // 15 years or so.
+    return __rdtsc();
+#else
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return ((uint64_t) t.tv_sec)*1000000000 + t.tv_nsec;
+#endif
+}
+
+
+// Find ticksPerSecond for GetTicks().  This is done once.
+static void
+Calibrate(void) {
+
+#ifdef __x86_64__
+    struct timespec t0, t1, dt = { .tv_sec = 0, .tv_nsec = 10000000 };
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    uint64_t ticks0 = GetTicks();
+    nanosleep(&dt, 0);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    uint64_t ticks1 = GetTicks();
+
+    ticksPerSecond = (ticks1 - ticks0)/(t1.tv_sec - t0.tv_sec +
+            1.0e-9*(t1.tv_nsec - t0.tv_nsec));
+#endif
+    DSPEW("bytesCounter clock runs at %lg ticks per second",
+            ticksPerSecond);
+}
+
+
+static inline
+atomic_uint_fast64_t *GetSlot(struct FilterBytesCounter *bc) {
+
+    if(slot == (uint32_t) -1)
+        slot = atomic_fetch_add(&nextSlot, 1) % NUM_SLOTS;
+
+    return (atomic_uint_fast64_t *) (bc->slots + slot*bc->slotSize);
+}
+
+
+// Sum the per-thread counters into the counters with the parameters.
+// Threads may be adding to the per-thread counters while this runs.
+static void
+Sum(struct FilterBytesCounter *bc) {
+
+    uint32_t n = bc->numInputs + bc->numOutputs;
+    uint64_t sums[n];
+    memset(sums, 0, n*sizeof(*sums));
+
+    for(uint32_t k=0; k<NUM_SLOTS; ++k) {
+        atomic_uint_fast64_t *c = (atomic_uint_fast64_t *)
+            (bc->slots + k*bc->slotSize);
+        for(uint32_t i=0; i<n; ++i)
+            sums[i] += atomic_load_explicit(c + i, memory_order_relaxed);
+    }
+
+    if(bc->numInputs) {
+        uint64_t total = 0;
+        for(uint32_t i=0; i<bc->numInputs; ++i)
+            total += (bc->inputCounters[i].count = sums[i]);
+        bc->inputCounters[bc->numInputs].count = total;
+    }
+
+    if(bc->numOutputs) {
+        uint64_t total = 0;
+        for(uint32_t i=0; i<bc->numOutputs; ++i)
+            total += (bc->outputCounters[i].count =
+                    sums[bc->numInputs + i]);
+        bc->outputCounters[bc->numOutputs].count = total;
+    }
+}
+
+
 void PrintStreamHeader(const struct QsFilter *f) {
 
 
@@ -174,6 +296,21 @@ PrintSummary(struct FilterBytesCounter *bc, FILE *file) {
                 "    |--------------------    NO OUTPUTS    --------------------------|\n",
                 line);
 
+    if(benchmark) {
+        uint64_t calls = 0, ticks = 0;
+        uint32_t n = bc->numInputs + bc->numOutputs;
+        for(uint32_t k=0; k<NUM_SLOTS; ++k) {
+            atomic_uint_fast64_t *c = (atomic_uint_fast64_t *)
+                (bc->slots + k*bc->slotSize);
+            calls += atomic_load(c + n);
+            ticks += atomic_load(c + n + 1);
+        }
+        fprintf(file,
+                "    |   counting took %3.3lg seconds per input() call"
+                " in %" PRIu64 " calls\n",
+                calls?(ticks/(ticksPerSecond*calls)):0.0, calls);
+    }
+
     fprintf(file,
                 "    |%s|\n",
                 line);
@@ -191,8 +328,10 @@ CleanFilterByteCounter(const char *pName,
     //DSPEW("Cleaning up filter parameter \"%s:%s\"",
     //        qsFilterName(bc->filter), pName);
 
-    if(printingStreamId == qsFilterStreamId(bc->filter))
+    if(printingStreamId == qsFilterStreamId(bc->filter)) {
+        Sum(bc);
         PrintSummary(bc, stderr);
+    }
 
 
     if(bc->numInputs) {
@@ -227,6 +366,8 @@ CleanFilterByteCounter(const char *pName,
         DASSERT(bc->outputCounters == 0);
 #endif
 
+    free(bc->slots);
+
 #ifdef DEBUG
     memset(bc, 0, sizeof(*bc));
 #endif
@@ -241,12 +382,41 @@ int construct(int argc, const char **argv) {
 
     printSummary = !qsOptsGetBool(argc, argv, "printNoSummary");
     period = qsOptsGetDouble(argc, argv, "report-period", DEFAULT_PERIOD);
+    benchmark = qsOptsGetBool(argc, argv, "benchmark");
+
+    if(period > 0.0 || benchmark)
+        Calibrate();
+    periodTicks = period*ticksPerSecond;
 
     return 0; // success
 }
 
 
-// This callback is called after every filter module input() call.
+// Returns true if this thread should sum the counters and push the
+// parameters now.  If so the caller must clear bc->pushing after.
+static inline
+bool StartPush(struct FilterBytesCounter *bc) {
+
+    if(periodTicks) {
+        uint64_t t = GetTicks();
+        uint64_t last = atomic_load_explicit(&bc->lastPush,
+                memory_order_relaxed);
+        if(t - last < periodTicks ||
+                !atomic_compare_exchange_strong(&bc->lastPush, &last, t))
+            // It's not time yet, or another thread just did it.
+            return false;
+    }
+
+    // If another thread is pushing we let it, and our counts will be in
+    // the next push.
+    return !atomic_flag_test_and_set(&bc->pushing);
+}
+
+
+// This callback is called after every filter module input() call, from
+// the thread that called input(), without a stream mutex lock.  Threads
+// only add to their own counters, so it does not matter how many
+// threads call the filter input().
 //
 int postFilterInputCB(
             struct QsFilter *f,
@@ -256,76 +426,48 @@ int postFilterInputCB(
             uint32_t numInputs, uint32_t numOutputs,
             struct FilterBytesCounter *bc) {
 
-    // TODO: How will multi-threaded filter::input() functions break this?
-    // Do we need a mutex for multi-threaded filter::input().
-    //
-    // For single threaded filter input() this will be called after the
-    // filter input() in that thread call and not during, so there's no
-    // multi-thread issue here.
-    //
-    //DSPEW("filter=\"%s\"", qsFilterName(f));
-
     DASSERT(numInputs == bc->numInputs);
     DASSERT(numOutputs == bc->numOutputs);
 
-    bool pushReport = true;
-
-    if(period) {
-
-        struct timespec t;
-        clock_gettime(clockType, &t);
-        double dt = t.tv_sec - bc->t.tv_sec +
-            (1.0e-9)*(t.tv_nsec - bc->t.tv_nsec);
-        if(dt < period)
-            // Do not push (report) this measurement.  But we still need
-            // to tally the byte counters.
-            pushReport = false;
-        else {
-            // Save the last time that we pushed the measurement.
-            bc->t.tv_sec = t.tv_sec;
-            bc->t.tv_nsec = t.tv_nsec;
-        }
-    }
+    uint64_t t0 = 0;
+    if(benchmark)
+        t0 = GetTicks();
 
+    atomic_uint_fast64_t *c = GetSlot(bc);
 
-    if(numInputs) {
-        // zero the total at the start of this for loop.
-        bc->inputCounters[numInputs].count = 0;
-        uint32_t i=0;
-        for(; i<numInputs; ++i) {
-            // Add to the port count and the total is the sum of all.
-            bc->inputCounters[numInputs].count +=
-                (bc->inputCounters[i].count +=
-                    lenIn[i]);
-            if(pushReport)
-                // Port i
+    for(uint32_t i=0; i<numInputs; ++i)
+        if(lenIn[i])
+            atomic_fetch_add_explicit(c + i, lenIn[i],
+                    memory_order_relaxed);
+    c += numInputs;
+    for(uint32_t i=0; i<numOutputs; ++i)
+        if(lenOut[i])
+            atomic_fetch_add_explicit(c + i, lenOut[i],
+                    memory_order_relaxed);
+
+    if(StartPush(bc)) {
+
+        Sum(bc);
+
+        if(numInputs)
+            // Ports and the total.
+            for(uint32_t i=0; i<=numInputs; ++i)
                 qsParameterPushByPointer(bc->inputCounters[i].parameter,
                         &(bc->inputCounters[i].count));
-        }
-        if(pushReport)
-            // Total
-            qsParameterPushByPointer(bc->inputCounters[i].parameter,
-                    &(bc->inputCounters[i].count));
-    }
 
-    if(numOutputs) {
-        // zero the total at the start of this for loop.
-        bc->outputCounters[numOutputs].count = 0;
-        uint32_t i=0;
-        for(; i<numOutputs; ++i) {
-            // Add to the port count and the total is the sum of all.
-            bc->outputCounters[numOutputs].count +=
-                (bc->outputCounters[i].count +=
-                    lenOut[i]);
-            if(pushReport)
-                // Port i
+        if(numOutputs)
+            for(uint32_t i=0; i<=numOutputs; ++i)
                 qsParameterPushByPointer(bc->outputCounters[i].parameter,
                         &(bc->outputCounters[i].count));
-        }
-        if(pushReport)
-            // Total
-            qsParameterPushByPointer(bc->outputCounters[i].parameter,
-                    &(bc->outputCounters[i].count));
+
+        atomic_flag_clear(&bc->pushing);
+    }
+
+    if(benchmark) {
+        c += numOutputs;
+        atomic_fetch_add_explicit(c, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(c + 1, GetTicks() - t0,
+                memory_order_relaxed);
     }
 
     return 0;
@@ -352,6 +494,16 @@ int preStart(struct QsStream *s, struct QsFilter *f,
     bc->numInputs = numInputs;
     bc->numOutputs = numOutputs;
     bc->filter = f;
+    atomic_flag_clear(&bc->pushing);
+
+    // The counts, the number of callbacks and the ticks, rounded up to
+    // whole cache lines.
+    bc->slotSize = (numInputs + numOutputs + 2)*sizeof(uint64_t);
+    bc->slotSize = ((bc->slotSize + CACHE_LINE - 1)/CACHE_LINE)*CACHE_LINE;
+    bc->slots = aligned_alloc(CACHE_LINE, NUM_SLOTS*bc->slotSize);
+    ASSERT(bc->slots, "aligned_alloc(%zu,%zu) failed",
+            CACHE_LINE, NUM_SLOTS*bc->slotSize);
+    memset(bc->slots, 0, NUM_SLOTS*bc->slotSize);
 
     clock_gettime(CLOCK_MONOTONIC, &bc->start);
 
@@ -0,0 +1,308 @@
+// quickstream controller module that measures how long every filter
+// input() call takes, in all running streams.
+//
+// This module should be able to work with more than one stream running.
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <stdatomic.h>
+
+
+#include "../../../../include/quickstream/app.h"
+#include "../../../../include/quickstream/filter.h"
+#include "../../../../include/quickstream/controller.h"
+#include "../../../../include/quickstream/parameter.h"
+#include "../../../debug.h"
+
+
+
+// The histogram is log-linear, like HDR histograms: values less than
+// 2^SUB_BITS nanoseconds have a bin each, and each power of 2 above that
+// is split into 2^SUB_BITS linear bins, so bins are never wider than
+// 1/2^SUB_BITS (about 3%) of the values in them.
+#define SUB_BITS  (5)
+#define SUB_BINS  ((uint32_t) 1 << SUB_BITS)
+#define NUM_BINS  ((64 - SUB_BITS + 1)*SUB_BINS)
+
+
+
+void help(FILE *f) {
+    fprintf(f,
+"   Usage: inputTime\n"
+"\n"
+"   A controller module that measures how long each filter input() call\n"
+"   takes, for all filters in all running streams.  The times are kept in\n"
+"   a log-linear histogram for each filter, with bins that are no wider\n"
+"   than about 3%% of the times in them.  The time is from just before\n"
+"   input() is called to just after input() returns, before the stream\n"
+"   mutex is locked.\n"
+"\n"
+"   When the stream stops this pushes, for each filter, the parameters\n"
+"   \"inputP50\", \"inputP99\", \"inputP99.9\" and \"inputMax\", which are\n"
+"   the 50, 99 and 99.9 percentiles and the maximum input() times in\n"
+"   seconds, of type QsDouble; and prints a summary to stderr.\n"
+"\n"
+"\n                OPTIONS\n"
+"\n"
+"  --printNoSummary    do not print the summary to stderr.\n"
+"                      By default it is printed to stderr\n"
+"\n"
+"\n");
+}
+
+
+// Recording a value is lock-free.  The filter may be multi-threaded so
+// more than one thread may record at a time.
+struct Histogram {
+    atomic_uint_fast64_t count, max; // max in nanoseconds
+    atomic_uint_fast64_t bins[NUM_BINS];
+};
+
+
+struct FilterInputTime {
+
+    struct QsFilter *filter;
+
+    struct Histogram histogram;
+
+    // p50, p99, p99.9 and max
+    struct QsParameter *parameters[4];
+
+    struct FilterInputTime *next;
+};
+
+
+static const char *pNames[4] = {
+    "inputP50", "inputP99", "inputP99.9", "inputMax"
+};
+static const double percents[3] = { 50.0, 99.0, 99.9 };
+
+
+// Related to option --printNoSummary
+//
+static bool printSummary = true;
+
+// All filters that we are measuring in all streams.  This list is
+// only accessed by the main thread.
+static struct FilterInputTime *filters = 0;
+
+// The time that this thread called the current filter input() in
+// nanoseconds.
+static __thread uint64_t startTime;
+
+
+static inline
+uint64_t GetTime(void) {
+
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return ((uint64_t) t.tv_sec)*1000000000 + t.tv_nsec;
+}
+
+
+static inline
+uint32_t GetBin(uint64_t ns) {
+
+    if(ns < SUB_BINS)
+        return ns;
+
+    // The highest set bit is bit e, e >= SUB_BITS.
+    uint32_t e = 63 - __builtin_clzll(ns);
+    return (e - SUB_BITS + 1)*SUB_BINS +
+        ((ns >> (e - SUB_BITS)) - SUB_BINS);
+}
+
+
+// The smallest value in bin i, in nanoseconds.
+static inline
+uint64_t GetBinValue(uint32_t i) {
+
+    if(i < SUB_BINS)
+        return i;
+    uint32_t k = i >> SUB_BITS;
+    return ((uint64_t) (SUB_BINS + (i & (SUB_BINS - 1)))) << (k - 1);
+}
+
+
+static inline
+void Record(struct Histogram *h, uint64_t ns) {
+
+    atomic_fetch_add_explicit(h->bins + GetBin(ns), 1,
+            memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->count, 1, memory_order_relaxed);
+
+    uint64_t max = atomic_load_explicit(&h->max, memory_order_relaxed);
+    while(ns > max && !atomic_compare_exchange_weak_explicit(&h->max,
+                &max, ns, memory_order_relaxed, memory_order_relaxed));
+}
+
+
+// Returns the percentile value in seconds, from the middle of the bin
+// that it is in.  This is called when no threads are recording.
+static double
+GetPercentile(struct Histogram *h, double percent) {
+
+    uint64_t count = atomic_load(&h->count);
+    if(!count) return 0.0;
+
+    // The number of values that are at or below the percentile.
+    uint64_t n = (uint64_t) (percent*0.01*count + 0.5);
+    if(n < 1) n = 1;
+
+    uint64_t sum = 0;
+    for(uint32_t i=0; i<NUM_BINS; ++i) {
+        sum += atomic_load(h->bins + i);
+        if(sum >= n) {
+            uint64_t max = atomic_load(&h->max);
+            double value = max;
+            if(i + 1 < NUM_BINS)
+                value = 0.5*(GetBinValue(i) + GetBinValue(i+1));
+            if(value > max) value = max;
+            return 1.0e-9 * value;
+        }
+    }
+
+    return 1.0e-9 * atomic_load(&h->max);
+}
+
+
+static void
+CleanFilterInputTime(const char *pName, struct FilterInputTime *ft) {
+
+    DASSERT(ft);
+
+    struct FilterInputTime *prev = 0;
+    struct FilterInputTime *x = filters;
+    while(x && x != ft) {
+        prev = x;
+        x = x->next;
+    }
+    DASSERT(x);
+    if(prev)
+        prev->next = ft->next;
+    else
+        filters = ft->next;
+
+#ifdef DEBUG
+    memset(ft, 0, sizeof(*ft));
+#endif
+    free(ft);
+}
+
+
+int construct(int argc, const char **argv) {
+
+    printSummary = !qsOptsGetBool(argc, argv, "printNoSummary");
+
+    return 0; // success
+}
+
+
+// This is called just before the filter input() by the thread that
+// calls it.
+static int
+PreInputCB(struct QsFilter *f, const size_t lenIn[],
+        const bool isFlushing[],
+        uint32_t numInputs, uint32_t numOutputs,
+        struct FilterInputTime *ft) {
+
+    startTime = GetTime();
+    return 0;
+}
+
+
+// This is called just after the filter input() by the same thread.
+static int
+PostInputCB(struct QsFilter *f, const size_t lenIn[],
+        const size_t lenOut[], const bool isFlushing[],
+        uint32_t numInputs, uint32_t numOutputs,
+        struct FilterInputTime *ft) {
+
+    Record(&ft->histogram, GetTime() - startTime);
+    return 0;
+}
+
+
+int preStart(struct QsStream *s, struct QsFilter *f,
+        uint32_t numInputs, uint32_t numOutputs) {
+
+    DSPEW("filter=\"%s\"", qsFilterName(f));
+
+    struct FilterInputTime *ft = calloc(1, sizeof(*ft));
+    ASSERT(ft, "calloc(1,%zu) failed", sizeof(*ft));
+    ft->filter = f;
+
+    for(uint32_t i=0; i<4; ++i)
+        // Note: we let the last parameter do the cleanup of the struct
+        // FilterInputTime.
+        ft->parameters[i] = qsParameterCreateForFilter(f,
+                pNames[i], QsDouble,
+                0 /*setCallback=0*/,
+                (i == 3)?
+                    (void (*)(const char *pName, void *userData))
+                    CleanFilterInputTime:0 /*cleanup*/,
+                ft/*userData*/);
+
+    ft->next = filters;
+    filters = ft;
+
+    qsAddPreFilterInput(f,
+            (int (*)(struct QsFilter *filter, const size_t lenIn[],
+                const bool isFlushing[],
+                uint32_t numInputs, uint32_t numOutputs,
+                void *userData)) PreInputCB, ft);
+    qsAddPostFilterInput(f,
+            (int (*)(struct QsFilter *filter, const size_t lenIn[],
+                const size_t lenOut[], const bool isFlushing[],
+                uint32_t numInputs, uint32_t numOutputs,
+                void *userData)) PostInputCB, ft);
+
+    return 0; // keep calling for all filters.
+}
+
+
+int preStop(struct QsStream *s, struct QsFilter *f,
+        uint32_t numInputs, uint32_t numOutputs) {
+
+    struct FilterInputTime *ft = filters;
+    while(ft && ft->filter != f)
+        ft = ft->next;
+    if(!ft) return 0;
+
+    double values[4];
+    for(uint32_t i=0; i<3; ++i)
+        values[i] = GetPercentile(&ft->histogram, percents[i]);
+    values[3] = 1.0e-9 * atomic_load(&ft->histogram.max);
+
+    for(uint32_t i=0; i<4; ++i)
+        qsParameterPushByPointer(ft->parameters[i], values + i);
+
+    if(printSummary)
+        fprintf(stderr, "  Filter \"%s\" input() %" PRIu64 " calls"
+                "  p50 %3.3lg  p99 %3.3lg  p99.9 %3.3lg  max %3.3lg"
+                " seconds\n",
+                qsFilterName(f), (uint64_t) atomic_load(&ft->histogram.count),
+                values[0], values[1], values[2], values[3]);
+
+    return 0;
+}
+
+
+int postStop(struct QsStream *s, struct QsFilter *f,
+        uint32_t numInputs, uint32_t numOutputs) {
+
+    qsAddPreFilterInput(f, 0, 0);
+    qsAddPostFilterInput(f, 0, 0);
+
+    // Because quickstream can re-configure filter connections between
+    // stream runs, we must destroy all the parameters that we created
+    // and recreate them (possibly differently) again in the next run
+    // preStart().
+    qsParameterDestroyForFilter(f, "^input(P50|P99|P99\\.9|Max)$",
+            QS_PNAME_REGEX);
+
+    return 0;
+}
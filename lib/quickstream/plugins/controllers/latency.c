@@ -0,0 +1,260 @@
+// quickstream controller module that traces sampled data latency
+// through every filter in all running streams.
+//
+// This module should be able to work with more than one stream running.
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+
+#include "../../../../include/quickstream/app.h"
+#include "../../../../include/quickstream/filter.h"
+#include "../../../../include/quickstream/controller.h"
+#include "../../../../include/quickstream/parameter.h"
+#include "../../../debug.h"
+
+
+
+#define DEFAULT_SAMPLE_EVERY  ((uint32_t) 16)
+
+// Histogram bin 0 is less than 1 micro-second, and bin N is from 2^(N-1)
+// to 2^N micro-seconds.  The last bin has all that is larger.
+#define NUM_BINS  ((uint32_t) 32)
+
+
+static uint32_t sampleEvery = DEFAULT_SAMPLE_EVERY;
+
+
+
+void help(FILE *f) {
+    fprintf(f,
+"   Usage: latency\n"
+"\n"
+"   A controller module that traces sampled latency through all filters,\n"
+"   in all running streams.  Every N input() calls, source filters mark\n"
+"   the bytes they write with the time, and the marks are passed through\n"
+"   the filter graph as the filters read and write.  Each time a filter\n"
+"   reads a marked byte on input port # this pushes the parameters\n"
+"   \"latencyIn#\", which is the time in seconds since the filter that\n"
+"   feeds the port wrote it, and \"latencySource\", which is the time in\n"
+"   seconds since the source wrote it.  Both are of type QsDouble.\n"
+"   Histograms of the latencies are printed to stderr when the stream\n"
+"   stops.\n"
+"\n"
+"\n                OPTIONS\n"
+"\n"
+"  --printNoSummary    do not print the histograms to stderr.\n"
+"                      By default they are printed to stderr\n"
+"\n"
+"\n"
+"  --sample-every N    mark the source output every N input() calls.\n"
+"                      The default N is %" PRIu32 ".\n"
+"\n"
+"\n",
+    DEFAULT_SAMPLE_EVERY);
+}
+
+
+struct Histogram {
+
+    uint64_t count;
+    double sum, max;
+    uint64_t bins[NUM_BINS];
+
+    struct QsParameter *parameter;
+};
+
+
+struct FilterLatency {
+
+    struct QsFilter *filter;
+
+    uint32_t numInputs;
+
+    // Input ports 0, 1, 2, 3, .. N-1, and the source latency at N.
+    struct Histogram *histograms;
+};
+
+
+// Related to option --printNoSummary
+//
+static bool printSummary = true;
+
+
+static inline
+void Add(struct Histogram *h, double t) {
+
+    ++h->count;
+    h->sum += t;
+    if(t > h->max) h->max = t;
+
+    uint32_t i = 0;
+    double us = t*1.0e6;
+    if(us >= 1.0) {
+        i = ilogb(us) + 1;
+        if(i >= NUM_BINS) i = NUM_BINS - 1;
+    }
+    ++h->bins[i];
+
+    qsParameterPushByPointer(h->parameter, &t);
+}
+
+
+static void
+PrintHistogram(const struct Histogram *h, const char *name, FILE *file) {
+
+    if(!h->count) {
+        fprintf(file, "    %-14s  no samples\n", name);
+        return;
+    }
+
+    fprintf(file, "    %-14s  %" PRIu64 " samples  mean %3.3lg  max"
+            " %3.3lg seconds\n",
+            name, h->count, h->sum/h->count, h->max);
+
+    for(uint32_t i=0; i<NUM_BINS; ++i) {
+        if(!h->bins[i]) continue;
+        if(i == 0)
+            fprintf(file, "        %12s < %-10g us", "", 1.0);
+        else
+            fprintf(file, "        %12g - %-10g us",
+                    ldexp(1.0, i-1), ldexp(1.0, i));
+        fprintf(file, " %12" PRIu64 "\n", h->bins[i]);
+    }
+}
+
+
+static void
+CleanFilterLatency(const char *pName, struct FilterLatency *fl) {
+
+    DASSERT(fl);
+    DASSERT(fl->histograms);
+
+    if(printSummary) {
+
+        fprintf(stderr,
+                "  |------------------------------------------------------------------|\n"
+                "  |    Filter \"%s\" latency\n"
+                "  |------------------------------------------------------------------|\n",
+                qsFilterName(fl->filter));
+
+        for(uint32_t i=0; i<=fl->numInputs; ++i) {
+            char name[24];
+            if(i < fl->numInputs)
+                snprintf(name, 24, "input port %" PRIu32, i);
+            else
+                strcpy(name, "from source");
+            PrintHistogram(fl->histograms + i, name, stderr);
+        }
+    }
+
+#ifdef DEBUG
+    memset(fl->histograms, 0,
+            (fl->numInputs+1)*sizeof(*fl->histograms));
+#endif
+    free(fl->histograms);
+#ifdef DEBUG
+    memset(fl, 0, sizeof(*fl));
+#endif
+    free(fl);
+}
+
+
+int construct(int argc, const char **argv) {
+
+    printSummary = !qsOptsGetBool(argc, argv, "printNoSummary");
+    sampleEvery = qsOptsGetUint32(argc, argv, "sample-every",
+            DEFAULT_SAMPLE_EVERY);
+
+    return 0; // success
+}
+
+
+// This is called each time filter, f, reads past a latency sample.
+//
+static void
+LatencyCB(struct QsFilter *f, uint32_t inputPortNum,
+        double edgeLatency, double sourceLatency,
+        struct FilterLatency *fl) {
+
+    DASSERT(fl);
+    DASSERT(inputPortNum < fl->numInputs);
+
+    Add(fl->histograms + inputPortNum, edgeLatency);
+    Add(fl->histograms + fl->numInputs, sourceLatency);
+}
+
+
+int preStart(struct QsStream *s, struct QsFilter *f,
+        uint32_t numInputs, uint32_t numOutputs) {
+
+    DSPEW("filter=\"%s\"", qsFilterName(f));
+
+    void (*callback)(struct QsFilter *filter, uint32_t inputPortNum,
+            double edgeLatency, double sourceLatency, void *userData) =
+        (void (*)(struct QsFilter *filter, uint32_t inputPortNum,
+            double edgeLatency, double sourceLatency, void *userData))
+        LatencyCB;
+
+    if(numInputs == 0) {
+        // A source just makes samples, so we have no latency to measure
+        // here.
+        qsAddFilterLatency(f, sampleEvery, callback, 0);
+        return 0;
+    }
+
+    struct FilterLatency *fl = calloc(1, sizeof(*fl));
+    ASSERT(fl, "calloc(1,%zu) failed", sizeof(*fl));
+    fl->filter = f;
+    fl->numInputs = numInputs;
+
+    // We require 1 more for the source latency.
+    fl->histograms = calloc(numInputs + 1, sizeof(*fl->histograms));
+    ASSERT(fl->histograms, "calloc(%" PRIu32 ",%zu) failed",
+            numInputs + 1, sizeof(*fl->histograms));
+
+    for(uint32_t i=0; i<numInputs; ++i) {
+        char pName[24];
+        snprintf(pName, 24, "latencyIn%" PRIu32, i);
+        fl->histograms[i].parameter =
+            qsParameterCreateForFilter(f,
+                pName, QsDouble,
+                0 /*setCallback=0*/,
+                0 /*cleanup=0*/,
+                fl/*userData*/);
+    }
+
+    // Note: we let this parameter do the cleanup of the struct
+    // FilterLatency.
+    fl->histograms[numInputs].parameter =
+        qsParameterCreateForFilter(f,
+                "latencySource", QsDouble,
+                0 /*setCallback=0*/,
+                (void (*)(const char *pName, void *userData))
+                    CleanFilterLatency/*cleanup*/,
+                fl/*userData*/);
+
+    qsAddFilterLatency(f, sampleEvery, callback, fl);
+
+    return 0; // keep calling for all filters.
+}
+
+
+int postStop(struct QsStream *s, struct QsFilter *f,
+        uint32_t numInputs, uint32_t numOutputs) {
+
+    if(numInputs == 0)
+        return 0;
+
+    // Because quickstream can re-configure filter connections between
+    // stream runs, we must destroy all the parameters that we created
+    // and recreate them (possibly differently) again in the next run
+    // preStart().
+    qsParameterDestroyForFilter(f, "^latency(In[0-9]+|Source)$",
+            QS_PNAME_REGEX);
+
+    return 0;
+}
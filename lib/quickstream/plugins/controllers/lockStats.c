@@ -0,0 +1,146 @@
+// quickstream controller module that measures the stream and filter
+// mutex lock contention in all running streams.
+//
+// This module should be able to work with more than one stream running.
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#include "../../../../include/quickstream/app.h"
+#include "../../../../include/quickstream/filter.h"
+#include "../../../../include/quickstream/controller.h"
+#include "../../../../include/quickstream/parameter.h"
+#include "../../../debug.h"
+
+
+
+void help(FILE *f) {
+    fprintf(f,
+"   Usage: lockStats\n"
+"\n"
+"   A controller module that measures the stream mutex and filter mutex\n"
+"   lock contention, in all running streams.  For each place in the\n"
+"   quickstream flow code that locks a mutex, it counts the locks, the\n"
+"   locks that had to wait for another thread, the time waiting and the\n"
+"   time the lock was held, and the time that idle worker threads wait\n"
+"   for a job.  These are printed to stderr when each stream stops.\n"
+"\n"
+"   When each stream stops this pushes the controller parameters:\n"
+"   \"lockWait\" the seconds the worker threads waited for the stream\n"
+"   mutex, \"lockHold\" the seconds the stream mutex was held,\n"
+"   \"lockContended\" the fraction of the stream mutex locks that had to\n"
+"   wait, and \"idleWait\" the seconds idle threads waited for a job.\n"
+"   They are all of type QsDouble.\n"
+"\n"
+"\n                OPTIONS\n"
+"\n"
+"  --printNoSummary    do not print the statistics to stderr.\n"
+"                      By default they are printed to stderr\n"
+"\n"
+"\n");
+}
+
+
+// Related to option --printNoSummary
+//
+static bool printSummary = true;
+// Marker to keep us from reporting a stream more than once.
+static uint32_t reportedStreamId = -1;
+
+static struct QsParameter *lockWait, *lockHold, *lockContended,
+        *idleWait;
+
+
+int construct(int argc, const char **argv) {
+
+    printSummary = !qsOptsGetBool(argc, argv, "printNoSummary");
+
+    lockWait = qsParameterCreate("lockWait", QsDouble, 0, 0, 0);
+    lockHold = qsParameterCreate("lockHold", QsDouble, 0, 0, 0);
+    lockContended = qsParameterCreate("lockContended", QsDouble, 0, 0, 0);
+    idleWait = qsParameterCreate("idleWait", QsDouble, 0, 0, 0);
+
+    return 0; // success
+}
+
+
+int preStart(struct QsStream *s, struct QsFilter *f,
+        uint32_t numInputs, uint32_t numOutputs) {
+
+    reportedStreamId = -1;
+
+    // This is called for each filter in the stream, but it only turns
+    // it on the first time.
+    qsStreamLockStats(s, true);
+
+    return 0;
+}
+
+
+static void
+PrintStats(uint32_t streamId, const struct QsLockStats *stats,
+        uint32_t numSites, FILE *file) {
+
+    fprintf(file,
+        "  |------------------------------------------------------------------|\n"
+        "  |    Stream %" PRIu32 " mutex locks\n"
+        "  |------------------------------------------------------------------|\n"
+        "    %-32s %10s %10s %10s %10s %10s\n",
+        streamId, "site", "locks", "contended", "wait(s)", "hold(s)",
+        "cond(s)");
+
+    for(uint32_t i=0; i<numSites; ++i) {
+        const struct QsLockStats *st = stats + i;
+        if(!st->count) continue;
+        fprintf(file, "    %-32s %10" PRIu64 " %10" PRIu64
+                " %10.3lg %10.3lg %10.3lg\n",
+                st->site, st->count, st->contended,
+                st->waitTime, st->holdTime, st->condWaitTime);
+    }
+}
+
+
+int postStop(struct QsStream *s, struct QsFilter *f,
+        uint32_t numInputs, uint32_t numOutputs) {
+
+    uint32_t streamId = qsFilterStreamId(f);
+
+    if(reportedStreamId == streamId)
+        return 0;
+    reportedStreamId = streamId;
+
+    uint32_t numSites;
+    const struct QsLockStats *stats = qsStreamGetLockStats(s, &numSites);
+    if(!stats) return 0;
+
+    // Totals for the stream mutex.
+    double wait = 0, hold = 0, idle = 0, contended = 0;
+    uint64_t count = 0, numContended = 0;
+
+    for(uint32_t i=0; i<numSites; ++i) {
+        if(strstr(stats[i].site, " filter mutex"))
+            continue;
+        count += stats[i].count;
+        numContended += stats[i].contended;
+        wait += stats[i].waitTime;
+        hold += stats[i].holdTime;
+        if(strcmp(stats[i].site, "GetWork") == 0)
+            // Not the main thread waiting in qsStreamWait().
+            idle += stats[i].condWaitTime;
+    }
+    if(count)
+        contended = ((double) numContended)/count;
+
+    if(printSummary)
+        PrintStats(streamId, stats, numSites, stderr);
+
+    qsParameterPushByPointer(lockWait, &wait);
+    qsParameterPushByPointer(lockHold, &hold);
+    qsParameterPushByPointer(lockContended, &contended);
+    qsParameterPushByPointer(idleWait, &idle);
+
+    return 0;
+}
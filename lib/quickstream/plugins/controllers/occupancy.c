@@ -0,0 +1,398 @@
+// quickstream controller module that samples how full the buffers
+// between filters are, and finds the filter that is the bottleneck, in
+// all running streams.
+//
+// This module should be able to work with more than one stream running.
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+
+#include "../../../../include/quickstream/app.h"
+#include "../../../../include/quickstream/filter.h"
+#include "../../../../include/quickstream/controller.h"
+#include "../../../../include/quickstream/parameter.h"
+#include "../../../debug.h"
+
+
+
+#define DEFAULT_PERIOD  ((uint32_t) 1000) // micro-seconds
+
+
+static uint32_t period = DEFAULT_PERIOD;
+
+
+
+void help(FILE *f) {
+    fprintf(f,
+"   Usage: occupancy\n"
+"\n"
+"   A controller module that samples how full the buffers are between\n"
+"   the filters, in all running streams.  A thread for each stream reads\n"
+"   the fill level of every connection periodically, without stopping the\n"
+"   stream.  When the stream stops a report is printed to stderr with the\n"
+"   mean fill level and the fraction of the time each connection was full\n"
+"   and empty, and the filter that is most likely the bottleneck: the one\n"
+"   with full inputs and empty outputs.\n"
+"\n"
+"   When the stream stops this pushes, for each filter, the parameters\n"
+"   \"fillIn#\", \"fullIn#\" and \"emptyIn#\", which are the mean fill\n"
+"   fraction and the fractions of the time that input port # was full\n"
+"   and empty, and \"bottleneck\", which is the fraction of the time its\n"
+"   inputs were full times the fraction of the time its outputs were\n"
+"   empty.  Source filters count as always having full inputs and sinks\n"
+"   count as always having empty outputs.  They are all of type QsDouble.\n"
+"\n"
+"\n                OPTIONS\n"
+"\n"
+"  --period USEC       sample every USEC micro-seconds.  The default USEC\n"
+"                      is %" PRIu32 ".\n"
+"\n"
+"\n"
+"  --printNoSummary    do not print the report to stderr.\n"
+"                      By default it is printed to stderr\n"
+"\n"
+"\n",
+    DEFAULT_PERIOD);
+}
+
+
+// A connection from a filter output to a filter input.
+struct Edge {
+
+    struct QsFilter *from, *to;
+    uint32_t outputPortNum, readerIndex, inputPortNum;
+
+    // Only the sampler thread changes these while it runs.
+    uint64_t full, empty;
+    double fill;
+};
+
+
+struct FilterOccupancy {
+
+    struct QsFilter *filter;
+    uint32_t numInputs, numOutputs;
+
+    // For input ports 0, 1, 2, .. numInputs-1 the fill, full and empty
+    // parameters, and then the bottleneck parameter.
+    struct QsParameter **parameters;
+};
+
+
+struct Sampler {
+
+    struct QsStream *stream;
+
+    struct FilterOccupancy *filters;
+    uint32_t numFilters;
+
+    struct Edge *edges;
+    uint32_t numEdges;
+
+    uint64_t numSamples;
+
+    pthread_t thread;
+    atomic_bool running;
+
+    struct Sampler *next;
+};
+
+
+// Related to option --printNoSummary
+//
+static bool printSummary = true;
+
+// A sampler for each stream that is running.  This list is only accessed
+// by the main thread.
+static struct Sampler *samplers = 0;
+
+
+
+static struct Sampler *
+FindSampler(struct QsStream *s) {
+
+    struct Sampler *sp = samplers;
+    while(sp && sp->stream != s)
+        sp = sp->next;
+    return sp;
+}
+
+
+static void *
+Sample(struct Sampler *sp) {
+
+    struct timespec t = {
+        .tv_sec = period/1000000,
+        .tv_nsec = (period%1000000)*1000
+    };
+
+    while(atomic_load(&sp->running)) {
+
+        for(uint32_t i=0; i<sp->numEdges; ++i) {
+            struct Edge *e = sp->edges + i;
+            size_t length, maxLength;
+            if(qsFilterOutputOccupancy(e->from, e->outputPortNum,
+                        e->readerIndex, 0, 0, &length, &maxLength))
+                continue;
+            if(length >= maxLength)
+                ++e->full;
+            else if(length == 0)
+                ++e->empty;
+            e->fill += ((double) length)/maxLength;
+        }
+        ++sp->numSamples;
+
+        nanosleep(&t, 0);
+    }
+
+    return 0;
+}
+
+
+int construct(int argc, const char **argv) {
+
+    printSummary = !qsOptsGetBool(argc, argv, "printNoSummary");
+    period = qsOptsGetUint32(argc, argv, "period", DEFAULT_PERIOD);
+    if(period == 0) period = 1;
+
+    return 0; // success
+}
+
+
+int preStart(struct QsStream *s, struct QsFilter *f,
+        uint32_t numInputs, uint32_t numOutputs) {
+
+    struct Sampler *sp = FindSampler(s);
+    if(!sp) {
+        sp = calloc(1, sizeof(*sp));
+        ASSERT(sp, "calloc(1,%zu) failed", sizeof(*sp));
+        sp->stream = s;
+        sp->next = samplers;
+        samplers = sp;
+    }
+
+    sp->filters = realloc(sp->filters,
+            (sp->numFilters + 1)*sizeof(*sp->filters));
+    ASSERT(sp->filters, "realloc(,%zu) failed",
+            (sp->numFilters + 1)*sizeof(*sp->filters));
+    struct FilterOccupancy *fo = sp->filters + sp->numFilters++;
+    fo->filter = f;
+    fo->numInputs = numInputs;
+    fo->numOutputs = numOutputs;
+
+    fo->parameters = calloc(3*numInputs + 1, sizeof(*fo->parameters));
+    ASSERT(fo->parameters, "calloc(%" PRIu32 ",%zu) failed",
+            3*numInputs + 1, sizeof(*fo->parameters));
+
+    for(uint32_t i=0; i<numInputs; ++i) {
+        const char *names[3] = { "fillIn", "fullIn", "emptyIn" };
+        for(uint32_t k=0; k<3; ++k) {
+            char pName[24];
+            snprintf(pName, 24, "%s%" PRIu32, names[k], i);
+            fo->parameters[3*i + k] = qsParameterCreateForFilter(f,
+                    pName, QsDouble, 0, 0, 0);
+        }
+    }
+    fo->parameters[3*numInputs] = qsParameterCreateForFilter(f,
+            "bottleneck", QsDouble, 0, 0, 0);
+
+    return 0;
+}
+
+
+int postStart(struct QsStream *s, struct QsFilter *f,
+        uint32_t numInputs, uint32_t numOutputs) {
+
+    struct Sampler *sp = FindSampler(s);
+    DASSERT(sp);
+    if(atomic_load(&sp->running))
+        // We started with the first filter.
+        return 0;
+
+    // All the preStart() calls are done, so we have all the filters.
+    // The buffers are set up now, so we can find all the connections.
+    for(uint32_t i=0; i<sp->numFilters; ++i) {
+        struct FilterOccupancy *fo = sp->filters + i;
+        for(uint32_t port=0; port<fo->numOutputs; ++port) {
+            struct Edge e;
+            memset(&e, 0, sizeof(e));
+            e.from = fo->filter;
+            e.outputPortNum = port;
+            for(e.readerIndex = 0;
+                    qsFilterOutputOccupancy(fo->filter, port,
+                        e.readerIndex, &e.to, &e.inputPortNum,
+                        0, 0) == 0;
+                    ++e.readerIndex) {
+                sp->edges = realloc(sp->edges,
+                        (sp->numEdges + 1)*sizeof(*sp->edges));
+                ASSERT(sp->edges, "realloc(,%zu) failed",
+                        (sp->numEdges + 1)*sizeof(*sp->edges));
+                sp->edges[sp->numEdges++] = e;
+            }
+        }
+    }
+
+    atomic_store(&sp->running, true);
+    ASSERT(pthread_create(&sp->thread, 0,
+                (void *(*)(void *)) Sample, sp) == 0);
+
+    return 0;
+}
+
+
+// Returns the fraction of the time that the filter inputs are full times
+// the fraction of the time that the filter outputs are empty.
+static double
+GetBottleneck(struct Sampler *sp, struct FilterOccupancy *fo) {
+
+    double full = 0, empty = 0;
+    uint32_t numIn = 0, numOut = 0;
+
+    for(uint32_t i=0; i<sp->numEdges; ++i) {
+        struct Edge *e = sp->edges + i;
+        if(e->to == fo->filter) {
+            full += e->full;
+            ++numIn;
+        }
+        if(e->from == fo->filter) {
+            empty += e->empty;
+            ++numOut;
+        }
+    }
+
+    full = numIn?(full/(numIn*sp->numSamples)):1.0;
+    empty = numOut?(empty/(numOut*sp->numSamples)):1.0;
+
+    return full*empty;
+}
+
+
+static void
+PrintReport(struct Sampler *sp, const double *bottlenecks, FILE *file) {
+
+    fprintf(file,
+        "  |------------------------------------------------------------------|\n"
+        "  |    Stream %" PRIu32 " buffer occupancy from %" PRIu64
+        " samples\n"
+        "  |------------------------------------------------------------------|\n"
+        "    %-44s %6s %6s %6s\n",
+        qsFilterStreamId(sp->filters[0].filter), sp->numSamples,
+        "connection", "fill", "full", "empty");
+
+    for(uint32_t i=0; i<sp->numEdges; ++i) {
+        struct Edge *e = sp->edges + i;
+        char name[128];
+        snprintf(name, 128, "%s:%" PRIu32 " -> %s:%" PRIu32,
+                qsFilterName(e->from), e->outputPortNum,
+                qsFilterName(e->to), e->inputPortNum);
+        fprintf(file, "    %-44s %5.1f%% %5.1f%% %5.1f%%\n", name,
+                100.0*e->fill/sp->numSamples,
+                100.0*e->full/sp->numSamples,
+                100.0*e->empty/sp->numSamples);
+    }
+
+    uint32_t worst = 0;
+    for(uint32_t i=1; i<sp->numFilters; ++i)
+        if(bottlenecks[i] > bottlenecks[worst])
+            worst = i;
+
+    fprintf(file, "    bottleneck: \"%s\" %3.3lg\n",
+            qsFilterName(sp->filters[worst].filter), bottlenecks[worst]);
+}
+
+
+int preStop(struct QsStream *s, struct QsFilter *f,
+        uint32_t numInputs, uint32_t numOutputs) {
+
+    struct Sampler *sp = FindSampler(s);
+    if(!sp || !atomic_load(&sp->running))
+        // We did the report with the first filter.
+        return 0;
+
+    atomic_store(&sp->running, false);
+    ASSERT(pthread_join(sp->thread, 0) == 0);
+
+    if(!sp->numSamples) return 0;
+
+    double *bottlenecks = calloc(sp->numFilters, sizeof(*bottlenecks));
+    ASSERT(bottlenecks, "calloc(%" PRIu32 ",%zu) failed",
+            sp->numFilters, sizeof(*bottlenecks));
+
+    for(uint32_t i=0; i<sp->numFilters; ++i) {
+
+        struct FilterOccupancy *fo = sp->filters + i;
+        bottlenecks[i] = GetBottleneck(sp, fo);
+
+        for(uint32_t k=0; k<sp->numEdges; ++k) {
+            struct Edge *e = sp->edges + k;
+            if(e->to != fo->filter) continue;
+            double values[3] = {
+                e->fill/sp->numSamples,
+                ((double) e->full)/sp->numSamples,
+                ((double) e->empty)/sp->numSamples
+            };
+            for(uint32_t j=0; j<3; ++j)
+                qsParameterPushByPointer(
+                        fo->parameters[3*e->inputPortNum + j],
+                        values + j);
+        }
+        qsParameterPushByPointer(fo->parameters[3*fo->numInputs],
+                bottlenecks + i);
+    }
+
+    if(printSummary)
+        PrintReport(sp, bottlenecks, stderr);
+
+    free(bottlenecks);
+
+    return 0;
+}
+
+
+int postStop(struct QsStream *s, struct QsFilter *f,
+        uint32_t numInputs, uint32_t numOutputs) {
+
+    // Because quickstream can re-configure filter connections between
+    // stream runs, we must destroy all the parameters that we created
+    // and recreate them (possibly differently) again in the next run
+    // preStart().
+    qsParameterDestroyForFilter(f,
+            "^((fill|full|empty)In[0-9]+|bottleneck)$", QS_PNAME_REGEX);
+
+    struct Sampler *prev = 0;
+    struct Sampler *sp = samplers;
+    while(sp && sp->stream != s) {
+        prev = sp;
+        sp = sp->next;
+    }
+    if(!sp) return 0;
+
+    // Free the sampler with the last filter.
+    for(uint32_t i=0; i<sp->numFilters; ++i)
+        if(sp->filters[i].filter == f && i != sp->numFilters - 1)
+            return 0;
+
+    DASSERT(!atomic_load(&sp->running));
+
+    if(prev)
+        prev->next = sp->next;
+    else
+        samplers = sp->next;
+
+    for(uint32_t i=0; i<sp->numFilters; ++i)
+        free(sp->filters[i].parameters);
+    free(sp->filters);
+    free(sp->edges);
+#ifdef DEBUG
+    memset(sp, 0, sizeof(*sp));
+#endif
+    free(sp);
+
+    return 0;
+}
@@ -0,0 +1,457 @@
+// quickstream controller module that counts CPU performance events, like
+// cycles, instructions and cache misses, for every filter input() call,
+// in all running streams.
+//
+// This module should be able to work with more than one stream running.
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+
+#include "../../../../include/quickstream/app.h"
+#include "../../../../include/quickstream/filter.h"
+#include "../../../../include/quickstream/controller.h"
+#include "../../../../include/quickstream/parameter.h"
+#include "../../../debug.h"
+
+
+
+void help(FILE *f) {
+    fprintf(f,
+"   Usage: perfCounters\n"
+"\n"
+"   A controller module that counts CPU performance events for every\n"
+"   filter input() call, for all filters in all running streams, using\n"
+"   the Linux perf_event_open(2) system call.  Each worker thread opens\n"
+"   its own counters, which are read just before and just after each\n"
+"   input() call, and the difference is added to that filter.  A table\n"
+"   is printed to stderr when each stream stops.\n"
+"\n"
+"   The hardware events are cycles, instructions, cache misses and branch\n"
+"   misses, from which the instructions per cycle (IPC) and cache misses\n"
+"   per byte are printed.  If the hardware counters are not available, as\n"
+"   is common in virtual machines, the software events task clock, page\n"
+"   faults and context switches are counted in place of them.  The bytes\n"
+"   are the bytes read by input(), or written if the filter is a source.\n"
+"   The counts may include the input callbacks of other controllers, but\n"
+"   not the stream mutex lock after input() returns.  Reading the\n"
+"   counters costs two system calls for each input() call.\n"
+"\n"
+"\n                OPTIONS\n"
+"\n"
+"  --software          use the software events even if the hardware\n"
+"                      events are available.\n"
+"\n"
+"\n");
+}
+
+
+#define MAX_EVENTS  (4)
+
+
+struct Event {
+    const char *name;
+    uint32_t type;
+    uint64_t config;
+};
+
+
+static const struct Event hardwareEvents[] = {
+    // The first is the group leader.
+    { "cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { "instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { "cache-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+    { "branch-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+    { 0, 0, 0 }
+};
+
+static const struct Event softwareEvents[] = {
+    { "task-clock(ns)", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK },
+    { "page-faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS },
+    { "ctx-switches", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES },
+    { 0, 0, 0 }
+};
+
+
+// The events that we found we can open in construct().
+static const struct Event *events[MAX_EVENTS];
+static uint32_t numEvents = 0;
+static bool isHardware = false;
+
+
+// Counters for a thread.
+struct ThreadCounters {
+
+    int fds[MAX_EVENTS];
+
+    // The counts just before the current input() call.
+    uint64_t start[MAX_EVENTS];
+
+    // Set if the counters could not be opened for this thread.
+    bool failed;
+};
+
+
+// The counts for a filter.  Threads add to it without a lock.
+struct FilterCounters {
+
+    struct QsFilter *filter;
+
+    atomic_uint_fast64_t calls, bytes;
+    atomic_uint_fast64_t counts[MAX_EVENTS];
+
+    struct FilterCounters *next;
+};
+
+
+// All filters that we are counting in all streams.  This list is only
+// accessed by the main thread.
+static struct FilterCounters *filters = 0;
+
+// Marker to keep us from printing the stream header more than once.
+static uint32_t printingStreamId = -1;
+
+// Each thread keeps its' struct ThreadCounters with this key, and the
+// counters are closed when the thread exits.
+static pthread_key_t threadKey;
+
+
+
+static int
+OpenEvent(const struct Event *e, int groupFd) {
+
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = e->type;
+    attr.config = e->config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    if(groupFd == -1)
+        attr.read_format = PERF_FORMAT_GROUP;
+
+    // This thread, any CPU.
+    return syscall(SYS_perf_event_open, &attr, 0, -1, groupFd, 0);
+}
+
+
+static void
+CloseCounters(struct ThreadCounters *tc) {
+
+    for(uint32_t i=0; i<numEvents; ++i)
+        if(tc->fds[i] >= 0)
+            close(tc->fds[i]);
+#ifdef DEBUG
+    memset(tc, 0, sizeof(*tc));
+#endif
+    free(tc);
+}
+
+
+// Open the event group for this thread.  Returns true on success.
+static bool
+OpenCounters(struct ThreadCounters *tc) {
+
+    for(uint32_t i=0; i<MAX_EVENTS; ++i)
+        tc->fds[i] = -1;
+
+    for(uint32_t i=0; i<numEvents; ++i) {
+        tc->fds[i] = OpenEvent(events[i], i?tc->fds[0]:-1);
+        if(tc->fds[i] < 0) {
+            WARN("perf_event_open(\"%s\") failed", events[i]->name);
+            return false;
+        }
+    }
+    return true;
+}
+
+
+// Find the events that this process can count with the given list, and
+// put them in events[].  The first event, the group leader, must work.
+static bool
+ProbeEvents(const struct Event *list) {
+
+    numEvents = 0;
+
+    int leader = OpenEvent(list, -1);
+    if(leader < 0) return false;
+    events[numEvents++] = list;
+
+    for(++list; list->name && numEvents < MAX_EVENTS; ++list) {
+        int fd = OpenEvent(list, leader);
+        if(fd < 0) {
+            NOTICE("perf event \"%s\" is not available", list->name);
+            continue;
+        }
+        events[numEvents++] = list;
+        close(fd);
+    }
+
+    close(leader);
+    return true;
+}
+
+
+static inline bool
+ReadCounters(struct ThreadCounters *tc, uint64_t *values) {
+
+    // PERF_FORMAT_GROUP: the number of events and then the values.
+    uint64_t buf[1 + MAX_EVENTS];
+    size_t len = (1 + numEvents)*sizeof(uint64_t);
+
+    if(read(tc->fds[0], buf, len) != len)
+        return false;
+
+    memcpy(values, buf + 1, numEvents*sizeof(uint64_t));
+    return true;
+}
+
+
+static inline struct ThreadCounters *
+GetThreadCounters(void) {
+
+    struct ThreadCounters *tc = pthread_getspecific(threadKey);
+    if(tc) return tc;
+
+    tc = calloc(1, sizeof(*tc));
+    ASSERT(tc, "calloc(1,%zu) failed", sizeof(*tc));
+    tc->failed = !OpenCounters(tc);
+    ASSERT(pthread_setspecific(threadKey, tc) == 0);
+    return tc;
+}
+
+
+int construct(int argc, const char **argv) {
+
+    bool software = qsOptsGetBool(argc, argv, "software");
+
+    if(!software && ProbeEvents(hardwareEvents))
+        isHardware = true;
+    else if(!ProbeEvents(softwareEvents)) {
+        ERROR("perf_event_open(2) failed: %s", strerror(errno));
+        return -1; // fail
+    }
+
+    if(!isHardware && !software)
+        INFO("Hardware performance counters are not available;"
+                " using software events");
+
+    ASSERT(pthread_key_create(&threadKey,
+                (void (*)(void *)) CloseCounters) == 0);
+
+    return 0; // success
+}
+
+
+int destroy(void) {
+
+    // The main thread may have run the flow, if there were no worker
+    // threads.
+    struct ThreadCounters *tc = pthread_getspecific(threadKey);
+    if(tc) {
+        ASSERT(pthread_setspecific(threadKey, 0) == 0);
+        CloseCounters(tc);
+    }
+
+    ASSERT(pthread_key_delete(threadKey) == 0);
+
+    return 0;
+}
+
+
+// This is called just before the filter input() by the thread that
+// calls it.
+static int
+PreInputCB(struct QsFilter *f, const size_t lenIn[],
+        const bool isFlushing[],
+        uint32_t numInputs, uint32_t numOutputs,
+        struct FilterCounters *fc) {
+
+    struct ThreadCounters *tc = GetThreadCounters();
+    if(!tc->failed && !ReadCounters(tc, tc->start))
+        tc->failed = true;
+    return 0;
+}
+
+
+// This is called just after the filter input() by the same thread.
+static int
+PostInputCB(struct QsFilter *f, const size_t lenIn[],
+        const size_t lenOut[], const bool isFlushing[],
+        uint32_t numInputs, uint32_t numOutputs,
+        struct FilterCounters *fc) {
+
+    struct ThreadCounters *tc = GetThreadCounters();
+    uint64_t values[MAX_EVENTS];
+    if(tc->failed || !ReadCounters(tc, values))
+        return 0;
+
+    for(uint32_t i=0; i<numEvents; ++i)
+        atomic_fetch_add_explicit(fc->counts + i,
+                values[i] - tc->start[i], memory_order_relaxed);
+
+    size_t bytes = 0;
+    if(numInputs)
+        for(uint32_t i=0; i<numInputs; ++i)
+            bytes += lenIn[i];
+    else
+        for(uint32_t i=0; i<numOutputs; ++i)
+            bytes += lenOut[i];
+
+    atomic_fetch_add_explicit(&fc->bytes, bytes, memory_order_relaxed);
+    atomic_fetch_add_explicit(&fc->calls, 1, memory_order_relaxed);
+
+    return 0;
+}
+
+
+int preStart(struct QsStream *s, struct QsFilter *f,
+        uint32_t numInputs, uint32_t numOutputs) {
+
+    printingStreamId = -1;
+
+    DSPEW("filter=\"%s\"", qsFilterName(f));
+
+    struct FilterCounters *fc = calloc(1, sizeof(*fc));
+    ASSERT(fc, "calloc(1,%zu) failed", sizeof(*fc));
+    fc->filter = f;
+    fc->next = filters;
+    filters = fc;
+
+    qsAddPreFilterInput(f,
+            (int (*)(struct QsFilter *filter, const size_t lenIn[],
+                const bool isFlushing[],
+                uint32_t numInputs, uint32_t numOutputs,
+                void *userData)) PreInputCB, fc);
+    qsAddPostFilterInput(f,
+            (int (*)(struct QsFilter *filter, const size_t lenIn[],
+                const size_t lenOut[], const bool isFlushing[],
+                uint32_t numInputs, uint32_t numOutputs,
+                void *userData)) PostInputCB, fc);
+
+    return 0; // keep calling for all filters.
+}
+
+
+static void
+PrintStreamHeader(uint32_t streamId, FILE *file) {
+
+    fprintf(file,
+        "  |------------------------------------------------------------------|\n"
+        "  |    Stream %" PRIu32 " %s performance counters\n"
+        "  |------------------------------------------------------------------|\n"
+        "    %-24s %8s %12s",
+        streamId, isHardware?"hardware":"software",
+        "filter", "calls", "bytes");
+
+    for(uint32_t i=0; i<numEvents; ++i)
+        fprintf(file, " %14s", events[i]->name);
+
+    if(isHardware)
+        fprintf(file, " %6s %12s", "IPC", "misses/byte");
+    else
+        fprintf(file, " %12s", "ns/byte");
+    putc('\n', file);
+}
+
+
+static inline int
+FindEvent(const char *name) {
+
+    for(uint32_t i=0; i<numEvents; ++i)
+        if(strcmp(events[i]->name, name) == 0)
+            return i;
+    return -1;
+}
+
+
+static void
+PrintFilter(struct FilterCounters *fc, FILE *file) {
+
+    uint64_t counts[MAX_EVENTS];
+    for(uint32_t i=0; i<numEvents; ++i)
+        counts[i] = atomic_load(fc->counts + i);
+    uint64_t bytes = atomic_load(&fc->bytes);
+
+    fprintf(file, "    %-24s %8" PRIu64 " %12" PRIu64,
+            qsFilterName(fc->filter), (uint64_t) atomic_load(&fc->calls),
+            bytes);
+
+    for(uint32_t i=0; i<numEvents; ++i)
+        fprintf(file, " %14" PRIu64, counts[i]);
+
+    // The per byte event is cache misses, or the task clock.
+    int cycles = FindEvent("cycles");
+    int instructions = FindEvent("instructions");
+    int perByte = FindEvent(isHardware?"cache-misses":"task-clock(ns)");
+
+    if(isHardware) {
+        if(instructions >= 0 && counts[cycles])
+            fprintf(file, " %6.3lg",
+                    ((double) counts[instructions])/counts[cycles]);
+        else
+            fprintf(file, " %6s", "-");
+    }
+
+    if(perByte >= 0 && bytes)
+        fprintf(file, " %12.3lg", ((double) counts[perByte])/bytes);
+    else
+        fprintf(file, " %12s", "-");
+
+    putc('\n', file);
+}
+
+
+int preStop(struct QsStream *s, struct QsFilter *f,
+        uint32_t numInputs, uint32_t numOutputs) {
+
+    struct FilterCounters *fc = filters;
+    while(fc && fc->filter != f)
+        fc = fc->next;
+    if(!fc) return 0;
+
+    if(printingStreamId != qsFilterStreamId(f)) {
+        printingStreamId = qsFilterStreamId(f);
+        PrintStreamHeader(printingStreamId, stderr);
+    }
+
+    PrintFilter(fc, stderr);
+
+    return 0;
+}
+
+
+int postStop(struct QsStream *s, struct QsFilter *f,
+        uint32_t numInputs, uint32_t numOutputs) {
+
+    qsAddPreFilterInput(f, 0, 0);
+    qsAddPostFilterInput(f, 0, 0);
+
+    struct FilterCounters *prev = 0;
+    struct FilterCounters *fc = filters;
+    while(fc && fc->filter != f) {
+        prev = fc;
+        fc = fc->next;
+    }
+    if(!fc) return 0;
+
+    if(prev)
+        prev->next = fc->next;
+    else
+        filters = fc->next;
+
+#ifdef DEBUG
+    memset(fc, 0, sizeof(*fc));
+#endif
+    free(fc);
+
+    return 0;
+}
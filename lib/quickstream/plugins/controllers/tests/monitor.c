@@ -15,10 +15,26 @@ void help(FILE *f) {
 "\n"
 " A test controller module that reads and prints parameters.\n"
 "\n"
+"\n                OPTIONS\n"
+"\n"
+"  --async             get the parameters with the QS_ASYNC flag.\n"
+"\n"
 "\n");
 }
 
 
+static uint32_t asyncFlag = 0;
+
+
+int construct(int argc, const char **argv) {
+
+    if(qsOptsGetBool(argc, argv, "async"))
+        asyncFlag = QS_ASYNC;
+
+    return 0; // success
+}
+
+
 int getCallback(
             const void *value,
             void *streamOrApp,
@@ -45,7 +61,8 @@ int postStart(struct QsStream *s, struct QsFilter *f,
                 "^.*$"/*parameter name egex*/,
                 Any/*any type*/,
                 getCallback, 0, 
-                QS_PNAME_REGEX | QS_KEEP_AT_RESTART | QS_KEEP_ONE
+                QS_PNAME_REGEX | QS_KEEP_AT_RESTART | QS_KEEP_ONE |
+                asyncFlag
                 ) >= 0);
 
     return 0;
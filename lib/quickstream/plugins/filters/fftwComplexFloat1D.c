@@ -139,6 +139,12 @@ int start(uint32_t numInPorts, uint32_t numOutPorts) {
 
     maxWrite = bufMult * batchSize;
 
+    // The input and output are complex floats, so we will only get
+    // whole complex floats.  We do not ask for more alignment than that
+    // since batchSize may not be a multiple of it.
+    qsSetInputType(0, "float complex", sizeof(float complex), 0);
+    qsSetOutputType(0, "float complex", sizeof(float complex), 0);
+
     // We need at least bins * sizeof(float complex) of input to be able
     // to act on the input.
     //qsSetInputThreshold(0, batchSize);
@@ -0,0 +1,346 @@
+// For O_DIRECT
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "../../../../include/quickstream/filter.h"
+#include "../../../../lib/debug.h"
+#include "uring.h"
+
+
+#define DEFAULT_MAXREAD     ((size_t) (256*1024))
+#define DEFAULT_QUEUEDEPTH  4
+// The O_DIRECT block size.  We use the page size which is larger than or
+// equal to any logical block size that we know of.
+#define BLOCKSIZE           ((size_t) 4096)
+
+
+void help(FILE *f) {
+
+    fprintf(f,
+
+"  Usage: fileSink --file PATH { --maxRead LEN --queueDepth N --direct }\n"
+"\n"
+"This filter is a sink.\n"
+"This filter must have 1 input and 0 outputs.\n"
+"This filter will write its input to the file PATH.  The input ring\n"
+"buffer memory is written directly using io_uring, with up to N writes\n"
+"in flight.  input() submits the writes and returns without waiting,\n"
+"and a later input() call advances the input when all the writes have\n"
+"completed, so the worker thread is not blocked by the writes, unless\n"
+"the input has filled up to LEN bytes and we must advance some of it.\n"
+"Writes that are still in flight when the stream stops are waited for\n"
+"in stop().  If io_uring is not available pwrite(2) is used, which\n"
+"blocks.\n"
+"\n"
+"\n"
+"                 OPTIONS\n"
+"\n"
+"\n"
+"  --file PATH     The file to write.  The file is created or truncated.\n"
+"                  This option is required.\n"
+"\n"
+"  --maxRead LEN   Set the input read promise to LEN bytes.  This is how\n"
+"                  much input can be buffered before this filter must\n"
+"                  write it.  The default value for LEN is %zu.\n"
+"\n"
+"  --queueDepth N  Split each write into N writes that are all in flight\n"
+"                  at once.  The default is %d.\n"
+"\n"
+"  --direct        Write the file with O_DIRECT, bypassing the page cache.\n"
+"                  Only whole %zu byte blocks are written with O_DIRECT,\n"
+"                  the last partial block is written in stop().\n"
+"\n"
+"\n",
+DEFAULT_MAXREAD, DEFAULT_QUEUEDEPTH, BLOCKSIZE
+        );
+}
+
+
+static size_t maxRead;
+static uint32_t queueDepth;
+static bool direct;
+// fd may be opened with O_DIRECT, tailFd is not.
+static int fd = -1, tailFd = -1;
+static off_t offset;
+static struct Uring uring;
+static int32_t *res;
+
+// The input that we have not advanced yet, from the last input() call.
+// This is written in stop() if it is still not written then; like with
+// O_DIRECT the last input that is less than a block.
+static uint8_t *tail;
+static size_t tailLen;
+
+// The io_uring writes that input() submitted, that we have not advanced
+// the input for yet.  They start at tail.
+static struct {
+    size_t len; // the total length of the writes
+    uint32_t n; // number of writes, 0 if there are none
+    uint32_t numDone; // number of writes that have completed
+    size_t chunk; // length of each write but the last
+} pending;
+
+
+int construct(int argc, const char **argv) {
+
+    const char *path = qsOptsGetString(argc, argv, "file", 0);
+    if(!path) {
+        ERROR("filter \"%s\" needs a --file PATH option",
+                qsGetFilterName());
+        return -1; // fail
+    }
+
+    maxRead = qsOptsGetSizeT(argc, argv, "maxRead", DEFAULT_MAXREAD);
+    queueDepth = qsOptsGetUint32(argc, argv, "queueDepth",
+            DEFAULT_QUEUEDEPTH);
+    direct = qsOptsGetBool(argc, argv, "direct");
+
+    if(queueDepth == 0) queueDepth = 1;
+    if(direct && maxRead % BLOCKSIZE)
+        maxRead += BLOCKSIZE - maxRead % BLOCKSIZE;
+
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | (direct?O_DIRECT:0),
+            0644);
+    if(fd < 0) {
+        ERROR("open(\"%s\",) failed", path);
+        return -1; // fail
+    }
+
+    if(direct) {
+        tailFd = open(path, O_WRONLY);
+        if(tailFd < 0) {
+            ERROR("open(\"%s\",) failed", path);
+            return -1; // fail
+        }
+    }
+
+    if(UringInit(&uring, queueDepth))
+        NOTICE("io_uring is not available, using pwrite()");
+
+    res = calloc(queueDepth, sizeof(*res));
+    ASSERT(res, "calloc(%" PRIu32 ",%zu) failed",
+            queueDepth, sizeof(*res));
+
+    return 0; // success
+}
+
+
+int start(uint32_t numInPorts, uint32_t numOutPorts) {
+
+    ASSERT(numInPorts == 1);
+    ASSERT(numOutPorts == 0);
+
+    qsSetInputReadPromise(0, maxRead);
+
+    // Start at the beginning of the file for each run.
+    if(offset)
+        ASSERT(ftruncate(fd, 0) == 0);
+    offset = 0;
+    tail = 0;
+    tailLen = 0;
+    pending.n = 0;
+
+    return 0; // success
+}
+
+
+// Returns the number of bytes that were written, that are contiguous
+// from the start of the buffer, or -1 on error.  The rest will be
+// written again.
+static ssize_t
+Written(size_t len, size_t chunk, uint32_t n) {
+
+    size_t total = 0;
+    for(uint32_t i=0; i<n; ++i) {
+        size_t l = (i == n - 1)?(len - i*chunk):chunk;
+        if(res[i] < 0) {
+            ERROR("writing file failed: %s", strerror(-res[i]));
+            return -1; // fail
+        }
+        total += res[i];
+        if(res[i] != l) break;
+    }
+
+    if(direct && total % BLOCKSIZE) {
+        ERROR("short O_DIRECT write");
+        return -1; // fail
+    }
+
+    return total;
+}
+
+
+// Gets the results of the pending writes, and advances the input for
+// what was written.  If wait is set this waits for the writes to
+// complete, else if they are not all complete this returns 0.
+//
+// Returns the number of bytes advanced, or -1 on error.
+static ssize_t
+Finish(bool wait) {
+
+    DASSERT(pending.n);
+
+    if(wait) {
+        int ret = UringWait(&uring, res);
+        if(ret) {
+            ERROR("io_uring_enter() failed: %s", strerror(-ret));
+            pending.n = 0;
+            return -1; // fail
+        }
+        pending.numDone = pending.n;
+    } else {
+        pending.numDone += UringReap(&uring, res);
+        if(pending.numDone < pending.n)
+            return 0;
+    }
+
+    ssize_t total = Written(pending.len, pending.chunk, pending.n);
+    pending.n = 0;
+    if(total < 0)
+        return -1; // fail
+
+    offset += total;
+    tail += total;
+    tailLen -= total;
+    return total;
+}
+
+
+int input(void *buffers[], const size_t lens[],
+        const bool isFlushing[],
+        uint32_t numInPorts, uint32_t numOutPorts) {
+
+    // The input memory that the pending writes were submitted from may
+    // be at a different address now, because the ring buffer is mapped
+    // twice and the read pointer wraps; it is the same memory.
+    tail = buffers[0];
+    tailLen = lens[0];
+
+    size_t advanced = 0;
+
+    if(pending.n) {
+
+        // If the input is filled to the read promise, we must advance
+        // some input, so we wait for the writes.  This is the only time
+        // that input() blocks.
+        ssize_t total = Finish(lens[0] >= maxRead);
+        if(total < 0)
+            return -1; // fail
+        advanced = total;
+
+        if(pending.n || total != pending.len) {
+            // The writes are not done, or a short write.  We write the
+            // rest in the next call.
+            qsAdvanceInput(0, advanced);
+            return 0; // success
+        }
+    }
+
+    uint8_t *buffer = tail;
+    size_t len = tailLen;
+
+    if(direct)
+        // We only write whole blocks with O_DIRECT.  We always advance
+        // whole blocks, and the ring buffer memory is page aligned, so
+        // the buffer stays aligned.
+        len -= len % BLOCKSIZE;
+
+    if(len == 0) {
+        // A flush or wake up call with nothing that we can write now.
+        qsAdvanceInput(0, advanced);
+        return 0; // Wait for more data.
+    }
+
+    uint32_t n = queueDepth;
+    size_t chunk = (len + n - 1)/n;
+    if(direct && chunk % BLOCKSIZE)
+        chunk += BLOCKSIZE - chunk % BLOCKSIZE;
+    n = (len + chunk - 1)/chunk;
+
+    if(uring.fd >= 0) {
+        // Submit the writes and do not wait for them.
+        for(uint32_t i=0; i<n; ++i)
+            UringQueue(&uring, IORING_OP_WRITE, fd, buffer + i*chunk,
+                    (i == n - 1)?(len - i*chunk):chunk,
+                    offset + i*chunk, i);
+        int ret = UringSubmit(&uring);
+        if(ret) {
+            ERROR("io_uring_enter() failed: %s", strerror(-ret));
+            return -1; // fail
+        }
+        pending.len = len;
+        pending.n = n;
+        pending.chunk = chunk;
+        pending.numDone = 0;
+
+        if(!advanced && lens[0] >= maxRead) {
+            // We must advance some input in this call.
+            ssize_t total = Finish(true);
+            if(total < 0)
+                return -1; // fail
+            advanced = total;
+        }
+
+        qsAdvanceInput(0, advanced);
+        return 0; // success
+    }
+
+    for(uint32_t i=0; i<n; ++i) {
+        size_t l = (i == n - 1)?(len - i*chunk):chunk;
+        ssize_t wr = pwrite(fd, buffer + i*chunk, l, offset + i*chunk);
+        res[i] = (wr < 0)?(-errno):wr;
+        if(wr != l) break;
+    }
+
+    ssize_t total = Written(len, chunk, n);
+    if(total < 0)
+        return -1; // fail
+
+    offset += total;
+    tail += total;
+    tailLen -= total;
+    qsAdvanceInput(0, advanced + total);
+
+    return 0; // success
+}
+
+
+int stop(uint32_t numInPorts, uint32_t numOutPorts) {
+
+    if(pending.n && Finish(true) < 0)
+        // Wait for the writes that are still in flight.
+        return -1; // fail
+
+    if(tailLen) {
+        // The ring buffer memory is still mapped, and this is the part
+        // of the input that we did not write, like the last partial
+        // block with O_DIRECT.
+        if(pwrite(direct?tailFd:fd, tail, tailLen, offset) != tailLen) {
+            ERROR("pwrite() failed");
+            return -1;
+        }
+        offset += tailLen;
+        tailLen = 0;
+    }
+
+    return 0; // success
+}
+
+
+int destroy(void) {
+
+    UringCleanup(&uring);
+    if(fd >= 0)
+        close(fd);
+    if(tailFd >= 0)
+        close(tailFd);
+    fd = tailFd = -1;
+    free(res);
+    res = 0;
+
+    return 0; // success
+}
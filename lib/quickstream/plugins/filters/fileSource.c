@@ -0,0 +1,242 @@
+// For O_DIRECT
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "../../../../include/quickstream/filter.h"
+#include "../../../../lib/debug.h"
+#include "uring.h"
+
+
+#define DEFAULT_MAXWRITE    ((size_t) (256*1024))
+#define DEFAULT_QUEUEDEPTH  4
+// The O_DIRECT block size.  We use the page size which is larger than or
+// equal to any logical block size that we know of.
+#define BLOCKSIZE           ((size_t) 4096)
+
+
+void help(FILE *f) {
+
+    fprintf(f,
+
+"  Usage: fileSource --file PATH { --maxWrite LEN --queueDepth N --direct }\n"
+"\n"
+"This filter is a source.\n"
+"This filter must have 0 inputs.\n"
+"This filter will read the file PATH and write it to 1 output.  The file\n"
+"is read directly into the output ring buffer using io_uring, with up to\n"
+"N reads in flight.  Each input() call waits for at least one read to\n"
+"complete, and the data is outputted when all the reads have completed.\n"
+"If io_uring is not available pread(2) is used.\n"
+"\n"
+"\n"
+"                 OPTIONS\n"
+"\n"
+"\n"
+"  --file PATH     The file to read.  This option is required.\n"
+"\n"
+"  --maxWrite LEN  Set the maximum write promise to LEN bytes.\n"
+"                  The default value for LEN is %zu.\n"
+"\n"
+"  --queueDepth N  Split each read into N reads that are all in flight\n"
+"                  at once.  The default is %d.\n"
+"\n"
+"  --direct        Open the file with O_DIRECT, bypassing the page cache.\n"
+"                  LEN will be rounded up to a multiple of %zu.\n"
+"\n"
+"\n",
+DEFAULT_MAXWRITE, DEFAULT_QUEUEDEPTH, BLOCKSIZE
+        );
+}
+
+
+static size_t maxWrite;
+static uint32_t queueDepth;
+static bool direct;
+static int fd = -1;
+static off_t offset;
+static struct Uring uring;
+static int32_t *res;
+
+// The io_uring reads that input() submitted, that we have not outputted
+// yet.
+static struct {
+    uint8_t *buffer;
+    uint32_t n; // number of reads, 0 if there are none
+    uint32_t numDone; // number of reads that have completed
+    size_t chunk; // length of each read
+} pending;
+
+
+int construct(int argc, const char **argv) {
+
+    const char *path = qsOptsGetString(argc, argv, "file", 0);
+    if(!path) {
+        ERROR("filter \"%s\" needs a --file PATH option",
+                qsGetFilterName());
+        return -1; // fail
+    }
+
+    maxWrite = qsOptsGetSizeT(argc, argv, "maxWrite", DEFAULT_MAXWRITE);
+    queueDepth = qsOptsGetUint32(argc, argv, "queueDepth",
+            DEFAULT_QUEUEDEPTH);
+    direct = qsOptsGetBool(argc, argv, "direct");
+
+    if(queueDepth == 0) queueDepth = 1;
+
+    if(direct && maxWrite % (queueDepth*BLOCKSIZE))
+        // Every read in the queue must be a multiple of BLOCKSIZE.
+        maxWrite += queueDepth*BLOCKSIZE - maxWrite % (queueDepth*BLOCKSIZE);
+
+    fd = open(path, O_RDONLY | (direct?O_DIRECT:0));
+    if(fd < 0) {
+        ERROR("open(\"%s\",) failed", path);
+        return -1; // fail
+    }
+
+    if(UringInit(&uring, queueDepth))
+        NOTICE("io_uring is not available, using pread()");
+
+    res = calloc(queueDepth, sizeof(*res));
+    ASSERT(res, "calloc(%" PRIu32 ",%zu) failed",
+            queueDepth, sizeof(*res));
+
+    return 0; // success
+}
+
+
+int start(uint32_t numInPorts, uint32_t numOutPorts) {
+
+    ASSERT(numInPorts == 0);
+    ASSERT(numOutPorts == 1);
+
+    qsCreateOutputBuffer(0, maxWrite);
+
+    // Start at the beginning of the file for each run.
+    offset = 0;
+    pending.n = 0;
+
+    return 0; // success
+}
+
+
+int input(void *buffers[], const size_t lens[],
+        const bool isFlushing[],
+        uint32_t numInputs, uint32_t numOutputs) {
+
+    // We'll assume there is no input data.
+    DASSERT(numInputs == 0);
+    DASSERT(numOutputs == 1);
+
+    // The ring buffer memory is page aligned, and we only write a
+    // multiple of BLOCKSIZE, except at the end of the file, so the
+    // buffer is aligned for O_DIRECT.
+    uint8_t *buffer = qsGetOutputBuffer(0, maxWrite, 0);
+
+    size_t chunk = maxWrite/queueDepth;
+    uint32_t n = queueDepth;
+    if(chunk == 0) {
+        chunk = maxWrite;
+        n = 1;
+    }
+
+    if(uring.fd >= 0) {
+
+        if(!pending.n) {
+            // Submit the reads and do not wait for them.
+            for(uint32_t i=0; i<n; ++i)
+                UringQueue(&uring, IORING_OP_READ, fd, buffer + i*chunk,
+                        chunk, offset + i*chunk, i);
+            int ret = UringSubmit(&uring);
+            if(ret) {
+                ERROR("io_uring_enter() failed: %s", strerror(-ret));
+                return -1; // fail
+            }
+            pending.buffer = buffer;
+            pending.n = n;
+            pending.chunk = chunk;
+            pending.numDone = 0;
+        }
+
+        // We did not output since we submitted, so the output buffer
+        // did not move.
+        DASSERT(pending.buffer == buffer);
+
+        // Wait for at least one read to complete, so that we do not
+        // return without progress and get called again right away.
+        int ret = UringReapWait(&uring, res);
+        if(ret < 0) {
+            ERROR("io_uring_enter() failed: %s", strerror(-ret));
+            return -1; // fail
+        }
+        pending.numDone += ret;
+        if(pending.numDone < pending.n)
+            // Not all the reads are done.  We get called again, because
+            // we are a source, and we wait for the next read then.
+            return 0; // continue.
+
+        pending.n = 0;
+
+    } else
+        for(uint32_t i=0; i<n; ++i) {
+            ssize_t rd = pread(fd, buffer + i*chunk, chunk,
+                    offset + i*chunk);
+            res[i] = (rd < 0)?(-errno):rd;
+            if(rd != chunk) break;
+        }
+
+    // Only the bytes that are contiguous from the start of the buffer
+    // can be outputted.  The rest will be read again in the next call.
+    size_t total = 0;
+    bool done = false;
+    for(uint32_t i=0; i<n; ++i) {
+        if(res[i] < 0) {
+            ERROR("reading file failed: %s", strerror(-res[i]));
+            return -1; // fail
+        }
+        total += res[i];
+        if(res[i] != chunk) {
+            // We read to the end of the file.
+            done = (res[i] == 0 || direct);
+            break;
+        }
+    }
+
+    offset += total;
+    qsOutput(0, total);
+
+    if(done || total == 0)
+        // This filter is done reading the file.
+        return 1; // filter done.
+
+    return 0; // continue.
+}
+
+
+int stop(uint32_t numInPorts, uint32_t numOutPorts) {
+
+    if(pending.n) {
+        // The stream stopped with reads in flight.  We must wait for
+        // them before the output buffer goes away.
+        UringWait(&uring, res);
+        pending.n = 0;
+    }
+
+    return 0; // success
+}
+
+
+int destroy(void) {
+
+    UringCleanup(&uring);
+    if(fd >= 0)
+        close(fd);
+    fd = -1;
+    free(res);
+    res = 0;
+
+    return 0; // success
+}
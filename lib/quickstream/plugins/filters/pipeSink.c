@@ -0,0 +1,222 @@
+// For vmsplice() and F_GETPIPE_SZ
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/ioctl.h>
+#include <poll.h>
+
+#include "../../../../include/quickstream/filter.h"
+#include "../../../../lib/debug.h"
+
+
+#define DEFAULT_MAXREAD     ((size_t) (1024*1024))
+
+
+void help(FILE *f) {
+
+    fprintf(f,
+
+"  Usage: pipeSink { --fd N --maxRead LEN --pipeSize BYTES }\n"
+"\n"
+"This filter is a sink.\n"
+"This filter must have 1 input and 0 outputs.\n"
+"This filter will write its input to file descriptor N.  If N is a pipe\n"
+"the input ring buffer memory is given to the pipe with vmsplice(2), so\n"
+"the bytes are not copied by this process.  The input is not advanced\n"
+"until the process reading the pipe has read it, so the ring buffer\n"
+"memory is not reused while the pipe still refers to it.  If N is not a\n"
+"pipe, write(2) is used, without a stdio buffer.\n"
+"\n"
+"\n"
+"                 OPTIONS\n"
+"\n"
+"\n"
+"  --fd N            The file descriptor to write.  The default is 1,\n"
+"                    which is stdout.\n"
+"\n"
+"  --maxRead LEN     Set the input read promise to LEN bytes.  When\n"
+"                    writing to a pipe LEN is made to be at least twice\n"
+"                    the pipe size.  The default value for LEN is %zu.\n"
+"\n"
+"  --pipeSize BYTES  If the file descriptor is a pipe, set the pipe\n"
+"                    buffer size to BYTES with fcntl(F_SETPIPE_SZ).\n"
+"                    The default is to not change the pipe size.\n"
+"\n"
+"\n",
+DEFAULT_MAXREAD
+        );
+}
+
+
+static size_t maxRead;
+static int fd;
+static bool isPipe;
+
+// The number of bytes at the start of the input that we have given to
+// the pipe with vmsplice() but that we have not advanced yet.
+static size_t spliced;
+
+
+int construct(int argc, const char **argv) {
+
+    fd = qsOptsGetInt(argc, argv, "fd", STDOUT_FILENO);
+    maxRead = qsOptsGetSizeT(argc, argv, "maxRead", DEFAULT_MAXREAD);
+    int pipeSize = qsOptsGetInt(argc, argv, "pipeSize", 0);
+
+    struct stat st;
+    if(fstat(fd, &st)) {
+        ERROR("fstat(%d,) failed", fd);
+        return -1; // fail
+    }
+
+    isPipe = S_ISFIFO(st.st_mode);
+
+    if(isPipe && pipeSize > 0 &&
+            fcntl(fd, F_SETPIPE_SZ, pipeSize) < 0)
+        // This is not a big deal.  It may be more than
+        // /proc/sys/fs/pipe-max-size.
+        NOTICE("fcntl(%d, F_SETPIPE_SZ, %d) failed", fd, pipeSize);
+
+    return 0; // success
+}
+
+
+int start(uint32_t numInPorts, uint32_t numOutPorts) {
+
+    ASSERT(numInPorts == 1);
+    ASSERT(numOutPorts == 0);
+
+    if(isPipe) {
+        int pipeSize = fcntl(fd, F_GETPIPE_SZ);
+        if(pipeSize < 0) {
+            ERROR("fcntl(%d, F_GETPIPE_SZ) failed", fd);
+            return -1; // fail
+        }
+        // The pipe can hold at most pipeSize bytes that we have not
+        // advanced yet.  If we can read twice that much, than we can
+        // always advance some input after we vmsplice() it all.
+        if(maxRead < 2*((size_t) pipeSize))
+            maxRead = 2*((size_t) pipeSize);
+    }
+
+    qsSetInputReadPromise(0, maxRead);
+
+    spliced = 0;
+
+    return 0; // success
+}
+
+
+// Returns 0 on success, or -1 on error.
+static inline
+int Write(const uint8_t *buffer, size_t len) {
+
+    while(len) {
+        ssize_t ret = write(fd, buffer, len);
+        if(ret < 0) {
+            if(errno == EINTR) continue;
+            ERROR("write(%d,%p,%zu) failed", fd, buffer, len);
+            return -1;
+        }
+        buffer += ret;
+        len -= ret;
+    }
+    return 0;
+}
+
+
+int input(void *buffers[], const size_t lens[],
+        const bool isFlushing[],
+        uint32_t numInPorts, uint32_t numOutPorts) {
+
+    uint8_t *buffer = buffers[0];
+    size_t len = lens[0];
+
+    DASSERT(spliced <= len);
+
+    if(!isPipe) {
+        if(Write(buffer, len))
+            return -1; // fail
+        qsAdvanceInput(0, len);
+        return 0; // success
+    }
+
+    // Give the pipe the part of the input that it does not have yet.
+    while(spliced < len) {
+        struct iovec iov = {
+            .iov_base = buffer + spliced,
+            .iov_len = len - spliced
+        };
+        ssize_t ret = vmsplice(fd, &iov, 1, 0);
+        if(ret < 0) {
+            if(errno == EINTR) continue;
+            if(spliced == 0 && errno == EINVAL) {
+                // The kernel will not vmsplice() this.  We never gave
+                // it anything, so we can just write from now on.
+                NOTICE("vmsplice() failed, using write(2)");
+                isPipe = false;
+                if(Write(buffer, len))
+                    return -1; // fail
+                qsAdvanceInput(0, len);
+                return 0; // success
+            }
+            ERROR("vmsplice(%d,,) failed", fd);
+            return -1; // fail
+        }
+        spliced += ret;
+    }
+
+    if(isFlushing[0]) {
+        // The filter feeding us is done so the ring buffer memory will
+        // not be written to anymore, and we can advance it all.  stop()
+        // waits for the pipe to be read before the memory goes away.
+        qsAdvanceInput(0, spliced);
+        spliced = 0;
+        return 0; // success
+    }
+
+    // FIONREAD tells us how many bytes are still in the pipe.  They are
+    // at the end of what we spliced, and the ring buffer memory that
+    // holds them must not be reused yet.  It's the bytes before that
+    // that the reader of the pipe is done with.
+    int inPipe = 0;
+    if(ioctl(fd, FIONREAD, &inPipe)) {
+        ERROR("ioctl(%d, FIONREAD,) failed", fd);
+        return -1; // fail
+    }
+    if((size_t) inPipe > spliced)
+        // Someone else is writing to this pipe too.  Not good.
+        inPipe = spliced;
+
+    size_t advance = spliced - inPipe;
+    spliced = inPipe;
+    qsAdvanceInput(0, advance);
+
+    return 0; // success
+}
+
+
+int stop(uint32_t numInPorts, uint32_t numOutPorts) {
+
+    if(!isPipe) return 0;
+
+    // The ring buffer memory goes away after this, and the pipe may
+    // still refer to it, so we wait for the reader of the pipe to read
+    // the last of it.  POLLERR is set if the reader closes the pipe.
+    struct pollfd pfd = { .fd = fd, .events = POLLOUT };
+    int inPipe;
+    while(ioctl(fd, FIONREAD, &inPipe) == 0 && inPipe > 0) {
+        pfd.revents = 0;
+        if(poll(&pfd, 1, 1/*millisecond*/) > 0 && (pfd.revents & POLLERR))
+            break;
+    }
+    spliced = 0;
+
+    return 0; // success
+}
@@ -0,0 +1,117 @@
+// For F_SETPIPE_SZ
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "../../../../include/quickstream/filter.h"
+#include "../../../../lib/debug.h"
+
+
+#define DEFAULT_MAXWRITE    ((size_t) (256*1024))
+
+
+void help(FILE *f) {
+
+    fprintf(f,
+
+"  Usage: pipeSource { --fd N --maxWrite LEN --pipeSize BYTES }\n"
+"\n"
+"This filter is a source.\n"
+"This filter must have 0 inputs.\n"
+"This filter will read file descriptor N and write it to 1 output.\n"
+"It reads with read(2) directly into the output ring buffer, so unlike\n"
+"the stdin filter there is no copy through a stdio buffer.  The kernel\n"
+"cannot splice(2) from a pipe into user memory, so read(2) is as close\n"
+"to zero-copy as we can get on the reading side.\n"
+"\n"
+"\n"
+"                 OPTIONS\n"
+"\n"
+"\n"
+"  --fd N            The file descriptor to read.  The default is 0,\n"
+"                    which is stdin.\n"
+"\n"
+"  --maxWrite LEN    Set the maximum write promise to LEN bytes.\n"
+"                    The default value for LEN is %zu.\n"
+"\n"
+"  --pipeSize BYTES  If the file descriptor is a pipe, set the pipe\n"
+"                    buffer size to BYTES with fcntl(F_SETPIPE_SZ).\n"
+"                    A larger pipe means fewer read(2) calls.  The\n"
+"                    default is to not change the pipe size.\n"
+"\n"
+"\n",
+DEFAULT_MAXWRITE
+        );
+}
+
+
+static size_t maxWrite;
+static int fd;
+
+
+int construct(int argc, const char **argv) {
+
+    fd = qsOptsGetInt(argc, argv, "fd", STDIN_FILENO);
+    maxWrite = qsOptsGetSizeT(argc, argv, "maxWrite", DEFAULT_MAXWRITE);
+    int pipeSize = qsOptsGetInt(argc, argv, "pipeSize", 0);
+
+    struct stat st;
+    if(fstat(fd, &st)) {
+        ERROR("fstat(%d,) failed", fd);
+        return -1; // fail
+    }
+
+    if(S_ISFIFO(st.st_mode) && pipeSize > 0 &&
+            fcntl(fd, F_SETPIPE_SZ, pipeSize) < 0)
+        // This is not a big deal.  It may be more than
+        // /proc/sys/fs/pipe-max-size.
+        NOTICE("fcntl(%d, F_SETPIPE_SZ, %d) failed", fd, pipeSize);
+
+    return 0; // success
+}
+
+
+int start(uint32_t numInPorts, uint32_t numOutPorts) {
+
+    ASSERT(numInPorts == 0);
+    ASSERT(numOutPorts == 1);
+
+    qsCreateOutputBuffer(0, maxWrite);
+
+    return 0; // success
+}
+
+
+int input(void *buffers[], const size_t lens[],
+        const bool isFlushing[],
+        uint32_t numInputs, uint32_t numOutputs) {
+
+    // We'll assume there is no input data.
+    DASSERT(numInputs == 0);
+    DASSERT(numOutputs == 1);
+
+    void *buffer = qsGetOutputBuffer(0, maxWrite, 0);
+
+    ssize_t rd;
+    do
+        rd = read(fd, buffer, maxWrite);
+    while(rd < 0 && errno == EINTR);
+
+    if(rd < 0) {
+        ERROR("read(%d,%p,%zu) failed", fd, buffer, maxWrite);
+        return -1; // fail
+    }
+
+    if(rd == 0)
+        // This filter is done reading.  End of file.
+        return 1; // filter done.
+
+    qsOutput(0, rd);
+
+    return 0; // continue.
+}
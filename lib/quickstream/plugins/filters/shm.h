@@ -0,0 +1,202 @@
+// Code that is shared by the shmSource and shmSink filter modules.
+//
+// The shmSink filter in one process feeds the shmSource filter in another
+// process through a named POSIX shared memory object.  The shared memory
+// is a page with a ShmControl structure in it, followed by a ring buffer
+// that is mapped twice, back to back, like the quickstream ring buffers
+// in lib/makeRingBuffer.c, so that reads and writes never have to wrap.
+//
+// The read and write counters are atomic.  When one side has to wait for
+// the other it waits on a futex, so there are no system calls when
+// neither side is waiting.
+//
+// shmSource creates the shared memory object, and shmSink attaches to
+// it.  There is one sink per source for each stream run.
+//
+// This is not a zero copy transport.  A filter input() reads from, and
+// qsOutput() writes to, ring buffers that the stream owns, so shmSink
+// copies its input into the shared ring and shmSource copies out of the
+// shared ring into its output; each byte is copied twice.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "../../../../lib/debug.h"
+
+
+#define SHM_MAGIC    ((uint32_t) 0x71734d42)
+
+// ShmControl::state values
+#define SHM_NOTREADY   ((uint32_t) 0) // shmSource is not started
+#define SHM_WAITING    ((uint32_t) 1) // shmSource waits for a shmSink
+#define SHM_ATTACHED   ((uint32_t) 2) // shmSink is writing
+#define SHM_END        ((uint32_t) 3) // shmSink is done writing
+
+
+struct ShmControl {
+
+    uint32_t magic; // Set last by the creator.
+    uint64_t length; // The length of the ring buffer in bytes.
+
+    _Atomic uint32_t state;
+    // The process IDs, so each side can tell if the other died.
+    _Atomic pid_t sourcePid, sinkPid;
+
+    // These are on their own cache lines, so the two processes do not
+    // fight over a cache line when they do not have to.
+
+    // Total bytes written.  Only shmSink changes it.
+    _Alignas(64) _Atomic uint64_t writeCount;
+    // Incremented after writeCount changes.  shmSource waits on this.
+    _Atomic uint32_t writeFutex;
+    _Atomic uint32_t readerWaiting;
+
+    // Total bytes read.  Only shmSource changes it.
+    _Alignas(64) _Atomic uint64_t readCount;
+    // Incremented after readCount changes.  shmSink waits on this.
+    _Atomic uint32_t readFutex;
+    _Atomic uint32_t writerWaiting;
+};
+
+
+struct Shm {
+    struct ShmControl *control;
+    uint8_t *ring; // mapped twice, so 2*length long.
+    size_t length;
+};
+
+
+// Wait for *addr to not be val, for up to timeout seconds.  These futexes
+// are not private, since they are shared between processes.
+static inline
+void ShmFutexWait(_Atomic uint32_t *addr, uint32_t val, double timeout) {
+
+    struct timespec ts = {
+        .tv_sec = timeout,
+        .tv_nsec = (timeout - (time_t) timeout)*1.0e9
+    };
+    syscall(SYS_futex, addr, FUTEX_WAIT, val, &ts, 0, 0);
+}
+
+
+static inline
+void ShmFutexWake(_Atomic uint32_t *addr, _Atomic uint32_t *waiting) {
+
+    atomic_fetch_add(addr, 1);
+    if(atomic_load(waiting))
+        syscall(SYS_futex, addr, FUTEX_WAKE, INT32_MAX, 0, 0, 0);
+}
+
+
+// Map the shared memory from the file descriptor, fd.  If length is not
+// 0 this sets up the object with a ring buffer of that length, else we
+// get the length from the control structure.  Returns 0 on success.
+static inline
+int ShmMap(struct Shm *shm, int fd, size_t length) {
+
+    size_t pageSize = getpagesize();
+    DASSERT(sizeof(struct ShmControl) <= pageSize);
+
+    if(length) {
+        if(length % pageSize)
+            length += pageSize - length % pageSize;
+        if(ftruncate(fd, pageSize + length)) {
+            ERROR("ftruncate() failed");
+            return -1;
+        }
+    } else {
+        // The creator may not have called ftruncate() yet, and touching
+        // the mapping past the end of the file would get us SIGBUS.
+        struct stat st;
+        if(fstat(fd, &st)) {
+            ERROR("fstat() failed");
+            return -1;
+        }
+        if(st.st_size < (off_t) pageSize)
+            return 1; // Not ready yet.
+    }
+
+    shm->control = mmap(0, pageSize, PROT_READ|PROT_WRITE, MAP_SHARED,
+            fd, 0);
+    if(shm->control == MAP_FAILED) {
+        ERROR("mmap() failed");
+        return -1;
+    }
+
+    if(length) {
+        memset(shm->control, 0, sizeof(*shm->control));
+        shm->control->length = length;
+        // So that another shmSource can tell that this one is using it.
+        atomic_store(&shm->control->sourcePid, getpid());
+        // The magic number tells shmSink that the rest is set.
+        atomic_thread_fence(memory_order_release);
+        shm->control->magic = SHM_MAGIC;
+    } else {
+        atomic_thread_fence(memory_order_acquire);
+        if(shm->control->magic != SHM_MAGIC) {
+            munmap(shm->control, pageSize);
+            shm->control = 0;
+            return 1; // Not ready yet.
+        }
+        length = shm->control->length;
+    }
+
+    shm->length = length;
+
+    // Get 2*length of address space, and then put the ring buffer in
+    // both halves of it.
+    uint8_t *x = mmap(0, 2*length, PROT_NONE,
+            MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if(x == MAP_FAILED) {
+        ERROR("mmap() failed");
+        goto fail;
+    }
+    if(mmap(x, length, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_FIXED,
+                fd, pageSize) != x ||
+            mmap(x + length, length, PROT_READ|PROT_WRITE,
+                MAP_SHARED|MAP_FIXED, fd, pageSize) != x + length) {
+        ERROR("mmap() failed");
+        // This unmaps what of the ring buffer got mapped too.
+        munmap(x, 2*length);
+        goto fail;
+    }
+    shm->ring = x;
+
+    return 0;
+
+fail:
+
+    munmap(shm->control, pageSize);
+    shm->control = 0;
+    return -1;
+}
+
+
+// Returns true if the process with ID pid is gone.
+static inline
+bool ShmIsDead(pid_t pid) {
+    return pid && kill(pid, 0) && errno == ESRCH;
+}
+
+
+static inline
+void ShmUnmap(struct Shm *shm) {
+
+    if(shm->ring)
+        munmap(shm->ring, 2*shm->length);
+    if(shm->control)
+        munmap(shm->control, getpagesize());
+    shm->ring = 0;
+    shm->control = 0;
+}
@@ -0,0 +1,195 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "../../../../include/quickstream/filter.h"
+#include "shm.h"
+
+
+#define DEFAULT_MAXREAD     ((size_t) (1024*1024))
+#define DEFAULT_TIMEOUT     10.0
+
+
+void help(FILE *f) {
+
+    fprintf(f,
+
+"  Usage: shmSink --shm NAME { --maxRead LEN --timeout SEC }\n"
+"\n"
+"This filter is a sink.\n"
+"This filter must have 1 input and 0 outputs.\n"
+"This filter writes its input to the POSIX shared memory object NAME\n"
+"that a shmSource filter in another process created.  Together they\n"
+"carry a ring buffer edge from one process to another.  The input is\n"
+"copied into the shared memory, and shmSource copies it out.  The shared\n"
+"memory is attached each time the stream runs.\n"
+"\n"
+"\n"
+"                 OPTIONS\n"
+"\n"
+"\n"
+"  --shm NAME      The name of the shared memory object.  This option is\n"
+"                  required.\n"
+"\n"
+"  --maxRead LEN   Set the input read promise to LEN bytes.  The default\n"
+"                  value for LEN is %zu.\n"
+"\n"
+"  --timeout SEC   Keep trying to attach to the shmSource for SEC seconds.\n"
+"                  The default is %g.\n"
+"\n"
+"\n",
+DEFAULT_MAXREAD, DEFAULT_TIMEOUT
+        );
+}
+
+
+// qsGetFilterName() may not be called in input().
+static const char *filterName;
+
+static char name[256];
+static size_t maxRead;
+static double timeout;
+static struct Shm shm;
+
+
+int construct(int argc, const char **argv) {
+
+    filterName = qsGetFilterName();
+
+    const char *shmName = qsOptsGetString(argc, argv, "shm", 0);
+    if(!shmName) {
+        ERROR("filter \"%s\" needs a --shm NAME option",
+                filterName);
+        return -1; // fail
+    }
+    // shm_open() wants a name that starts with '/'.
+    snprintf(name, sizeof(name), "%s%s",
+            (shmName[0] == '/')?"":"/", shmName);
+
+    maxRead = qsOptsGetSizeT(argc, argv, "maxRead", DEFAULT_MAXREAD);
+    timeout = qsOptsGetDouble(argc, argv, "timeout", DEFAULT_TIMEOUT);
+
+    return 0; // success
+}
+
+
+// Returns 0 on success.
+static
+int Attach(void) {
+
+    struct timespec t, end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    end.tv_sec += timeout;
+    end.tv_nsec += (timeout - (time_t) timeout)*1.0e9;
+
+    while(true) {
+
+        if(!shm.control) {
+            int fd = shm_open(name, O_RDWR, 0);
+            if(fd >= 0) {
+                int ret = ShmMap(&shm, fd, 0);
+                close(fd);
+                if(ret < 0) return -1;
+            }
+        }
+
+        if(shm.control) {
+            // We can only attach to a shmSource that is waiting for us.
+            uint32_t state = SHM_WAITING;
+            if(atomic_compare_exchange_strong(&shm.control->state,
+                        &state, SHM_ATTACHED)) {
+                atomic_store(&shm.control->sinkPid, getpid());
+                return 0;
+            }
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &t);
+        if(t.tv_sec + 1.0e-9*t.tv_nsec > end.tv_sec + 1.0e-9*end.tv_nsec) {
+            ERROR("filter \"%s\" failed to attach to shared memory \"%s\"",
+                    filterName, name);
+            return -1;
+        }
+        // The shmSource may not be started yet.
+        usleep(10000);
+    }
+}
+
+
+int start(uint32_t numInPorts, uint32_t numOutPorts) {
+
+    ASSERT(numInPorts == 1);
+    ASSERT(numOutPorts == 0);
+
+    qsSetInputReadPromise(0, maxRead);
+
+    return Attach();
+}
+
+
+int input(void *buffers[], const size_t lens[],
+        const bool isFlushing[],
+        uint32_t numInPorts, uint32_t numOutPorts) {
+
+    struct ShmControl *c = shm.control;
+    // Only this process changes writeCount.
+    uint64_t w = atomic_load_explicit(&c->writeCount, memory_order_relaxed);
+    size_t space;
+
+    while(true) {
+
+        uint32_t seq = atomic_load(&c->readFutex);
+        uint64_t r = atomic_load_explicit(&c->readCount,
+                memory_order_acquire);
+        space = shm.length - (w - r);
+        if(space)
+            break;
+
+        if(ShmIsDead(atomic_load(&c->sourcePid))) {
+            ERROR("filter \"%s\" shmSource process %d died",
+                    filterName, atomic_load(&c->sourcePid));
+            return -1; // fail
+        }
+
+        // Wait for shmSource to read.
+        atomic_store(&c->writerWaiting, 1);
+        if(atomic_load(&c->readFutex) == seq)
+            ShmFutexWait(&c->readFutex, seq, 0.1);
+        atomic_store(&c->writerWaiting, 0);
+    }
+
+    size_t len = lens[0];
+    if(len > space)
+        len = space;
+
+    // The ring is mapped twice so this never wraps.
+    memcpy(shm.ring + w % shm.length, buffers[0], len);
+
+    atomic_store_explicit(&c->writeCount, w + len, memory_order_release);
+    ShmFutexWake(&c->writeFutex, &c->readerWaiting);
+
+    qsAdvanceInput(0, len);
+
+    return 0; // success
+}
+
+
+int stop(uint32_t numInPorts, uint32_t numOutPorts) {
+
+    if(!shm.control) return 0;
+
+    uint32_t state = SHM_ATTACHED;
+    if(atomic_compare_exchange_strong(&shm.control->state,
+                &state, SHM_END))
+        // Let shmSource see that we are done.
+        ShmFutexWake(&shm.control->writeFutex,
+                &shm.control->readerWaiting);
+
+    return 0; // success
+}
+
+
+int destroy(void) {
+
+    ShmUnmap(&shm);
+
+    return 0; // success
+}
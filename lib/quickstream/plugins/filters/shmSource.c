@@ -0,0 +1,228 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "../../../../include/quickstream/filter.h"
+#include "shm.h"
+
+
+#define DEFAULT_LENGTH      ((size_t) (8*1024*1024))
+#define DEFAULT_MAXWRITE    ((size_t) (1024*1024))
+
+
+void help(FILE *f) {
+
+    fprintf(f,
+
+"  Usage: shmSource --shm NAME { --length LEN --maxWrite LEN }\n"
+"\n"
+"This filter is a source.\n"
+"This filter must have 0 inputs.\n"
+"This filter creates the POSIX shared memory object NAME, and writes\n"
+"what a shmSink filter in another process puts in it to 1 output.\n"
+"Together they carry a ring buffer edge from one process to another,\n"
+"without system calls when neither side has to wait.  The data is\n"
+"copied into the shared memory by shmSink and out of it by this filter.\n"
+"This filter finishes when the shmSink filter stops, or when the shmSink\n"
+"process dies, so a filter that crashes in the other process does not\n"
+"take this process with it.  If NAME was left by a shmSource process\n"
+"that died it is replaced, but if the shmSource process that made it is\n"
+"running this fails.\n"
+"\n"
+"\n"
+"                 OPTIONS\n"
+"\n"
+"\n"
+"  --shm NAME      The name of the shared memory object.  This option is\n"
+"                  required.\n"
+"\n"
+"  --length LEN    The length of the shared ring buffer in bytes.  The\n"
+"                  default is %zu.\n"
+"\n"
+"  --maxWrite LEN  Set the maximum write promise to LEN bytes.\n"
+"                  The default value for LEN is %zu.\n"
+"\n"
+"\n",
+DEFAULT_LENGTH, DEFAULT_MAXWRITE
+        );
+}
+
+
+// qsGetFilterName() may not be called in input().
+static const char *filterName;
+
+static char name[256];
+static size_t maxWrite;
+static struct Shm shm;
+
+
+// Remove the shared memory object if it was left by a shmSource process
+// that died.  Returns 0 if there is no object with our name now, or -1 if
+// another shmSource process that is running is using it.
+static
+int RemoveStale(void) {
+
+    int fd = shm_open(name, O_RDWR, 0);
+    if(fd < 0) {
+        if(errno == ENOENT)
+            return 0; // There is no old one.
+        ERROR("shm_open(\"%s\",,) failed", name);
+        return -1;
+    }
+
+    // If the object is not set up yet we cannot tell who made it, so we
+    // treat it as left by a process that died before it got that far.
+    pid_t pid = 0;
+    size_t pageSize = getpagesize();
+    struct stat st;
+    if(fstat(fd, &st) == 0 && st.st_size >= (off_t) pageSize) {
+        struct ShmControl *c = mmap(0, pageSize, PROT_READ, MAP_SHARED,
+                fd, 0);
+        if(c != MAP_FAILED) {
+            if(c->magic == SHM_MAGIC)
+                pid = atomic_load(&c->sourcePid);
+            munmap(c, pageSize);
+        }
+    }
+    close(fd);
+
+    if(pid && !ShmIsDead(pid)) {
+        ERROR("filter \"%s\" shared memory \"%s\" is in use by"
+                " shmSource process %d",
+                filterName, name, pid);
+        return -1;
+    }
+
+    shm_unlink(name);
+    return 0;
+}
+
+
+int construct(int argc, const char **argv) {
+
+    filterName = qsGetFilterName();
+
+    const char *shmName = qsOptsGetString(argc, argv, "shm", 0);
+    if(!shmName) {
+        ERROR("filter \"%s\" needs a --shm NAME option",
+                filterName);
+        return -1; // fail
+    }
+    // shm_open() wants a name that starts with '/'.
+    snprintf(name, sizeof(name), "%s%s",
+            (shmName[0] == '/')?"":"/", shmName);
+
+    size_t length = qsOptsGetSizeT(argc, argv, "length", DEFAULT_LENGTH);
+    maxWrite = qsOptsGetSizeT(argc, argv, "maxWrite", DEFAULT_MAXWRITE);
+
+    if(RemoveStale())
+        return -1; // fail
+
+    int fd = shm_open(name, O_RDWR|O_CREAT|O_EXCL, S_IRUSR|S_IWUSR);
+    if(fd < 0) {
+        ERROR("shm_open(\"%s\",,) failed", name);
+        return -1; // fail
+    }
+
+    int ret = ShmMap(&shm, fd, length);
+    close(fd);
+    if(ret) {
+        shm_unlink(name);
+        return -1; // fail
+    }
+
+    return 0; // success
+}
+
+
+int start(uint32_t numInPorts, uint32_t numOutPorts) {
+
+    ASSERT(numInPorts == 0);
+    ASSERT(numOutPorts == 1);
+
+    qsCreateOutputBuffer(0, maxWrite);
+
+    struct ShmControl *c = shm.control;
+    atomic_store(&c->writeCount, 0);
+    atomic_store(&c->readCount, 0);
+    atomic_store(&c->sinkPid, 0);
+    // Now a shmSink may attach.
+    atomic_store(&c->state, SHM_WAITING);
+
+    return 0; // success
+}
+
+
+int input(void *buffers[], const size_t lens[],
+        const bool isFlushing[],
+        uint32_t numInputs, uint32_t numOutputs) {
+
+    // We'll assume there is no input data.
+    DASSERT(numInputs == 0);
+    DASSERT(numOutputs == 1);
+
+    struct ShmControl *c = shm.control;
+    // Only this process changes readCount.
+    uint64_t r = atomic_load_explicit(&c->readCount, memory_order_relaxed);
+    uint64_t w;
+
+    while(true) {
+
+        uint32_t seq = atomic_load(&c->writeFutex);
+        w = atomic_load_explicit(&c->writeCount, memory_order_acquire);
+        if(w != r)
+            break;
+
+        uint32_t state = atomic_load(&c->state);
+        if(state == SHM_END) {
+            // shmSink may have written more before it ended.
+            if(atomic_load(&c->writeCount) != r)
+                continue;
+            return 1; // filter done.
+        }
+        if(state == SHM_ATTACHED && ShmIsDead(atomic_load(&c->sinkPid))) {
+            WARN("filter \"%s\" shmSink process %d died",
+                    filterName, atomic_load(&c->sinkPid));
+            return 1; // filter done.
+        }
+
+        // Wait for shmSink to write.  We wake up now and then to see if
+        // the shmSink process is still there.
+        atomic_store(&c->readerWaiting, 1);
+        if(atomic_load(&c->writeFutex) == seq)
+            ShmFutexWait(&c->writeFutex, seq, 0.1);
+        atomic_store(&c->readerWaiting, 0);
+    }
+
+    size_t len = w - r;
+    if(len > maxWrite)
+        len = maxWrite;
+
+    void *buffer = qsGetOutputBuffer(0, len, 0);
+    // The ring is mapped twice so this never wraps.
+    memcpy(buffer, shm.ring + r % shm.length, len);
+
+    atomic_store_explicit(&c->readCount, r + len, memory_order_release);
+    ShmFutexWake(&c->readFutex, &c->writerWaiting);
+
+    qsOutput(0, len);
+
+    return 0; // continue.
+}
+
+
+int stop(uint32_t numInPorts, uint32_t numOutPorts) {
+
+    atomic_store(&shm.control->state, SHM_NOTREADY);
+    return 0; // success
+}
+
+
+int destroy(void) {
+
+    if(shm.control) {
+        ShmUnmap(&shm);
+        shm_unlink(name);
+    }
+
+    return 0; // success
+}
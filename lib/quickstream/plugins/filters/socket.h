@@ -0,0 +1,75 @@
+// Socket code that is shared by the udp and tcp filter modules.
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include "../../../../lib/debug.h"
+
+
+// Get an address for a socket.  type is SOCK_DGRAM or SOCK_STREAM.
+// Returns 0 on success.
+static inline
+int SocketGetAddress(const char *host, int port, int type,
+        struct sockaddr_storage *addr, socklen_t *addrLen) {
+
+    char service[16];
+    snprintf(service, sizeof(service), "%d", port);
+
+    struct addrinfo hints, *res = 0;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = type;
+    hints.ai_flags = AI_PASSIVE;
+
+    int ret = getaddrinfo(host, service, &hints, &res);
+    if(ret) {
+        ERROR("getaddrinfo(\"%s\", \"%s\",,) failed: %s",
+                host?host:"", service, gai_strerror(ret));
+        return -1;
+    }
+    memcpy(addr, res->ai_addr, res->ai_addrlen);
+    *addrLen = res->ai_addrlen;
+    freeaddrinfo(res);
+    return 0;
+}
+
+
+// Set the socket buffer size and busy polling.  opt is SO_RCVBUF or
+// SO_SNDBUF, and forceOpt is SO_RCVBUFFORCE or SO_SNDBUFFORCE.  Failing
+// to get what was asked for is not an error, but we tell the user.
+static inline
+void SocketSetOptions(int fd, int opt, int forceOpt,
+        int bufSize, int busyPoll) {
+
+    if(bufSize > 0) {
+        // The kernel will cap this at /proc/sys/net/core/[rw]mem_max
+        // unless we have CAP_NET_ADMIN and use the FORCE option.
+        setsockopt(fd, SOL_SOCKET, opt, &bufSize, sizeof(bufSize));
+        int got = 0;
+        socklen_t len = sizeof(got);
+        getsockopt(fd, SOL_SOCKET, opt, &got, &len);
+        // The kernel doubles the value that we set, for its overhead.
+        if(got < bufSize &&
+                setsockopt(fd, SOL_SOCKET, forceOpt,
+                    &bufSize, sizeof(bufSize)))
+            NOTICE("Socket buffer size is %d and not %d as requested",
+                    got/2, bufSize);
+    }
+
+#ifdef SO_BUSY_POLL
+    if(busyPoll > 0 &&
+            setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL,
+                &busyPoll, sizeof(busyPoll)))
+        NOTICE("setsockopt(,SO_BUSY_POLL, %d) failed", busyPoll);
+#else
+    if(busyPoll > 0)
+        NOTICE("SO_BUSY_POLL is not supported");
+#endif
+}
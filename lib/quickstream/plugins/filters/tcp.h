@@ -0,0 +1,27 @@
+// Code that is shared by the tcpSource and tcpSink filter modules.
+//
+// The tcpSink and tcpSource filters carry one ring buffer edge of a
+// stream over a TCP connection.  The bytes on the connection are a
+// series of frames.  Each frame starts with a TcpFrame header, in
+// network byte order, that is followed by len bytes of payload for
+// TCP_FRAME_DATA frames, and nothing for the other frame types.
+
+#include "socket.h"
+
+
+#define TCP_FRAME_DATA    ((uint32_t) 1)
+// The filter feeding tcpSink is flushing.
+#define TCP_FRAME_FLUSH   ((uint32_t) 2)
+// The end of the stream.  The connection is closed after this.
+#define TCP_FRAME_END     ((uint32_t) 3)
+
+
+struct TcpFrame {
+    uint32_t type;
+    uint32_t len;
+};
+
+
+// The default socket buffer size.  Large socket buffers let TCP keep
+// more bytes in flight, which we need for high bandwidth links.
+#define TCP_DEFAULT_BUFSIZE  (4*1024*1024)
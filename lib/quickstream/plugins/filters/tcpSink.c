@@ -0,0 +1,385 @@
+#include <stdlib.h>
+#include <inttypes.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/uio.h>
+#include <linux/errqueue.h>
+
+#include "../../../../include/quickstream/filter.h"
+#include "tcp.h"
+
+
+#define DEFAULT_MAXREAD     ((size_t) (1024*1024))
+#define DEFAULT_CONNECTTIMEOUT  10.0
+
+// The most zero copy sends that we let the kernel hold at a time.
+#define MAX_PENDING  256
+
+
+void help(FILE *f) {
+
+    fprintf(f,
+
+"  Usage: tcpSink --port PORT { --address ADDR --maxRead LEN\n"
+"                 --sndbuf BYTES --zerocopy --connectTimeout SEC }\n"
+"\n"
+"This filter is a sink.\n"
+"This filter must have 1 input and 0 outputs.\n"
+"This filter connects to a tcpSource filter, that is most likely in\n"
+"another process on another computer, and sends its input to it.\n"
+"Together they carry a ring buffer edge from one stream to another.\n"
+"A new connection is made each time the stream runs.\n"
+"\n"
+"\n"
+"                 OPTIONS\n"
+"\n"
+"\n"
+"  --port PORT           The TCP port to connect to.  This option is\n"
+"                        required.\n"
+"\n"
+"  --address ADDR        The address to connect to.  The default is\n"
+"                        localhost.\n"
+"\n"
+"  --maxRead LEN         Set the input read promise to LEN bytes.\n"
+"                        The default value for LEN is %zu.\n"
+"\n"
+"  --sndbuf BYTES        Set the socket send buffer size.  The default\n"
+"                        is %d.\n"
+"\n"
+"  --zerocopy            Send with MSG_ZEROCOPY, if the kernel has it.\n"
+"                        The kernel sends directly from the input ring\n"
+"                        buffer, and the input is not advanced until the\n"
+"                        kernel tells us that it is done with it.  This\n"
+"                        is only a win for large sends to a real network\n"
+"                        device, on localhost the kernel copies anyway.\n"
+"\n"
+"  --connectTimeout SEC  Keep trying to connect for SEC seconds.  The\n"
+"                        default is %g.\n"
+"\n"
+"\n",
+DEFAULT_MAXREAD, TCP_DEFAULT_BUFSIZE, DEFAULT_CONNECTTIMEOUT
+        );
+}
+
+
+// qsGetFilterName() may not be called in input().
+static const char *filterName;
+
+static size_t maxRead;
+static int sndbuf;
+static bool zerocopy, useZerocopy;
+static double connectTimeout;
+static struct sockaddr_storage addr;
+static socklen_t addrLen;
+static int fd = -1;
+
+// With zero copy: the number of bytes at the start of the input that
+// we sent, but the kernel may not be done with yet.
+static size_t sent;
+// With zero copy: the number of bytes that the kernel has finished with
+// that are not advanced yet.
+static size_t completed;
+
+// The zero copy sends that the kernel has not told us it is done with,
+// in the order we sent them.
+static struct Pending {
+    uint32_t id; // The kernel counts zero copy sends starting at 0.
+    size_t len;
+} pending[MAX_PENDING];
+static uint32_t pendingFirst, numPending, nextId;
+
+
+int construct(int argc, const char **argv) {
+
+    filterName = qsGetFilterName();
+
+    int port = qsOptsGetInt(argc, argv, "port", -1);
+    if(port < 0) {
+        ERROR("filter \"%s\" needs a --port PORT option",
+                filterName);
+        return -1; // fail
+    }
+    const char *address = qsOptsGetString(argc, argv, "address",
+            "localhost");
+    maxRead = qsOptsGetSizeT(argc, argv, "maxRead", DEFAULT_MAXREAD);
+    sndbuf = qsOptsGetInt(argc, argv, "sndbuf", TCP_DEFAULT_BUFSIZE);
+    zerocopy = qsOptsGetBool(argc, argv, "zerocopy");
+    connectTimeout = qsOptsGetDouble(argc, argv, "connectTimeout",
+            DEFAULT_CONNECTTIMEOUT);
+
+    if(SocketGetAddress(address, port, SOCK_STREAM, &addr, &addrLen))
+        return -1; // fail
+
+    return 0; // success
+}
+
+
+// Returns 0 on success.
+static
+int Connect(void) {
+
+    struct timespec t, end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    end.tv_sec += connectTimeout;
+    end.tv_nsec += (connectTimeout - (time_t) connectTimeout)*1.0e9;
+
+    while(true) {
+
+        fd = socket(addr.ss_family, SOCK_STREAM, 0);
+        if(fd < 0) {
+            ERROR("socket() failed");
+            return -1;
+        }
+        // This must be set before we connect so that TCP can use a
+        // large enough window.
+        SocketSetOptions(fd, SO_SNDBUF, SO_SNDBUFFORCE, sndbuf, 0);
+
+        if(connect(fd, (struct sockaddr *) &addr, addrLen) == 0)
+            break;
+
+        close(fd);
+        fd = -1;
+
+        clock_gettime(CLOCK_MONOTONIC, &t);
+        if(t.tv_sec + 1.0e-9*t.tv_nsec > end.tv_sec + 1.0e-9*end.tv_nsec) {
+            ERROR("filter \"%s\" failed to connect", filterName);
+            return -1;
+        }
+        // The tcpSource may not be listening yet.
+        usleep(10000);
+    }
+
+    useZerocopy = false;
+#ifdef SO_ZEROCOPY
+    if(zerocopy) {
+        int on = 1;
+        if(setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &on, sizeof(on)) == 0)
+            useZerocopy = true;
+        else
+            NOTICE("setsockopt(,SO_ZEROCOPY,) failed, "
+                    "MSG_ZEROCOPY will not be used");
+    }
+#else
+    if(zerocopy)
+        NOTICE("MSG_ZEROCOPY is not supported");
+#endif
+
+    return 0;
+}
+
+
+int start(uint32_t numInPorts, uint32_t numOutPorts) {
+
+    ASSERT(numInPorts == 1);
+    ASSERT(numOutPorts == 0);
+
+    qsSetInputReadPromise(0, maxRead);
+
+    sent = 0;
+    completed = 0;
+    pendingFirst = 0;
+    numPending = 0;
+    nextId = 0;
+
+    return Connect();
+}
+
+
+// Read the zero copy completion notifications, and add the lengths of
+// the sends that the kernel is done with to completed.  If block is set
+// we wait for at least one notification.  Returns 0 on success.
+static
+int Reap(bool block) {
+
+    if(block) {
+        // POLLERR is always polled for.
+        struct pollfd pfd = { .fd = fd, .events = 0 };
+        if(poll(&pfd, 1, -1) < 0 && errno != EINTR) {
+            ERROR("poll() failed");
+            return -1;
+        }
+    }
+
+    while(numPending) {
+
+        char control[128];
+        struct msghdr msg = {
+            .msg_control = control,
+            .msg_controllen = sizeof(control)
+        };
+
+        if(recvmsg(fd, &msg, MSG_ERRQUEUE|MSG_DONTWAIT) < 0) {
+            if(errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+                break;
+            ERROR("recvmsg(,,MSG_ERRQUEUE) failed");
+            return -1;
+        }
+
+        for(struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm;
+                cm = CMSG_NXTHDR(&msg, cm)) {
+            struct sock_extended_err *err =
+                (struct sock_extended_err *) CMSG_DATA(cm);
+            if(err->ee_origin != SO_EE_ORIGIN_ZEROCOPY || err->ee_errno)
+                continue;
+            // The kernel is done with sends ee_info to ee_data.  TCP
+            // finishes them in order.
+            uint32_t hi = err->ee_data;
+            while(numPending &&
+                    (int32_t) (pending[pendingFirst].id - hi) <= 0) {
+                completed += pending[pendingFirst].len;
+                pendingFirst = (pendingFirst + 1) % MAX_PENDING;
+                --numPending;
+            }
+        }
+    }
+    return 0;
+}
+
+
+// Send all of iov.  Returns 0 on success.
+static
+int Send(struct iovec *iov, int iovcnt, int flags) {
+
+    while(iovcnt) {
+
+        if(numPending == MAX_PENDING && Reap(true))
+            return -1;
+
+        struct msghdr msg = { .msg_iov = iov, .msg_iovlen = iovcnt };
+        ssize_t ret = sendmsg(fd, &msg, flags);
+        if(ret < 0) {
+            if(errno == EINTR) continue;
+            if(errno == ENOBUFS && (flags & MSG_ZEROCOPY) && numPending) {
+                // Too much memory is pinned.  Wait for some.
+                if(Reap(true)) return -1;
+                continue;
+            }
+            ERROR("filter \"%s\" sendmsg() failed", filterName);
+            return -1;
+        }
+
+        if(flags & MSG_ZEROCOPY) {
+            struct Pending *p =
+                pending + (pendingFirst + numPending) % MAX_PENDING;
+            p->id = nextId++;
+            p->len = ret;
+            ++numPending;
+        }
+
+        // Skip past what was sent.
+        while(ret && iovcnt) {
+            if((size_t) ret >= iov->iov_len) {
+                ret -= iov->iov_len;
+                ++iov;
+                --iovcnt;
+            } else {
+                iov->iov_base = ((uint8_t *) iov->iov_base) + ret;
+                iov->iov_len -= ret;
+                ret = 0;
+            }
+        }
+    }
+    return 0;
+}
+
+
+// Send a frame with no payload.
+static inline
+int SendFrame(uint32_t type) {
+
+    struct TcpFrame frame = { htonl(type), 0 };
+    struct iovec iov = { &frame, sizeof(frame) };
+    return Send(&iov, 1, 0);
+}
+
+
+int input(void *buffers[], const size_t lens[],
+        const bool isFlushing[],
+        uint32_t numInPorts, uint32_t numOutPorts) {
+
+    uint8_t *buffer = buffers[0];
+    size_t len = lens[0];
+
+    // We send no more than 4 GiB in a frame.
+    if(len - sent > UINT32_MAX)
+        len = sent + UINT32_MAX;
+
+    struct TcpFrame frame = {
+        htonl(TCP_FRAME_DATA),
+        htonl((uint32_t) (len - sent))
+    };
+
+    if(!useZerocopy) {
+        // The frame header and the payload go in one system call.
+        struct iovec iov[2] = {
+            { &frame, sizeof(frame) },
+            { buffer, len }
+        };
+        if(Send(iov, 2, 0))
+            return -1; // fail
+        qsAdvanceInput(0, len);
+        if(isFlushing[0] && SendFrame(TCP_FRAME_FLUSH))
+            return -1; // fail
+        return 0; // success
+    }
+
+    if(len > sent) {
+        // The frame header is sent with a copy, so that we do not need
+        // to keep it around until the kernel is done with it.
+        struct iovec iov = { &frame, sizeof(frame) };
+        if(Send(&iov, 1, 0))
+            return -1; // fail
+        iov.iov_base = buffer + sent;
+        iov.iov_len = len - sent;
+        if(Send(&iov, 1, MSG_ZEROCOPY))
+            return -1; // fail
+        sent = len;
+    }
+
+    if(Reap(false))
+        return -1; // fail
+
+    // We must advance some input if we have a read promise worth of it.
+    while(completed == 0 && lens[0] >= maxRead)
+        if(Reap(true))
+            return -1; // fail
+
+    DASSERT(completed <= sent);
+    sent -= completed;
+    qsAdvanceInput(0, completed);
+    completed = 0;
+
+    if(isFlushing[0] && SendFrame(TCP_FRAME_FLUSH))
+        return -1; // fail
+
+    return 0; // success
+}
+
+
+int stop(uint32_t numInPorts, uint32_t numOutPorts) {
+
+    if(fd < 0) return 0;
+
+    // The ring buffer memory goes away after this, so the kernel must
+    // be done with it.
+    while(numPending)
+        if(Reap(true))
+            break;
+
+    SendFrame(TCP_FRAME_END);
+
+    close(fd);
+    fd = -1;
+
+    return 0; // success
+}
+
+
+int destroy(void) {
+
+    if(fd >= 0)
+        close(fd);
+    fd = -1;
+
+    return 0; // success
+}
@@ -0,0 +1,231 @@
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include "../../../../include/quickstream/filter.h"
+#include "tcp.h"
+
+
+#define DEFAULT_MAXWRITE    ((size_t) (1024*1024))
+
+
+void help(FILE *f) {
+
+    fprintf(f,
+
+"  Usage: tcpSource --port PORT { --address ADDR --maxWrite LEN\n"
+"                   --rcvbuf BYTES }\n"
+"\n"
+"This filter is a source.\n"
+"This filter must have 0 inputs.\n"
+"This filter listens for a TCP connection from a tcpSink filter, that\n"
+"is most likely in another process on another computer, and writes\n"
+"what the tcpSink filter reads to 1 output.  Together they carry a ring\n"
+"buffer edge from one stream to another.  The data is received directly\n"
+"into the output ring buffer.  This filter finishes when the tcpSink\n"
+"filter stops.  A new connection is accepted each time the stream runs.\n"
+"\n"
+"\n"
+"                 OPTIONS\n"
+"\n"
+"\n"
+"  --port PORT       The TCP port to listen on.  This option is required.\n"
+"\n"
+"  --address ADDR    The address to listen on.  The default is any\n"
+"                    address.\n"
+"\n"
+"  --maxWrite LEN    Set the maximum write promise to LEN bytes.\n"
+"                    The default value for LEN is %zu.\n"
+"\n"
+"  --rcvbuf BYTES    Set the socket receive buffer size.  The default is\n"
+"                    %d.\n"
+"\n"
+"\n",
+DEFAULT_MAXWRITE, TCP_DEFAULT_BUFSIZE
+        );
+}
+
+
+// qsGetFilterName() may not be called in input().
+static const char *filterName;
+
+static size_t maxWrite;
+static int rcvbuf;
+static int listenFd = -1, fd = -1;
+
+// Bytes left to read in the current data frame.
+static size_t remaining;
+
+
+int construct(int argc, const char **argv) {
+
+    filterName = qsGetFilterName();
+
+    int port = qsOptsGetInt(argc, argv, "port", -1);
+    if(port < 0) {
+        ERROR("filter \"%s\" needs a --port PORT option",
+                filterName);
+        return -1; // fail
+    }
+    const char *address = qsOptsGetString(argc, argv, "address", 0);
+    maxWrite = qsOptsGetSizeT(argc, argv, "maxWrite", DEFAULT_MAXWRITE);
+    rcvbuf = qsOptsGetInt(argc, argv, "rcvbuf", TCP_DEFAULT_BUFSIZE);
+
+    struct sockaddr_storage addr;
+    socklen_t addrLen;
+    if(SocketGetAddress(address, port, SOCK_STREAM, &addr, &addrLen))
+        return -1; // fail
+
+    listenFd = socket(addr.ss_family, SOCK_STREAM, 0);
+    if(listenFd < 0) {
+        ERROR("socket() failed");
+        return -1; // fail
+    }
+
+    int on = 1;
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+    // The accepted socket gets the buffer size of the listening socket,
+    // and it must be set before the connection is made so that TCP can
+    // use a large enough window.
+    SocketSetOptions(listenFd, SO_RCVBUF, SO_RCVBUFFORCE, rcvbuf, 0);
+
+    if(bind(listenFd, (struct sockaddr *) &addr, addrLen)) {
+        ERROR("bind() to port %d failed", port);
+        return -1; // fail
+    }
+
+    if(listen(listenFd, 1)) {
+        ERROR("listen() failed");
+        return -1; // fail
+    }
+
+    return 0; // success
+}
+
+
+int start(uint32_t numInPorts, uint32_t numOutPorts) {
+
+    ASSERT(numInPorts == 0);
+    ASSERT(numOutPorts == 1);
+
+    qsCreateOutputBuffer(0, maxWrite);
+
+    remaining = 0;
+
+    return 0; // success
+}
+
+
+// Read exactly len bytes.  Returns 0 on success, 1 if the connection
+// was closed before any bytes were read, and -1 on error.
+static
+int ReadAll(void *buf, size_t len) {
+
+    uint8_t *ptr = buf;
+
+    while(len) {
+        ssize_t rd = recv(fd, ptr, len, MSG_WAITALL);
+        if(rd < 0) {
+            if(errno == EINTR) continue;
+            ERROR("recv() failed");
+            return -1;
+        }
+        if(rd == 0) {
+            if(ptr == buf) return 1;
+            ERROR("connection closed in the middle of a frame header");
+            return -1;
+        }
+        ptr += rd;
+        len -= rd;
+    }
+    return 0;
+}
+
+
+int input(void *buffers[], const size_t lens[],
+        const bool isFlushing[],
+        uint32_t numInputs, uint32_t numOutputs) {
+
+    // We'll assume there is no input data.
+    DASSERT(numInputs == 0);
+    DASSERT(numOutputs == 1);
+
+    if(fd < 0) {
+        // We block here until tcpSink connects.
+        fd = accept(listenFd, 0, 0);
+        if(fd < 0) {
+            ERROR("accept() failed");
+            return -1; // fail
+        }
+    }
+
+    while(remaining == 0) {
+
+        struct TcpFrame frame;
+        int ret = ReadAll(&frame, sizeof(frame));
+        if(ret == 1) {
+            WARN("filter \"%s\" connection closed without an end frame",
+                    filterName);
+            goto done;
+        }
+        if(ret)
+            return -1; // fail
+
+        switch(ntohl(frame.type)) {
+            case TCP_FRAME_DATA:
+                remaining = ntohl(frame.len);
+                break;
+            case TCP_FRAME_FLUSH:
+                // We do not hold onto any data, so there is nothing
+                // more to do.
+                DSPEW("filter \"%s\" got a flush frame", filterName);
+                break;
+            case TCP_FRAME_END:
+                goto done;
+            default:
+                ERROR("filter \"%s\" got bad frame type %" PRIu32,
+                        filterName, ntohl(frame.type));
+                return -1; // fail
+        }
+    }
+
+    size_t len = remaining;
+    if(len > maxWrite)
+        len = maxWrite;
+
+    uint8_t *buffer = qsGetOutputBuffer(0, len, 0);
+
+    ssize_t rd;
+    do
+        rd = recv(fd, buffer, len, 0);
+    while(rd < 0 && errno == EINTR);
+
+    if(rd <= 0) {
+        ERROR("filter \"%s\" recv() failed in the middle of a frame",
+                filterName);
+        return -1; // fail
+    }
+
+    remaining -= rd;
+    qsOutput(0, rd);
+
+    return 0; // continue.
+
+done:
+
+    close(fd);
+    fd = -1;
+    return 1; // filter done.
+}
+
+
+int destroy(void) {
+
+    if(fd >= 0)
+        close(fd);
+    if(listenFd >= 0)
+        close(listenFd);
+    fd = listenFd = -1;
+
+    return 0; // success
+}
@@ -0,0 +1,84 @@
+#include <string.h>
+
+#include "../../../../../include/quickstream/filter.h"
+#include "../../../../../include/quickstream/filter.hpp"
+
+
+// A test filter that copies 32 bit words from each input port to the
+// output port with the same port number, using the C++ template filter
+// module interface.  Like all filter modules, when more than one of
+// these is loaded the DSO is copied for each one.  The object state is
+// kept with qsSetFilterUserData(), not in static data.
+//
+class CopyCPP: public qs::Filter<CopyCPP, qs::In<uint32_t>, qs::Out<uint32_t> > {
+
+    size_t maxWrite; // in number of uint32_t
+    size_t total;
+
+    public:
+
+    CopyCPP(int argc, const char **argv) {
+        maxWrite = qsOptsGetSizeT(argc, argv,
+                "maxWrite", QS_DEFAULTMAXWRITE)/sizeof(uint32_t);
+        if(maxWrite == 0) maxWrite = 1;
+    };
+
+
+    int start(uint32_t numInPorts, uint32_t numOutPorts) {
+
+        if(numInPorts != numOutPorts || numInPorts == 0) {
+            fprintf(stderr, "filter \"%s\" needs the same number of "
+                    "inputs and outputs\n", qsGetFilterName());
+            return -1; // error fail
+        }
+        for(uint32_t i=0; i<numOutPorts; ++i)
+            createOutputBuffer(i, maxWrite);
+        total = 0;
+        return 0; // success
+    };
+
+
+    int input(const qs::Span<const uint32_t> in[], const bool isFlushing[],
+            uint32_t numInPorts, uint32_t numOutPorts) {
+
+        for(uint32_t i=0; i<numInPorts; ++i) {
+            size_t len = in[i].size();
+            if(len > maxWrite)
+                len = maxWrite;
+            if(len == 0) continue;
+            qs::Span<uint32_t> out = getOutputBuffer(i, len, len);
+            memcpy(out.data(), in[i].data(), len*sizeof(uint32_t));
+            output(i, len);
+            advanceInput(i, len);
+            total += len;
+        }
+        return 0; // success continue
+    };
+
+
+    int stop(uint32_t numInPorts, uint32_t numOutPorts) {
+        fprintf(stderr, "filter \"%s\" copied %zu words\n",
+                qsGetFilterName(), total);
+        return 0;
+    };
+
+
+    static void help(FILE *file) {
+
+        fprintf(file,
+"  Usage: tests/copyCPP { --maxWrite BYTES }\n"
+"\n"
+"  Copies 32 bit words from each input to the output with the same port\n"
+"  number.  Written with the C++ template filter module interface.\n"
+"\n"
+"                       OPTIONS\n"
+"\n"
+"      --maxWrite BYTES   default value %zu\n"
+"\n",
+        QS_DEFAULTMAXWRITE);
+    };
+};
+
+
+// We do not want a semicolon after this CPP macro
+QS_FILTER_MODULE(CopyCPP)
@@ -0,0 +1,128 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../../../../include/quickstream/filter.h"
+#include "../../../../../lib/debug.h"
+
+#define DEFAULT_PERIOD         ((size_t) 1000)
+
+
+void help(FILE *f) {
+
+    fprintf(f,
+"This filter is a sink.  This filter reads the output of tests/tagGen\n"
+"and checks the stream tags that mark every PERIOD bytes.  It only\n"
+"advances about half of its input in each input() call, so it sees\n"
+"some tags more than once.\n"
+"\n"
+"                  OPTIONS\n"
+"\n"
+"\n"
+"    --period PERIOD     The tagGen PERIOD.  The default PERIOD is %zu.\n"
+"\n"
+"\n",
+DEFAULT_PERIOD);
+}
+
+
+static size_t period;
+static size_t *count, *numTags;
+static const char *filterName;
+
+
+int construct(int argc, const char **argv) {
+
+    period = qsOptsGetSizeT(argc, argv,
+            "period", DEFAULT_PERIOD);
+    ASSERT(period);
+
+    filterName = qsGetFilterName();
+
+    return 0; // success
+}
+
+
+int start(uint32_t numInputs, uint32_t numOutputs) {
+
+    ASSERT(numInputs);
+    ASSERT(numOutputs == 0);
+
+    count = calloc(numInputs, sizeof(*count));
+    ASSERT(count, "calloc(%" PRIu32 ",%zu) failed",
+            numInputs, sizeof(*count));
+    numTags = calloc(numInputs, sizeof(*numTags));
+    ASSERT(numTags, "calloc(%" PRIu32 ",%zu) failed",
+            numInputs, sizeof(*numTags));
+
+    return 0; // success
+}
+
+
+int input(void *buffers[], const size_t lens[],
+        const bool isFlushing[],
+        uint32_t numInputs, uint32_t numOutputs) {
+
+    for(uint32_t i=0; i<numInputs; ++i) {
+
+        size_t len = lens[i];
+        if(len == 0) continue;
+
+        // Advance about half, so we see the other tags again next time.
+        size_t advance = (len + 1)/2;
+
+        const struct QsTag *tags;
+        uint32_t num = qsGetInputTags(i, &tags);
+
+        const char *in = buffers[i];
+        for(size_t j=0; j<len; ++j)
+            ASSERT(in[j] == (char) (count[i] + j),
+                    "%s bad data on input port %" PRIu32,
+                    filterName, i);
+
+        size_t expect = (period - count[i] % period) % period;
+
+        for(uint32_t k=0; k<num; ++k) {
+            // Every tag is at the next multiple of period.
+            ASSERT(tags[k].offset == expect,
+                    "%s input port %" PRIu32 " tag offset %zu"
+                    " should be %zu",
+                    filterName, i, tags[k].offset, expect);
+            ASSERT(strcmp(tags[k].key, "count") == 0);
+            ASSERT(tags[k].value == count[i] + tags[k].offset,
+                    "%s input port %" PRIu32 " tag value %lg"
+                    " should be %zu", filterName, i, tags[k].value,
+                    count[i] + tags[k].offset);
+            if(tags[k].offset < advance)
+                ++numTags[i];
+            expect += period;
+        }
+        // And there are no missing tags.
+        ASSERT(expect >= len, "%s input port %" PRIu32
+                " is missing tags", filterName, i);
+
+        count[i] += advance;
+        qsAdvanceInput(i, advance);
+    }
+
+    return 0;
+}
+
+
+int stop(uint32_t numInputs, uint32_t numOutputs) {
+
+    for(uint32_t i=0; i<numInputs; ++i) {
+        ASSERT(count[i], "%s read no data", filterName);
+        ASSERT(numTags[i] == (count[i] + period - 1)/period,
+                "%s input port %" PRIu32 " got %zu tags"
+                " for %zu bytes", filterName, i, numTags[i], count[i]);
+        DSPEW("%s input port %" PRIu32 " checked %zu tags in %zu bytes",
+                filterName, i, numTags[i], count[i]);
+    }
+
+    free(count);
+    count = 0;
+    free(numTags);
+    numTags = 0;
+
+    return 0;
+}
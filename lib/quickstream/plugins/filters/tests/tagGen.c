@@ -0,0 +1,97 @@
+#include "../../../../../include/quickstream/filter.h"
+#include "../../../../../lib/debug.h"
+
+// This is the default total output length for a given stream run.
+#define DEFAULT_TOTAL_LENGTH   ((size_t) 800000)
+#define DEFAULT_PERIOD         ((size_t) 1000)
+
+
+void help(FILE *f) {
+
+    fprintf(f,
+"This filter is a source.  This filter writes bytes to all outputs and\n"
+"marks every PERIOD bytes with a stream tag.  The tag key is \"count\" and\n"
+"the tag value is the number of bytes written before the marked byte.\n"
+"tests/tagCheck checks them.\n"
+"\n"
+"                  OPTIONS\n"
+"\n"
+"\n"
+"    --maxWrite BYTES    default value %zu.  This is the number of\n"
+"                        bytes written for each input() call.\n"
+"\n"
+"    --length LEN        Write LEN bytes total and than finish.\n"
+"                        The default LEN is %zu.\n"
+"\n"
+"    --period PERIOD     Tag every PERIOD bytes.  The default PERIOD\n"
+"                        is %zu.\n"
+"\n"
+"\n",
+QS_DEFAULTMAXWRITE, DEFAULT_TOTAL_LENGTH, DEFAULT_PERIOD);
+}
+
+
+static size_t maxWrite, totalOut, period, count;
+
+
+int construct(int argc, const char **argv) {
+
+    maxWrite = qsOptsGetSizeT(argc, argv,
+            "maxWrite", QS_DEFAULTMAXWRITE);
+    totalOut = qsOptsGetSizeT(argc, argv,
+            "length", DEFAULT_TOTAL_LENGTH);
+    period = qsOptsGetSizeT(argc, argv,
+            "period", DEFAULT_PERIOD);
+
+    ASSERT(maxWrite);
+    ASSERT(totalOut);
+    ASSERT(period);
+
+    return 0; // success
+}
+
+
+int start(uint32_t numInputs, uint32_t numOutputs) {
+
+    ASSERT(numInputs == 0);
+    ASSERT(numOutputs);
+
+    for(uint32_t i=0; i<numOutputs; ++i)
+        qsCreateOutputBuffer(i, maxWrite);
+
+    count = 0;
+
+    return 0; // success
+}
+
+
+int input(void *buffers[], const size_t lens[],
+        const bool isFlushing[],
+        uint32_t numInputs, uint32_t numOutputs) {
+
+    int ret = 0;
+
+    size_t len = maxWrite;
+    if(count + len > totalOut) {
+        len = totalOut - count;
+        ret = 1; // Last time calling input().
+    }
+
+    if(len == 0) return 1; // We're done.
+
+    // The offset of the first byte to tag.
+    size_t first = (period - count % period) % period;
+
+    for(uint32_t i=0; i<numOutputs; ++i) {
+        char *out = qsGetOutputBuffer(i, len, len);
+        for(size_t j=0; j<len; ++j)
+            out[j] = (char) (count + j);
+        for(size_t j=first; j<len; j += period)
+            qsOutputTag(i, j, "count", count + j);
+        qsOutput(i, len);
+    }
+
+    count += len;
+
+    return ret;
+}
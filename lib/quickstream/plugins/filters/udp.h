@@ -0,0 +1,14 @@
+// Code that is shared by the udpSource and udpSink filter modules.
+//
+// When the --sequence option is used each UDP datagram starts with a 4
+// byte packet sequence number in network byte order, followed by the
+// payload.  The sequence number is not part of the stream data, the
+// udpSource filter strips it off.
+//
+// A zero length datagram marks the end of the stream.  udpSink sends one
+// in stop(), and udpSource returns 1 from input() when it gets one.
+
+#include "socket.h"
+
+
+#define UDP_SEQLEN   ((size_t) sizeof(uint32_t))
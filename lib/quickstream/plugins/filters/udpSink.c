@@ -0,0 +1,254 @@
+// For sendmmsg()
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include "../../../../include/quickstream/filter.h"
+#include "udp.h"
+
+
+#define DEFAULT_PACKETSIZE  ((size_t) 1024)
+#define DEFAULT_BATCH       64
+
+
+void help(FILE *f) {
+
+    fprintf(f,
+
+"  Usage: udpSink --port PORT { --address ADDR --packetSize LEN\n"
+"                 --batch N --sndbuf BYTES --busyPoll USEC --sequence }\n"
+"\n"
+"This filter is a sink.\n"
+"This filter must have 1 input and 0 outputs.\n"
+"This filter sends its input as UDP datagrams with LEN byte payloads.\n"
+"Up to N datagrams are sent with each sendmmsg(2) call, directly from\n"
+"the input ring buffer.  When the stream stops, the last partial\n"
+"datagram is sent followed by a zero length datagram that marks the end\n"
+"of the stream.\n"
+"\n"
+"\n"
+"                 OPTIONS\n"
+"\n"
+"\n"
+"  --port PORT       The UDP port to send to.  This option is required.\n"
+"\n"
+"  --address ADDR    The address to send to.  The default is localhost.\n"
+"\n"
+"  --packetSize LEN  The datagram payload size, not counting the sequence\n"
+"                    number.  The default is %zu.\n"
+"\n"
+"  --batch N         Send up to N datagrams with each sendmmsg(2) call.\n"
+"                    The default is %d.\n"
+"\n"
+"  --sndbuf BYTES    Set the socket send buffer size.  The default is\n"
+"                    to not change it.\n"
+"\n"
+"  --busyPoll USEC   Set SO_BUSY_POLL on the socket.\n"
+"\n"
+"  --sequence        Start each datagram with a 4 byte sequence number\n"
+"                    in network byte order, so that udpSource can detect\n"
+"                    lost datagrams.\n"
+"\n"
+"\n",
+DEFAULT_PACKETSIZE, DEFAULT_BATCH
+        );
+}
+
+
+// qsGetFilterName() may not be called in input().
+static const char *filterName;
+
+static int fd = -1;
+static size_t packetSize;
+static uint32_t batch;
+static bool sequence;
+
+static struct mmsghdr *msgs;
+static struct iovec *iovs;
+static uint32_t *seqs;
+
+static uint32_t nextSeq;
+static bool refused;
+
+// The input that is less than a datagram, which is sent in stop().
+static uint8_t *tail;
+static size_t tailLen;
+
+
+int construct(int argc, const char **argv) {
+
+    filterName = qsGetFilterName();
+
+    int port = qsOptsGetInt(argc, argv, "port", -1);
+    if(port < 0) {
+        ERROR("filter \"%s\" needs a --port PORT option",
+                filterName);
+        return -1; // fail
+    }
+    const char *address = qsOptsGetString(argc, argv, "address",
+            "localhost");
+    packetSize = qsOptsGetSizeT(argc, argv, "packetSize",
+            DEFAULT_PACKETSIZE);
+    batch = qsOptsGetUint32(argc, argv, "batch", DEFAULT_BATCH);
+    int sndbuf = qsOptsGetInt(argc, argv, "sndbuf", 0);
+    int busyPoll = qsOptsGetInt(argc, argv, "busyPoll", 0);
+    sequence = qsOptsGetBool(argc, argv, "sequence");
+
+    if(batch == 0) batch = 1;
+    if(packetSize == 0) packetSize = 1;
+
+    struct sockaddr_storage addr;
+    socklen_t addrLen;
+    if(SocketGetAddress(address, port, SOCK_DGRAM, &addr, &addrLen))
+        return -1; // fail
+
+    fd = socket(addr.ss_family, SOCK_DGRAM, 0);
+    if(fd < 0) {
+        ERROR("socket() failed");
+        return -1; // fail
+    }
+
+    SocketSetOptions(fd, SO_SNDBUF, SO_SNDBUFFORCE, sndbuf, busyPoll);
+
+    // With a connected socket we do not need an address in each
+    // message.
+    if(connect(fd, (struct sockaddr *) &addr, addrLen)) {
+        ERROR("connect() to %s port %d failed", address, port);
+        return -1; // fail
+    }
+
+    msgs = calloc(batch, sizeof(*msgs));
+    ASSERT(msgs, "calloc(%" PRIu32 ",%zu) failed", batch, sizeof(*msgs));
+    iovs = calloc(2*batch, sizeof(*iovs));
+    ASSERT(iovs, "calloc(%" PRIu32 ",%zu) failed", 2*batch, sizeof(*iovs));
+    seqs = calloc(batch, sizeof(*seqs));
+    ASSERT(seqs, "calloc(%" PRIu32 ",%zu) failed", batch, sizeof(*seqs));
+
+    return 0; // success
+}
+
+
+int start(uint32_t numInPorts, uint32_t numOutPorts) {
+
+    ASSERT(numInPorts == 1);
+    ASSERT(numOutPorts == 0);
+
+    qsSetInputReadPromise(0, batch*packetSize);
+
+    nextSeq = 0;
+    refused = false;
+    tail = 0;
+    tailLen = 0;
+
+    return 0; // success
+}
+
+
+// Send n datagrams from buffer, the last one being lastLen bytes.
+// Returns 0 on success.
+static
+int Send(uint8_t *buffer, uint32_t n, size_t lastLen) {
+
+    for(uint32_t i=0; i<n; ++i) {
+        struct iovec *iov = iovs + 2*i;
+        struct msghdr *hdr = &msgs[i].msg_hdr;
+        hdr->msg_iov = iov;
+        hdr->msg_iovlen = 0;
+        if(sequence) {
+            seqs[i] = htonl(nextSeq + i);
+            iov[hdr->msg_iovlen].iov_base = seqs + i;
+            iov[hdr->msg_iovlen++].iov_len = UDP_SEQLEN;
+        }
+        iov[hdr->msg_iovlen].iov_base = buffer + i*packetSize;
+        iov[hdr->msg_iovlen++].iov_len = (i == n - 1)?lastLen:packetSize;
+    }
+    nextSeq += n;
+
+    uint32_t sent = 0;
+    while(sent < n) {
+        int ret = sendmmsg(fd, msgs + sent, n - sent, 0);
+        if(ret < 0) {
+            if(errno == EINTR) continue;
+            if(errno == ECONNREFUSED) {
+                // No one was listening for a datagram we sent before.
+                // That is just UDP, so we keep going.
+                if(!refused)
+                    NOTICE("filter \"%s\" datagrams are being refused",
+                            filterName);
+                refused = true;
+                continue;
+            }
+            ERROR("sendmmsg() failed");
+            return -1;
+        }
+        sent += ret;
+    }
+    return 0;
+}
+
+
+int input(void *buffers[], const size_t lens[],
+        const bool isFlushing[],
+        uint32_t numInPorts, uint32_t numOutPorts) {
+
+    uint8_t *buffer = buffers[0];
+    size_t len = lens[0];
+
+    // We only send whole datagrams here.
+    size_t n = len/packetSize;
+    if(n > batch)
+        n = batch;
+
+    // Save this in case this is the end of the stream.
+    tail = buffer + n*packetSize;
+    tailLen = len - n*packetSize;
+
+    if(n == 0)
+        return 0; // Wait for more data.
+
+    if(Send(buffer, n, packetSize))
+        return -1; // fail
+
+    qsAdvanceInput(0, n*packetSize);
+
+    return 0; // success
+}
+
+
+int stop(uint32_t numInPorts, uint32_t numOutPorts) {
+
+    // The ring buffer memory is still mapped, so we can send the rest
+    // of the input that is less than a full datagram.
+    if(tailLen && tailLen < packetSize) {
+        if(Send(tail, 1, tailLen))
+            return -1;
+    } else if(tailLen)
+        // We did not get called again to send all the input.
+        WARN("filter \"%s\" did not send %zu bytes",
+                filterName, tailLen);
+    tailLen = 0;
+
+    // Send the zero length end of stream marker.
+    if(send(fd, "", 0, 0))
+        NOTICE("filter \"%s\" failed to send end of stream",
+                filterName);
+
+    return 0; // success
+}
+
+
+int destroy(void) {
+
+    if(fd >= 0)
+        close(fd);
+    fd = -1;
+    free(msgs);
+    free(iovs);
+    free(seqs);
+    msgs = 0;
+    iovs = 0;
+    seqs = 0;
+
+    return 0; // success
+}
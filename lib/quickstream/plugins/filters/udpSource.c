@@ -0,0 +1,293 @@
+// For recvmmsg()
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <inttypes.h>
+#include <sys/time.h>
+
+#include "../../../../include/quickstream/filter.h"
+#include "udp.h"
+
+
+#define DEFAULT_PACKETSIZE  ((size_t) 1024)
+#define DEFAULT_BATCH       64
+
+
+void help(FILE *f) {
+
+    fprintf(f,
+
+"  Usage: udpSource --port PORT { --address ADDR --packetSize LEN\n"
+"                   --batch N --rcvbuf BYTES --busyPoll USEC\n"
+"                   --timeout SEC --sequence }\n"
+"\n"
+"This filter is a source.\n"
+"This filter must have 0 inputs.\n"
+"This filter receives UDP datagrams and writes the payloads to 1 output.\n"
+"Up to N datagrams are received with each recvmmsg(2) call, directly\n"
+"into the output ring buffer.  This filter finishes when it receives a\n"
+"zero length datagram, like the one the udpSink filter sends when it\n"
+"stops.\n"
+"\n"
+"\n"
+"                 OPTIONS\n"
+"\n"
+"\n"
+"  --port PORT       The UDP port to bind to.  This option is required.\n"
+"\n"
+"  --address ADDR    The address to bind to.  The default is any address.\n"
+"\n"
+"  --packetSize LEN  The largest datagram payload that can be received,\n"
+"                    not counting the sequence number.  Larger datagrams\n"
+"                    are an error.  The default is %zu.\n"
+"\n"
+"  --batch N         Receive up to N datagrams with each recvmmsg(2)\n"
+"                    call.  The default is %d.\n"
+"\n"
+"  --rcvbuf BYTES    Set the socket receive buffer size.  The default is\n"
+"                    to not change it.\n"
+"\n"
+"  --busyPoll USEC   Set SO_BUSY_POLL on the socket, so the kernel busy\n"
+"                    polls the device for USEC microseconds when there\n"
+"                    is no data.\n"
+"\n"
+"  --timeout SEC     Finish if no datagram is received in SEC seconds.\n"
+"                    The default is to wait forever.\n"
+"\n"
+"  --sequence        Each datagram starts with a 4 byte sequence number\n"
+"                    in network byte order.  Gaps and out of order\n"
+"                    datagrams are counted and reported when the stream\n"
+"                    stops.  The sequence numbers are not outputted.\n"
+"\n"
+"\n",
+DEFAULT_PACKETSIZE, DEFAULT_BATCH
+        );
+}
+
+
+// qsGetFilterName() may not be called in input().
+static const char *filterName;
+
+static int fd = -1;
+static size_t packetSize;
+static uint32_t batch;
+static bool sequence;
+
+static struct mmsghdr *msgs;
+static struct iovec *iovs;
+static uint32_t *seqs;
+
+static uint32_t nextSeq;
+static uint64_t numPackets, numLost, numOutOfOrder;
+
+
+int construct(int argc, const char **argv) {
+
+    filterName = qsGetFilterName();
+
+    int port = qsOptsGetInt(argc, argv, "port", -1);
+    if(port < 0) {
+        ERROR("filter \"%s\" needs a --port PORT option",
+                filterName);
+        return -1; // fail
+    }
+    const char *address = qsOptsGetString(argc, argv, "address", 0);
+    packetSize = qsOptsGetSizeT(argc, argv, "packetSize",
+            DEFAULT_PACKETSIZE);
+    batch = qsOptsGetUint32(argc, argv, "batch", DEFAULT_BATCH);
+    int rcvbuf = qsOptsGetInt(argc, argv, "rcvbuf", 0);
+    int busyPoll = qsOptsGetInt(argc, argv, "busyPoll", 0);
+    double timeout = qsOptsGetDouble(argc, argv, "timeout", 0);
+    sequence = qsOptsGetBool(argc, argv, "sequence");
+
+    if(batch == 0) batch = 1;
+    if(packetSize == 0) packetSize = 1;
+
+    struct sockaddr_storage addr;
+    socklen_t addrLen;
+    if(SocketGetAddress(address, port, SOCK_DGRAM, &addr, &addrLen))
+        return -1; // fail
+
+    fd = socket(addr.ss_family, SOCK_DGRAM, 0);
+    if(fd < 0) {
+        ERROR("socket() failed");
+        return -1; // fail
+    }
+
+    SocketSetOptions(fd, SO_RCVBUF, SO_RCVBUFFORCE, rcvbuf, busyPoll);
+
+    if(timeout > 0) {
+        struct timeval tv = {
+            .tv_sec = timeout,
+            .tv_usec = (timeout - (time_t) timeout)*1.0e6
+        };
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    }
+
+    if(bind(fd, (struct sockaddr *) &addr, addrLen)) {
+        ERROR("bind() to port %d failed", port);
+        return -1; // fail
+    }
+
+    msgs = calloc(batch, sizeof(*msgs));
+    ASSERT(msgs, "calloc(%" PRIu32 ",%zu) failed", batch, sizeof(*msgs));
+    iovs = calloc(2*batch, sizeof(*iovs));
+    ASSERT(iovs, "calloc(%" PRIu32 ",%zu) failed", 2*batch, sizeof(*iovs));
+    seqs = calloc(batch, sizeof(*seqs));
+    ASSERT(seqs, "calloc(%" PRIu32 ",%zu) failed", batch, sizeof(*seqs));
+
+    return 0; // success
+}
+
+
+int start(uint32_t numInPorts, uint32_t numOutPorts) {
+
+    ASSERT(numInPorts == 0);
+    ASSERT(numOutPorts == 1);
+
+    qsCreateOutputBuffer(0, batch*packetSize);
+
+    nextSeq = 0;
+    numPackets = 0;
+    numLost = 0;
+    numOutOfOrder = 0;
+
+    return 0; // success
+}
+
+
+int input(void *buffers[], const size_t lens[],
+        const bool isFlushing[],
+        uint32_t numInputs, uint32_t numOutputs) {
+
+    // We'll assume there is no input data.
+    DASSERT(numInputs == 0);
+    DASSERT(numOutputs == 1);
+
+    uint8_t *buffer = qsGetOutputBuffer(0, batch*packetSize, 0);
+
+    // Each datagram gets a packetSize slot in the output buffer, and the
+    // sequence number, if there is one, goes in seqs[].
+    for(uint32_t i=0; i<batch; ++i) {
+        struct iovec *iov = iovs + 2*i;
+        struct msghdr *hdr = &msgs[i].msg_hdr;
+        hdr->msg_iov = iov;
+        hdr->msg_iovlen = 0;
+        if(sequence) {
+            iov[hdr->msg_iovlen].iov_base = seqs + i;
+            iov[hdr->msg_iovlen++].iov_len = UDP_SEQLEN;
+        }
+        iov[hdr->msg_iovlen].iov_base = buffer + i*packetSize;
+        iov[hdr->msg_iovlen++].iov_len = packetSize;
+    }
+
+    // Block until we get at least one datagram, and then take as many
+    // as there are, up to batch.
+    int n;
+    do
+        n = recvmmsg(fd, msgs, batch, MSG_WAITFORONE, 0);
+    while(n < 0 && errno == EINTR);
+
+    if(n < 0) {
+        if(errno == EAGAIN || errno == EWOULDBLOCK) {
+            NOTICE("filter \"%s\" timed out waiting for data",
+                    filterName);
+            return 1; // filter done.
+        }
+        ERROR("recvmmsg() failed");
+        return -1; // fail
+    }
+
+    size_t total = 0;
+    bool done = false;
+
+    for(int i=0; i<n; ++i) {
+
+        size_t len = msgs[i].msg_len;
+
+        if(len == 0) {
+            // The end of stream marker.
+            done = true;
+            break;
+        }
+
+        if(msgs[i].msg_hdr.msg_flags & MSG_TRUNC) {
+            ERROR("Got a datagram larger than %zu bytes",
+                    packetSize + (sequence?UDP_SEQLEN:0));
+            return -1; // fail
+        }
+
+        if(sequence) {
+            if(len < UDP_SEQLEN) {
+                WARN("Got a %zu byte datagram with no sequence number",
+                        len);
+                continue;
+            }
+            len -= UDP_SEQLEN;
+            uint32_t seq = ntohl(seqs[i]);
+            if(numPackets && seq != nextSeq) {
+                // The difference, with uint32_t wrap around, tells us
+                // if datagrams were lost or this one is late.
+                uint32_t diff = seq - nextSeq;
+                if(diff < UINT32_MAX/2)
+                    numLost += diff;
+                else
+                    ++numOutOfOrder;
+                DSPEW("sequence %" PRIu32 " expected %" PRIu32,
+                        seq, nextSeq);
+            }
+            if(numPackets == 0 || seq - nextSeq < UINT32_MAX/2)
+                nextSeq = seq + 1;
+        }
+
+        ++numPackets;
+
+        // We only need to move data if a datagram did not fill its slot.
+        uint8_t *payload = buffer + i*packetSize;
+        if(buffer + total != payload)
+            memmove(buffer + total, payload, len);
+        total += len;
+    }
+
+    if(total)
+        qsOutput(0, total);
+
+    if(done)
+        // This filter is done.
+        return 1; // filter done.
+
+    return 0; // continue.
+}
+
+
+int stop(uint32_t numInPorts, uint32_t numOutPorts) {
+
+    if(!sequence) return 0;
+
+    if(numLost || numOutOfOrder)
+        // The user needs to see this at any spew level.
+        fprintf(stderr, "filter \"%s\" received %" PRIu64 " datagrams, %"
+                PRIu64 " lost, %" PRIu64 " out of order\n",
+                filterName, numPackets, numLost, numOutOfOrder);
+    else
+        INFO("filter \"%s\" received %" PRIu64 " datagrams, none lost",
+                filterName, numPackets);
+
+    return 0; // success
+}
+
+
+int destroy(void) {
+
+    if(fd >= 0)
+        close(fd);
+    fd = -1;
+    free(msgs);
+    free(iovs);
+    free(seqs);
+    msgs = 0;
+    iovs = 0;
+    seqs = 0;
+
+    return 0; // success
+}
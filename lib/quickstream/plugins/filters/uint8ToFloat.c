@@ -49,6 +49,10 @@ int start(uint32_t numInPorts, uint32_t numOutPorts) {
 
     qsCreateOutputBuffer(0, maxWrite);
 
+    // We write whole floats, so we can tell the filters that read our
+    // output that they get whole and aligned floats.
+    qsSetOutputType(0, "float", sizeof(float), 0);
+
     return 0; // success
 }
 
@@ -0,0 +1,239 @@
+// A very small io_uring wrapper that is used by the fileSource and
+// fileSink filter modules.  We do not require liburing, we just use the
+// kernel interface in linux/io_uring.h directly.  This is only enough
+// to queue some reads or writes, submit them all at once, and later
+// collect their completions without waiting, or wait for them all to
+// complete.
+//
+// If the kernel does not have io_uring (or it's not allowed) UringInit()
+// fails and the filters use pread() and pwrite() instead.
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+
+struct Uring {
+
+    int fd;
+
+    // Submission queue ring
+    uint32_t *sqHead, *sqTail, *sqMask, *sqArray;
+    struct io_uring_sqe *sqes;
+
+    // Completion queue ring
+    uint32_t *cqHead, *cqTail, *cqMask;
+    struct io_uring_cqe *cqes;
+
+    void *sqMap, *cqMap;
+    size_t sqMapLen, cqMapLen, sqesMapLen;
+
+    uint32_t entries;
+    // Number of queued SQEs that are not submitted yet.
+    uint32_t numQueued;
+    // Number of submitted requests that we have not got the completion
+    // for yet.
+    uint32_t numInFlight;
+};
+
+
+// Returns 0 on success, or -1 if io_uring is not available.
+static inline
+int UringInit(struct Uring *u, uint32_t entries) {
+
+    memset(u, 0, sizeof(*u));
+
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+
+    u->fd = syscall(__NR_io_uring_setup, entries, &p);
+    if(u->fd < 0)
+        return -1;
+
+    u->entries = p.sq_entries;
+
+    u->sqMapLen = p.sq_off.array + p.sq_entries*sizeof(uint32_t);
+    u->cqMapLen = p.cq_off.cqes + p.cq_entries*sizeof(struct io_uring_cqe);
+
+    if(p.features & IORING_FEAT_SINGLE_MMAP) {
+        if(u->cqMapLen > u->sqMapLen)
+            u->sqMapLen = u->cqMapLen;
+        u->cqMapLen = u->sqMapLen;
+    }
+
+    u->sqMap = mmap(0, u->sqMapLen, PROT_READ|PROT_WRITE,
+            MAP_SHARED|MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+    if(u->sqMap == MAP_FAILED)
+        goto fail;
+
+    if(p.features & IORING_FEAT_SINGLE_MMAP)
+        u->cqMap = u->sqMap;
+    else {
+        u->cqMap = mmap(0, u->cqMapLen, PROT_READ|PROT_WRITE,
+                MAP_SHARED|MAP_POPULATE, u->fd, IORING_OFF_CQ_RING);
+        if(u->cqMap == MAP_FAILED) {
+            munmap(u->sqMap, u->sqMapLen);
+            goto fail;
+        }
+    }
+
+    u->sqesMapLen = p.sq_entries*sizeof(struct io_uring_sqe);
+    u->sqes = mmap(0, u->sqesMapLen, PROT_READ|PROT_WRITE,
+            MAP_SHARED|MAP_POPULATE, u->fd, IORING_OFF_SQES);
+    if(u->sqes == MAP_FAILED) {
+        if(u->cqMap != u->sqMap)
+            munmap(u->cqMap, u->cqMapLen);
+        munmap(u->sqMap, u->sqMapLen);
+        goto fail;
+    }
+
+    uint8_t *sq = u->sqMap;
+    u->sqHead = (uint32_t *) (sq + p.sq_off.head);
+    u->sqTail = (uint32_t *) (sq + p.sq_off.tail);
+    u->sqMask = (uint32_t *) (sq + p.sq_off.ring_mask);
+    u->sqArray = (uint32_t *) (sq + p.sq_off.array);
+
+    uint8_t *cq = u->cqMap;
+    u->cqHead = (uint32_t *) (cq + p.cq_off.head);
+    u->cqTail = (uint32_t *) (cq + p.cq_off.tail);
+    u->cqMask = (uint32_t *) (cq + p.cq_off.ring_mask);
+    u->cqes = (struct io_uring_cqe *) (cq + p.cq_off.cqes);
+
+    return 0; // success
+
+fail:
+
+    close(u->fd);
+    u->fd = -1;
+    return -1;
+}
+
+
+static inline
+void UringCleanup(struct Uring *u) {
+
+    if(u->fd < 0) return;
+
+    munmap(u->sqes, u->sqesMapLen);
+    if(u->cqMap != u->sqMap)
+        munmap(u->cqMap, u->cqMapLen);
+    munmap(u->sqMap, u->sqMapLen);
+    close(u->fd);
+    u->fd = -1;
+}
+
+
+// Queue a read or write.  op is IORING_OP_READ or IORING_OP_WRITE.
+// There must not be more than u->entries queued and in flight.
+static inline
+void UringQueue(struct Uring *u, uint8_t op, int fd,
+        void *buf, uint32_t len, uint64_t offset, uint64_t userData) {
+
+    DASSERT(u->numQueued + u->numInFlight < u->entries);
+
+    uint32_t tail = *u->sqTail;
+    uint32_t index = tail & *u->sqMask;
+    struct io_uring_sqe *sqe = u->sqes + index;
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = op;
+    sqe->fd = fd;
+    sqe->addr = (uintptr_t) buf;
+    sqe->len = len;
+    sqe->off = offset;
+    sqe->user_data = userData;
+
+    u->sqArray[index] = index;
+    // The kernel must see the SQE before it sees the new tail.
+    __atomic_store_n(u->sqTail, tail + 1, __ATOMIC_RELEASE);
+    ++u->numQueued;
+}
+
+
+// Submit all queued requests without waiting for them to complete.
+//
+// Returns 0 on success, or -errno if io_uring_enter() fails.
+static inline
+int UringSubmit(struct Uring *u) {
+
+    while(u->numQueued) {
+        int ret = syscall(__NR_io_uring_enter, u->fd, u->numQueued,
+                0, 0, 0, 0);
+        if(ret < 0) {
+            if(errno == EINTR) continue;
+            return -errno;
+        }
+        u->numQueued -= ret;
+        u->numInFlight += ret;
+    }
+    return 0;
+}
+
+
+// Get the completions that are ready now, without waiting.  res[userData]
+// gets the result of each request, so userData must be an index less
+// than the number of elements in res[].
+//
+// Returns the number of completions that we got.
+static inline
+uint32_t UringReap(struct Uring *u, int32_t *res) {
+
+    uint32_t head = *u->cqHead;
+    uint32_t tail = __atomic_load_n(u->cqTail, __ATOMIC_ACQUIRE);
+    uint32_t n = 0;
+    for(; head != tail; ++head, ++n) {
+        struct io_uring_cqe *cqe = u->cqes + (head & *u->cqMask);
+        res[cqe->user_data] = cqe->res;
+    }
+    __atomic_store_n(u->cqHead, head, __ATOMIC_RELEASE);
+    u->numInFlight -= n;
+    return n;
+}
+
+
+// Like UringReap(), but if no requests have completed and there are
+// requests in flight, this blocks until at least one completes.
+//
+// Returns the number of completions reaped, or -errno if
+// io_uring_enter() fails.
+static inline
+int UringReapWait(struct Uring *u, int32_t *res) {
+
+    uint32_t n;
+    while(!(n = UringReap(u, res)) && u->numInFlight) {
+        int ret = syscall(__NR_io_uring_enter, u->fd, 0, 1,
+                IORING_ENTER_GETEVENTS, 0, 0);
+        if(ret < 0 && errno != EINTR)
+            return -errno;
+    }
+    return n;
+}
+
+
+// Submit all queued requests and wait for all requests that are in
+// flight to complete, putting results in res[] like UringReap().
+//
+// Returns 0 on success, or -errno if io_uring_enter() fails.
+static inline
+int UringWait(struct Uring *u, int32_t *res) {
+
+    int ret = UringSubmit(u);
+    if(ret) return ret;
+
+    while(u->numInFlight) {
+
+        if(UringReap(u, res))
+            continue;
+
+        ret = syscall(__NR_io_uring_enter, u->fd, 0, 1,
+                IORING_ENTER_GETEVENTS, 0, 0);
+        if(ret < 0 && errno != EINTR)
+            return -errno;
+    }
+
+    return 0;
+}
@@ -3,6 +3,7 @@
 #include <pthread.h>
 #include <dlfcn.h>
 #include <stdatomic.h>
+#include <time.h>
 
 // The public installed user interfaces:
 #include "../include/quickstream/app.h"
@@ -14,6 +15,7 @@
 #include "./qs.h"
 #include "filterList.h"
 #include "stream.h"
+#include "trace.h"
 
 
 
@@ -48,7 +50,7 @@ struct QsStream *qsAppStreamCreate(struct QsApp *app) {
     s->flags = _QS_STREAM_DEFAULTFLAGS;
     s->id = app->streamCount++;
 
-    s->dict = qsDictionaryCreate();
+    s->dict = qsDictionaryCreateArena();
 
     return s;
 }
@@ -247,6 +249,9 @@ void qsStreamDestroy(struct QsStream *s) {
 
     FreeRunResources(s);
 
+    TraceFree(s);
+    LockStatsFree(s);
+
     // Cleanup filters in this list
     struct QsFilter *f = s->filters;
     while(f) {
@@ -13,6 +13,9 @@ void FreeFilterRunResources(struct QsFilter *f) {
 
         uint32_t numJobs = GetNumAllocJobsForFilter(f->stream, f);
 
+        for(uint32_t i=0; i<numJobs; ++i)
+            TagsFreeJob(f->jobs + i);
+
         if(f->numInputs) {
             for(uint32_t i=0; i<numJobs; ++i) {
 
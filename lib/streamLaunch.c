@@ -13,6 +13,7 @@
 #include "./flowJobLists.h"
 #include "../include/quickstream/filter.h"
 #include "../include/quickstream/app.h"
+#include "Dictionary.h"
 
 
 
@@ -38,7 +39,7 @@ uint32_t nThreadFlow(struct QsStream *s) {
 
 
     // LOCK stream mutex
-    CHECK(pthread_mutex_lock(&s->mutex));
+    StreamLock(s, QS_LOCK_FLOW);
 
     // 0. set isSourcing
     //
@@ -84,7 +85,7 @@ uint32_t nThreadFlow(struct QsStream *s) {
     // lock until we unlock the stream mutex below.
 
     // UNLOCK stream mutex
-    CHECK(pthread_mutex_unlock(&s->mutex));
+    StreamUnlock(s);
 
     // Now the worker threads will run wild in the stream.
 
@@ -234,14 +235,14 @@ int qsStreamWait(struct QsStream *s) {
             "Stream has not been launched");
 
     // LOCK stream mutex
-    CHECK(pthread_mutex_lock(&s->mutex));
+    StreamLock(s, QS_LOCK_WAIT);
 
     if(s->numThreads == 0) {
         // The number of worker threads is 0 and so there is no reason to
         // wait, and no worker threads to signal this main/master thread.
         //
         // UNLOCK stream mutex
-        CHECK(pthread_mutex_unlock(&s->mutex));
+        StreamUnlock(s);
         return 1;
     }
 
@@ -256,19 +257,51 @@ int qsStreamWait(struct QsStream *s) {
     // 
     // wait via pthread_cond_wait()
     //
-    CHECK(pthread_cond_wait(&s->masterCond, &s->mutex));
+    StreamCondWait(s, &s->masterCond, QS_LOCK_WAIT);
     //
     // now it's locked again via pthread_cond_wait()
     
     s->masterWaiting = false;
 
     // UNLOCK stream mutex
-    CHECK(pthread_mutex_unlock(&s->mutex));
+    StreamUnlock(s);
 
     return 0; // yes we did wait.
 }
 
 
+// While the stream is flowing, filters are not added or removed, and
+// parameters seldom are, so finding them by name can use read-only hash
+// tables in place of the Dictionary tries.
+void FreezeDictionaries(struct QsStream *s) {
+
+    DASSERT(!s->frozenFilters);
+    s->frozenFilters = qsDictionaryFreeze(s->dict);
+
+    for(struct QsFilter *f = s->filters; f; f = f->next) {
+        DASSERT(!f->frozenParameters);
+        atomic_store(&f->frozenParametersStale, false);
+        f->frozenParameters = qsDictionaryFreeze(f->parameters);
+    }
+}
+
+
+// Called when no other threads may be finding filters or parameters.
+void ThawDictionaries(struct QsStream *s) {
+
+    if(s->frozenFilters) {
+        qsFrozenDictionaryDestroy(s->frozenFilters);
+        s->frozenFilters = 0;
+    }
+
+    for(struct QsFilter *f = s->filters; f; f = f->next)
+        if(f->frozenParameters) {
+            qsFrozenDictionaryDestroy(f->frozenParameters);
+            f->frozenParameters = 0;
+        }
+}
+
+
 int qsStreamLaunch(struct QsStream *s, uint32_t maxThreads) {
 
     DASSERT(_qsMainThread == pthread_self(), "Not main thread");
@@ -284,6 +317,15 @@ int qsStreamLaunch(struct QsStream *s, uint32_t maxThreads) {
 
     s->flags |= _QS_STREAM_LAUNCHED;
 
+    if(s->tuneMaxThreads) {
+        INFO("Stream %" PRIu32 " tuned to %" PRIu32 " threads"
+                " in place of %" PRIu32,
+                s->id, s->tuneMaxThreads, maxThreads);
+        maxThreads = s->tuneMaxThreads;
+        // It must be set again for the next launch.
+        s->tuneMaxThreads = 0;
+    }
+
     s->maxThreads = maxThreads;
 
     // TODO: remove pthreads synchronization calls in this code for the
@@ -296,10 +338,22 @@ int qsStreamLaunch(struct QsStream *s, uint32_t maxThreads) {
     CHECK(pthread_cond_init(&s->cond, 0));
     CHECK(pthread_cond_init(&s->masterCond, 0));
 
+    if(s->lockStats)
+        LockStatsReset(s);
+
+    for(struct QsFilter *f = s->filters; f; f = f->next)
+        MakeInputCallbackArrays(f);
+
+    FreezeDictionaries(s);
+
     StreamSetFilterMarks(s, true);
     for(uint32_t i=0; i<s->numSources; ++i)
         AllocateFilterJobsAndMutex(s, s->sources[i]);
 
+    // Now that the ring buffers and jobs are set up we can fork the
+    // filter helper processes, before there are worker threads.
+    ProcessLaunch(s);
+
     return s->flow(s);
 }
 
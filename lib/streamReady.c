@@ -3,6 +3,7 @@
 #include <pthread.h>
 #include <dlfcn.h>
 #include <stdatomic.h>
+#include <time.h>
 
 // The public installed user interfaces:
 #include "../include/quickstream/app.h"
@@ -15,6 +16,7 @@
 #include "qs.h"
 #include "filterList.h"
 #include "stream.h"
+#include "trace.h"
 #include "parameter.h"
 
 
@@ -136,6 +138,8 @@ AllocateFilterOutputsFrom(struct QsStream *s, struct QsFilter *f,
             ++outputPortNum) {
 
         f->outputs[outputPortNum].maxWrite = QS_DEFAULTMAXWRITE;
+        // Untyped bytes, unless qsSetOutputType() is called.
+        f->outputs[outputPortNum].granule = 1;
 
         // Count the number of readers for this output port
         // (outputPortNum):
@@ -174,6 +178,8 @@ AllocateFilterOutputsFrom(struct QsStream *s, struct QsFilter *f,
                 reader->feedFilter = f;
                 reader->threshold = QS_DEFAULTTHRESHOLD;
                 reader->maxRead = QS_DEFAULTMAXREADPROMISE;
+                // Untyped bytes, unless qsSetInputType() is called.
+                reader->granule = 1;
 
                 // We'll set the reader->inputPortNum later in
                 // SetupInputPorts(), if inputPortNum is QS_NEXTPORT.
@@ -449,6 +455,153 @@ MarkInputCallback(const char *key, struct  ControllerCallback *cb,
 }
 
 
+static void
+RemoveMarkedInputCallbacks(struct QsFilter *f,
+        struct QsDictionary *callbacks, const char *which) {
+
+    if(callbacks == 0)
+        return;
+
+    struct ControllerCallbackRemover r;
+    r.start = 0;
+    r.end = 0;
+
+    qsDictionaryForEach(callbacks,
+        (int (*) (const char *key, void *value,
+            void *userData)) MarkInputCallback, &r);
+
+    struct ControllerCallback *next;
+    for(struct ControllerCallback *cb=r.start; cb; cb = next) {
+        next = cb->next;
+        DSPEW("Removing %s:%s %s callback", f->name, cb->key, which);
+        qsDictionaryRemove(callbacks, cb->key);
+    }
+}
+
+
+// Call all the stream's filter stop()s, if present.
+static void CallFilterStops(struct QsStream *s) {
+
+    for(struct QsFilter *f = s->filters; f; f = f->next)
+        if(f->stream == s && f->stop) {
+            CHECK(pthread_setspecific(_qsKey, f));
+            f->mark = _QS_IN_STOP;
+            s->flags |= _QS_STREAM_STOP;
+            f->stop(f->numInputs, f->numOutputs);
+            s->flags &= ~_QS_STREAM_STOP;
+            f->mark = 0;
+            CHECK(pthread_setspecific(_qsKey, 0));
+        } else if(f->stream == s)
+            // The flow may have left this filter marked as finished,
+            // and there is no stop() to clear it.
+            f->mark = 0;
+}
+
+
+// Round len up to a multiple of granule.
+static inline
+size_t RoundUp(size_t len, size_t granule) {
+    if(len % granule)
+        len += granule - len % granule;
+    return len;
+}
+
+
+static void ApplyTuning(struct QsStream *s) {
+
+    for(struct QsFilter *f = s->filters; f; f = f->next) {
+        if(f->stream != s) continue;
+
+        for(uint32_t i=0; i<f->numOutputs; ++i) {
+            struct QsOutput *output = f->outputs + i;
+
+            if(output->maxWrite < output->tuneMaxWrite)
+                output->maxWrite = output->tuneMaxWrite;
+
+            for(uint32_t j=0; j<output->numReaders; ++j) {
+                struct QsReader *r = output->readers + j;
+                if(r->maxRead < r->tuneMaxRead)
+                    r->maxRead = r->tuneMaxRead;
+            }
+        }
+    }
+}
+
+
+// Check that the element types that the filters declared in their
+// start() for all connected output and input ports agree, and make the
+// read and write promises and thresholds a multiple of the port's
+// element granule.
+//
+// Returns true on error.
+static bool CheckPortTypes(struct QsStream *s) {
+
+    bool ret = false;
+
+    for(struct QsFilter *f = s->filters; f; f = f->next) {
+        if(f->stream != s) continue;
+
+        for(uint32_t i=0; i<f->numOutputs; ++i) {
+            struct QsOutput *output = f->outputs + i;
+
+            output->maxWrite = RoundUp(output->maxWrite, output->granule);
+
+            for(uint32_t j=0; j<output->numReaders; ++j) {
+                struct QsReader *r = output->readers + j;
+
+                r->maxRead = RoundUp(r->maxRead, r->granule);
+                if(r->threshold < r->granule)
+                    r->threshold = r->granule;
+
+                if(!output->elementSize || !r->elementSize)
+                    // At least one side is untyped bytes.
+                    continue;
+
+                if(output->elementSize != r->elementSize ||
+                        (output->typeName && r->typeName &&
+                        strcmp(output->typeName, r->typeName))) {
+                    ERROR("filter \"%s\" output port %" PRIu32
+                            " type \"%s\" (%zu bytes) does not match"
+                            " filter \"%s\" input port %" PRIu32
+                            " type \"%s\" (%zu bytes)",
+                            f->name, i,
+                            output->typeName?output->typeName:"",
+                            output->elementSize,
+                            r->filter->name, r->inputPortNum,
+                            r->typeName?r->typeName:"",
+                            r->elementSize);
+                    ret = true;
+                }
+            }
+        }
+    }
+
+    return ret;
+}
+
+
+// An untyped output may end with a partial element in a typed reader,
+// which the flow never gives to the reading filter.  We tell the user
+// how many bytes were dropped.
+static void WarnPartialElements(struct QsStream *s) {
+
+    for(struct QsFilter *f = s->filters; f; f = f->next) {
+        if(f->stream != s) continue;
+
+        for(uint32_t i=0; i<f->numInputs; ++i) {
+            struct QsReader *r = f->readers[i];
+            DASSERT(r);
+            DASSERT(r->granule);
+            size_t rem = r->readLength % r->granule;
+            if(rem)
+                WARN("filter \"%s\" input port %" PRIu32 " dropped %zu"
+                        " trailing bytes that are not a whole %zu byte"
+                        " element granule", f->name, i, rem, r->granule);
+        }
+    }
+}
+
+
 int qsStreamStop(struct QsStream *s) {
 
     DASSERT(_qsMainThread == pthread_self(), "Not main thread");
@@ -464,6 +617,15 @@ int qsStreamStop(struct QsStream *s) {
 
     s->flags &= (~_QS_STREAM_LAUNCHED);
 
+    // The stream is not flowing now, so the controllers may edit the
+    // callbacks again.
+    for(struct QsFilter *f = s->filters; f; f = f->next)
+        FreeInputCallbackArrays(f);
+
+    if(s->trace)
+        // Write the timeline of this run.
+        TraceWrite(s);
+
     if(!s->sources) {
         // The setup of the stream failed and the user ignored it.
         WARN("The stream is not setup");
@@ -481,46 +643,39 @@ int qsStreamStop(struct QsStream *s) {
 
 
     /**********************************************************************
-     *      Stage: remove all PostInputCallbacks that are marked as
-     *             finished.
+     *      Stage: remove all PreInputCallbacks and PostInputCallbacks
+     *             that are marked as finished.
      *********************************************************************/
 
     for(struct QsFilter *f = s->filters; f; f = f->next) {
+        RemoveMarkedInputCallbacks(f, f->preInputCallbacks, "PreInput");
+        RemoveMarkedInputCallbacks(f, f->postInputCallbacks, "PostInput");
+    }
 
-        if(f->postInputCallbacks == 0)
-            continue;
-
-        struct ControllerCallbackRemover r;
-        r.start = 0;
-        r.end = 0;
 
-        qsDictionaryForEach(f->postInputCallbacks,
-            (int (*) (const char *key, void *value,
-                void *userData)) MarkInputCallback, &r);
+    /**********************************************************************
+     *     Stage: warn about input that was dropped as partial elements
+     *********************************************************************/
 
-        struct ControllerCallback *next;
-        for(struct ControllerCallback *cb=r.start; cb; cb = next) {
-            next = cb->next;
-            DSPEW("Removing %s:%s PostInput callback", f->name, cb->key);
-            qsDictionaryRemove(f->postInputCallbacks, cb->key);
-        }
-    }
+    WarnPartialElements(s);
 
 
     /**********************************************************************
      *     Stage: call all stream's filter stop() if present
      *********************************************************************/
 
-    for(struct QsFilter *f = s->filters; f; f = f->next)
-        if(f->stream == s && f->stop) {
-            CHECK(pthread_setspecific(_qsKey, f));
-            f->mark = _QS_IN_STOP;
-            s->flags |= _QS_STREAM_STOP;
-            f->stop(f->numInputs, f->numOutputs);
-            s->flags &= ~_QS_STREAM_STOP;
-            f->mark = 0;
-            CHECK(pthread_setspecific(_qsKey, 0));
-        }
+    CallFilterStops(s);
+
+
+    /**********************************************************************
+     *     Stage: deliver the queued QS_ASYNC parameter values
+     *********************************************************************/
+
+    _qsParameterAsyncDrain();
+
+    // The notifier thread is done with its get callbacks, so nothing
+    // else is finding filters or parameters by name.
+    ThawDictionaries(s);
 
 
     /**********************************************************************
@@ -790,6 +945,34 @@ int qsStreamReady(struct QsStream *s) {
     }
 
 
+    /**********************************************************************
+     *     Stage: apply the controller buffer tuning
+     *********************************************************************/
+
+    // Controllers may have made the read and write promises larger with
+    // qsFilterTuneInput() and qsFilterTuneOutput(), but we never make
+    // them smaller than what the filter start() asked for.
+    //
+    ApplyTuning(s);
+
+
+    /**********************************************************************
+     *     Stage: check the port element types
+     *********************************************************************/
+
+    // The filter start()s may have declared the element types of their
+    // ports with qsSetInputType() and qsSetOutputType().  Connected
+    // ports must agree, and we need to fix the buffer promises before
+    // we calculate the ring buffer sizes.
+    //
+    if(CheckPortTypes(s)) {
+        ERROR("stream has mismatched port types");
+        CallFilterStops(s);
+        FreeRunResources(s);
+        return -5; // error mismatched types
+    }
+
+
     /**********************************************************************
      *     Stage: allocate output buffer (QsBuffer) structures
      *********************************************************************/
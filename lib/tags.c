@@ -0,0 +1,255 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "./debug.h"
+#include "./qs.h"
+#include "../include/quickstream/filter.h"
+
+// GetJob() is boiler plate code in filterAPI.h
+#include "filterAPI.h"
+
+
+// In this file is the stream tags code.
+//
+// A filter marks a byte it writes with qsOutputTag().  The tag is kept
+// in the job with an absolute offset, which is the number of bytes
+// written to the output since the stream started.  After input()
+// returns, with the stream mutex lock, TagsCommit() moves the tags to a
+// ring of tags in the output (QsOutput).  Before a reading filter's
+// input() is called, with the stream mutex lock, TagsGetInput() copies
+// the tags that are in the reader's input window into the job, with
+// offsets from the reader's input buffer, so the reading filter can see
+// them with qsGetInputTags() without a lock.
+//
+// A reader at a pass-through level gets the tags from its output and
+// from all the outputs above it in the pass-through list, since they all
+// count the same bytes.  That is how tags pass through pass-through
+// buffers.
+//
+// No reader can be more than the ring buffer mapLength behind the
+// writer, so tags that old are removed from the tag ring.
+//
+// Outputs and jobs have no tag memory until there is a tag, so streams
+// that do not use tags just check a pointer or two.
+
+
+// The first allocated size of a tag array.
+#define TAGS_MINSIZE  ((uint32_t) 16)
+
+
+void qsOutputTag(uint32_t outputPortNum, size_t offset,
+        const char *key, double value) {
+
+    struct QsJob *j = GetJob();
+    struct QsFilter *f = j->filter;
+
+    // These are user errors.
+    ASSERT(outputPortNum < f->numOutputs,
+            "Filter \"%s\", bad output port number", f->name);
+    ASSERT(key, "Filter \"%s\", tag key is 0", f->name);
+
+    struct QsOutput *output = f->outputs + outputPortNum;
+
+    ASSERT(offset < output->maxWrite,
+            "Filter \"%s\" output port %" PRIu32 " tag offset %zu is"
+            " past the %zu write promise",
+            f->name, outputPortNum, offset, output->maxWrite);
+
+    if(j->numOutputTags == j->outputTagsSize) {
+        j->outputTagsSize = j->outputTagsSize?(2*j->outputTagsSize):
+            TAGS_MINSIZE;
+        j->outputTags = realloc(j->outputTags,
+                j->outputTagsSize*sizeof(*j->outputTags));
+        ASSERT(j->outputTags, "realloc(,%zu) failed",
+                j->outputTagsSize*sizeof(*j->outputTags));
+    }
+
+    struct QsTagRecord *r = j->outputTags + j->numOutputTags++;
+    // Only the filter that owns the output changes writeCount, so we
+    // do not need a lock to read it here.
+    r->offset = output->writeCount + offset;
+    r->key = key;
+    r->value = value;
+    r->port = outputPortNum;
+}
+
+
+uint32_t qsGetInputTags(uint32_t inputPortNum, const struct QsTag **tags) {
+
+    struct QsJob *j = GetJob();
+
+    // This is a user error.
+    ASSERT(inputPortNum < j->filter->numInputs,
+            "Filter \"%s\", bad input port number", j->filter->name);
+    DASSERT(tags);
+
+    if(!j->inputTags) {
+        *tags = 0;
+        return 0;
+    }
+
+    *tags = j->inputTags[inputPortNum].tags;
+    return j->inputTags[inputPortNum].num;
+}
+
+
+// Add a tag to the ring, keeping the tags in offset order.
+static inline
+void RingAdd(struct QsTagRing *t, const struct QsTagRecord *r) {
+
+    if(t->num == t->size) {
+        // Grow the ring, and put the tags at the start of the new array.
+        uint32_t size = t->size?(2*t->size):TAGS_MINSIZE;
+        struct QsTagRecord *records = malloc(size*sizeof(*records));
+        ASSERT(records, "malloc(%zu) failed", size*sizeof(*records));
+        for(uint32_t i=0; i<t->num; ++i)
+            records[i] = t->records[(t->first + i) & (t->size - 1)];
+        free(t->records);
+        t->records = records;
+        t->size = size;
+        t->first = 0;
+    }
+
+    uint32_t mask = t->size - 1;
+    uint32_t i = t->num++;
+
+    // Tags are most likely added in order, so this does not loop.
+    while(i && t->records[(t->first + i - 1) & mask].offset > r->offset) {
+        t->records[(t->first + i) & mask] =
+            t->records[(t->first + i - 1) & mask];
+        --i;
+    }
+    t->records[(t->first + i) & mask] = *r;
+}
+
+
+// Move the tags from qsOutputTag() calls in the last input() call for
+// job, j, to the output tag rings.  This is called after the output
+// writeCounts are advanced.
+//
+// There must be a stream mutex lock to call this.
+void TagsCommit(struct QsFilter *f, struct QsJob *j) {
+
+    for(uint32_t i=0; i<j->numOutputTags; ++i) {
+
+        struct QsTagRecord *r = j->outputTags + i;
+        struct QsOutput *output = f->outputs + r->port;
+
+        // Check for this user error.
+        ASSERT(r->offset < output->writeCount,
+                "Filter \"%s\" output port %" PRIu32 " tagged a byte"
+                " that it did not write", f->name, r->port);
+
+        struct QsTagRing *t = output->tags;
+        if(!t) {
+            t = output->tags = calloc(1, sizeof(*t));
+            ASSERT(t, "calloc(1,%zu) failed", sizeof(*t));
+        }
+
+        // Remove the tags that no reader can see any more.
+        while(t->num && t->records[t->first].offset +
+                output->buffer->mapLength <= output->writeCount) {
+            t->first = (t->first + 1) & (t->size - 1);
+            --t->num;
+        }
+
+        RingAdd(t, r);
+    }
+
+    j->numOutputTags = 0;
+}
+
+
+// Add a tag to the input tags for input port, port, in job, j, keeping
+// them in offset order.
+void TagsAddInput(struct QsJob *j, uint32_t port,
+        const struct QsTag *tag) {
+
+    if(!j->inputTags) {
+        j->inputTags = calloc(j->filter->numInputs, sizeof(*j->inputTags));
+        ASSERT(j->inputTags, "calloc(%" PRIu32 ",%zu) failed",
+                j->filter->numInputs, sizeof(*j->inputTags));
+    }
+
+    struct QsJobInputTags *in = j->inputTags + port;
+
+    if(in->num == in->size) {
+        in->size = in->size?(2*in->size):TAGS_MINSIZE;
+        in->tags = realloc(in->tags, in->size*sizeof(*in->tags));
+        ASSERT(in->tags, "realloc(,%zu) failed",
+                in->size*sizeof(*in->tags));
+    }
+
+    uint32_t i = in->num++;
+    while(i && in->tags[i-1].offset > tag->offset) {
+        in->tags[i] = in->tags[i-1];
+        --i;
+    }
+    in->tags[i] = *tag;
+}
+
+
+// Get the tags for the input window of input port, port, into job, j.
+// This is called after j->inputLens[port] is set.
+//
+// There must be a stream mutex lock to call this.
+void TagsGetInput(struct QsFilter *f, struct QsJob *j, uint32_t port) {
+
+    struct QsReader *reader = f->readers[port];
+
+    if(j->inputTags)
+        j->inputTags[port].num = 0;
+
+    // The absolute offsets of the input window.
+    uint64_t start = reader->output->writeCount - reader->readLength;
+    uint64_t end = start + j->inputLens[port];
+
+    for(struct QsOutput *o = reader->output; o; o = o->prev) {
+        struct QsTagRing *t = o->tags;
+        if(!t) continue;
+        for(uint32_t i=0; i<t->num; ++i) {
+            struct QsTagRecord *r =
+                t->records + ((t->first + i) & (t->size - 1));
+            if(r->offset < start) continue;
+            if(r->offset >= end) break;
+            struct QsTag tag = {
+                .offset = r->offset - start,
+                .key = r->key,
+                .value = r->value
+            };
+            TagsAddInput(j, port, &tag);
+        }
+    }
+}
+
+
+void TagsFreeOutput(struct QsOutput *output) {
+
+    if(!output->tags) return;
+
+    free(output->tags->records);
+    free(output->tags);
+    output->tags = 0;
+}
+
+
+void TagsFreeJob(struct QsJob *j) {
+
+    if(j->inputTags) {
+        for(uint32_t i=0; i<j->filter->numInputs; ++i)
+            free(j->inputTags[i].tags);
+        free(j->inputTags);
+        j->inputTags = 0;
+    }
+    free(j->outputTags);
+    j->outputTags = 0;
+    j->numOutputTags = 0;
+    j->outputTagsSize = 0;
+}
@@ -0,0 +1,311 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "../include/quickstream/app.h"
+
+#include "./debug.h"
+#include "./qs.h"
+#include "./trace.h"
+
+
+// In this file is the code that records a timeline of the stream flow and
+// writes it as a Chrome Trace Event JSON file, which can be looked at
+// with chrome://tracing or https://ui.perfetto.dev.
+//
+// Each thread that runs the flow records events in its own buffer,
+// without a lock.  A thread gets its buffer the first time it adds an
+// event in a flow run, and keeps it in thread local storage.  At
+// qsStreamStop() no threads are running the flow, and the events are
+// written to the file and the buffers are reused in the next run.
+//
+// The events are: the filter input() calls, with the bytes read and
+// written and the job number; the time waiting for the stream mutex
+// after input() returns; and the time threads are idle waiting for a
+// job.
+
+
+// A thread buffer keeps no more than this many events in a run.
+#define TRACE_MAXEVENTS  ((uint32_t) (1024*1024))
+#define TRACE_MINEVENTS  ((uint32_t) 1024)
+
+
+struct QsTraceEvent {
+    uint64_t begin, end; // nanoseconds
+    struct QsFilter *filter;
+    uint64_t in, out; // bytes read and written in input()
+    uint32_t type, job;
+};
+
+
+struct QsTraceBuffer {
+
+    struct QsTraceBuffer *next;
+
+    // Set when a thread has this buffer in this run.
+    atomic_bool taken;
+
+    // The thread number in the trace file.
+    uint32_t tid;
+
+    uint32_t num, size;
+    struct QsTraceEvent *events;
+
+    // Events that did not fit in this run.
+    uint64_t dropped;
+};
+
+
+struct QsTrace {
+
+    FILE *file;
+
+    // This is changed for each run, so that the thread local storage
+    // from the last run is not used.
+    uint64_t generation;
+
+    _Atomic (struct QsTraceBuffer *) buffers;
+    atomic_uint numBuffers;
+
+    // The time the trace was started in nanoseconds.
+    uint64_t start;
+
+    // Set after the first event is written to the file.
+    bool wroteEvent;
+};
+
+
+// The source of unique trace generation numbers.
+static atomic_uint_fast64_t generations = 1;
+
+// The buffer that this thread is using for the trace with generation
+// threadGeneration.
+static __thread uint64_t threadGeneration = 0;
+static __thread struct QsTraceBuffer *threadBuffer = 0;
+
+
+
+int qsStreamTrace(struct QsStream *s, const char *filename) {
+
+    DASSERT(_qsMainThread == pthread_self(), "Not main thread");
+    DASSERT(s);
+    ASSERT(!(s->flags & _QS_STREAM_LAUNCHED),
+            "stream trace cannot be changed while the stream is flowing");
+
+    if(s->trace)
+        TraceFree(s);
+
+    if(!filename)
+        return 0;
+
+    FILE *file = fopen(filename, "w");
+    if(!file) {
+        ERROR("fopen(\"%s\", \"w\") failed", filename);
+        return -1; // error
+    }
+
+    struct QsTrace *trace = calloc(1, sizeof(*trace));
+    ASSERT(trace, "calloc(1,%zu) failed", sizeof(*trace));
+
+    trace->file = file;
+    trace->generation = atomic_fetch_add(&generations, 1);
+    trace->start = TraceTime();
+
+    fprintf(file, "[");
+
+    s->trace = trace;
+
+    return 0; // success
+}
+
+
+static inline
+struct QsTraceBuffer *GetBuffer(struct QsTrace *trace) {
+
+    if(threadGeneration == trace->generation)
+        return threadBuffer;
+
+    struct QsTraceBuffer *b = atomic_load(&trace->buffers);
+
+    // Try to reuse a buffer from a thread in the last run.
+    for(; b; b = b->next) {
+        bool taken = false;
+        if(atomic_compare_exchange_strong(&b->taken, &taken, true))
+            break;
+    }
+
+    if(!b) {
+        b = calloc(1, sizeof(*b));
+        ASSERT(b, "calloc(1,%zu) failed", sizeof(*b));
+        atomic_store(&b->taken, true);
+        b->tid = atomic_fetch_add(&trace->numBuffers, 1);
+        b->next = atomic_load(&trace->buffers);
+        while(!atomic_compare_exchange_weak(&trace->buffers, &b->next, b));
+    }
+
+    threadGeneration = trace->generation;
+    threadBuffer = b;
+    return b;
+}
+
+
+void TraceAdd(struct QsTrace *trace, uint32_t type,
+        uint64_t begin, uint64_t end,
+        struct QsFilter *f, struct QsJob *j) {
+
+    struct QsTraceBuffer *b = GetBuffer(trace);
+
+    if(b->num == b->size) {
+        if(b->size >= TRACE_MAXEVENTS) {
+            ++b->dropped;
+            return;
+        }
+        b->size = b->size?(2*b->size):TRACE_MINEVENTS;
+        b->events = realloc(b->events, b->size*sizeof(*b->events));
+        ASSERT(b->events, "realloc(,%zu) failed",
+                b->size*sizeof(*b->events));
+    }
+
+    struct QsTraceEvent *e = b->events + b->num++;
+    e->begin = begin;
+    e->end = end;
+    e->type = type;
+    e->filter = f;
+    e->in = 0;
+    e->out = 0;
+    e->job = 0;
+
+    if(type == QS_TRACE_INPUT) {
+        DASSERT(f);
+        DASSERT(j);
+        for(uint32_t i=0; i<f->numInputs; ++i)
+            e->in += j->advanceLens[i];
+        for(uint32_t i=0; i<f->numOutputs; ++i)
+            e->out += j->outputLens[i];
+        e->job = j - f->jobs;
+    }
+}
+
+
+// Write a string as a JSON string.
+static void
+PrintString(FILE *file, const char *str) {
+
+    putc('"', file);
+    for(; *str; ++str) {
+        if(*str == '"' || *str == '\\')
+            putc('\\', file);
+        if((unsigned char) *str < ' ')
+            fprintf(file, "\\u%04x", (unsigned char) *str);
+        else
+            putc(*str, file);
+    }
+    putc('"', file);
+}
+
+
+static inline
+void StartEvent(struct QsTrace *trace) {
+
+    fprintf(trace->file, trace->wroteEvent?",\n":"\n");
+    trace->wroteEvent = true;
+}
+
+
+void TraceWrite(struct QsStream *s) {
+
+    struct QsTrace *trace = s->trace;
+    DASSERT(trace);
+    FILE *file = trace->file;
+
+    StartEvent(trace);
+    fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\","
+            "\"pid\":%" PRIu32 ",\"args\":{\"name\":\"stream %" PRIu32
+            "\"}}", s->id, s->id);
+
+    for(struct QsTraceBuffer *b = atomic_load(&trace->buffers); b;
+            b = b->next) {
+
+        if(!b->num) continue;
+
+        StartEvent(trace);
+        fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\","
+                "\"pid\":%" PRIu32 ",\"tid\":%" PRIu32 ","
+                "\"args\":{\"name\":\"thread %" PRIu32 "\"}}",
+                s->id, b->tid, b->tid);
+
+        for(uint32_t i=0; i<b->num; ++i) {
+            struct QsTraceEvent *e = b->events + i;
+            StartEvent(trace);
+            fprintf(file, "{\"name\":");
+            switch(e->type) {
+                case QS_TRACE_INPUT:
+                    PrintString(file, e->filter->name);
+                    fprintf(file, ",\"cat\":\"input\"");
+                    break;
+                case QS_TRACE_MUTEX:
+                    fprintf(file, "\"mutex wait\",\"cat\":\"mutex\"");
+                    break;
+                default:
+                    fprintf(file, "\"idle\",\"cat\":\"queue\"");
+            }
+            fprintf(file, ",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+                    "\"pid\":%" PRIu32 ",\"tid\":%" PRIu32,
+                    (e->begin - trace->start)*1.0e-3,
+                    (e->end - e->begin)*1.0e-3, s->id, b->tid);
+            if(e->type == QS_TRACE_INPUT)
+                fprintf(file, ",\"args\":{\"in\":%" PRIu64
+                        ",\"out\":%" PRIu64 ",\"job\":%" PRIu32 "}",
+                        e->in, e->out, e->job);
+            else if(e->filter) {
+                fprintf(file, ",\"args\":{\"filter\":");
+                PrintString(file, e->filter->name);
+                putc('}', file);
+            }
+            putc('}', file);
+        }
+
+        if(b->dropped)
+            WARN("Stream %" PRIu32 " trace thread %" PRIu32
+                    " dropped %" PRIu64 " events",
+                    s->id, b->tid, b->dropped);
+
+        b->num = 0;
+        b->dropped = 0;
+        atomic_store(&b->taken, false);
+    }
+
+    // Chrome can read the file without the closing ']', so the file is
+    // usable before TraceFree() is called.
+    fflush(file);
+
+    // So the threads in the next run do not use the buffers they had in
+    // this run.
+    trace->generation = atomic_fetch_add(&generations, 1);
+}
+
+
+void TraceFree(struct QsStream *s) {
+
+    struct QsTrace *trace = s->trace;
+    if(!trace) return;
+
+    fprintf(trace->file, "\n]\n");
+    fclose(trace->file);
+
+    struct QsTraceBuffer *next;
+    for(struct QsTraceBuffer *b = atomic_load(&trace->buffers); b;
+            b = next) {
+        next = b->next;
+        free(b->events);
+        free(b);
+    }
+
+    free(trace);
+    s->trace = 0;
+}
@@ -0,0 +1,38 @@
+// This file contains the inline functions and declarations for recording
+// the flow timeline that qsStreamTrace() turns on.  See trace.c.
+//
+// When the stream has no trace (s->trace == 0) the flow code just checks
+// that pointer, so tracing costs next to nothing when it is not used.
+
+
+// Event types
+#define QS_TRACE_INPUT  ((uint32_t) 0) // A filter input() call.
+#define QS_TRACE_MUTEX  ((uint32_t) 1) // Waiting for the stream mutex.
+#define QS_TRACE_IDLE   ((uint32_t) 2) // Waiting for a job.
+
+
+// Get the time in nanoseconds.
+static inline
+uint64_t TraceTime(void) {
+
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return ((uint64_t) t.tv_sec)*1000000000 + t.tv_nsec;
+}
+
+
+// Add an event to this thread's trace buffer.  This does not need a
+// lock.  f and j may be 0 for events that are not a filter input() call.
+extern
+void TraceAdd(struct QsTrace *trace, uint32_t type,
+        uint64_t begin, uint64_t end,
+        struct QsFilter *f, struct QsJob *j);
+
+// Write the events of the last flow run to the trace file.  This is
+// called in qsStreamStop() when no threads are running the flow.
+extern
+void TraceWrite(struct QsStream *s);
+
+// Finish writing the trace file and free the trace.
+extern
+void TraceFree(struct QsStream *s);
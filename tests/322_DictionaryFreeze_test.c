@@ -0,0 +1,118 @@
+// Tests qsDictionaryFreeze() and compares the time to find keys in the
+// frozen copy with the time to find them in the Dictionary trie.
+
+#include <stdio.h>
+#include <signal.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <time.h>
+
+#include "../lib/Dictionary.h"
+#include "../lib/debug.h"
+
+static
+void catchSegv(int sig) {
+    fprintf(stderr, "\nCaught signal %d\n"
+            "\nsleeping:  gdb -pid %u\n",
+            sig, getpid());
+    while(true) usleep(100000);
+}
+
+
+static double
+GetTime(void) {
+
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + 1.0e-9*t.tv_nsec;
+}
+
+
+#define NUM_KEYS  (1000)
+#define NUM_LOOPS (200)
+
+
+int main(int argc, const char **argv) {
+
+    signal(SIGSEGV, catchSegv);
+
+    // An empty dictionary.
+    struct QsDictionary *d = qsDictionaryCreate();
+    struct QsFrozenDictionary *fd = qsDictionaryFreeze(d);
+    ASSERT(qsFrozenDictionaryFind(fd, "a") == 0);
+    qsFrozenDictionaryDestroy(fd);
+
+    // Keys like the filter and parameter names that we look up while
+    // the streams flow.
+    char *keys[NUM_KEYS];
+    for(uint32_t i=0; i<NUM_KEYS; ++i) {
+        char key[64];
+        switch(i%4) {
+            case 0:
+                snprintf(key, 64, "tests/sequenceGen_%" PRIu32, i);
+                break;
+            case 1:
+                snprintf(key, 64, "bytesIn%" PRIu32 "Rate", i);
+                break;
+            case 2:
+                snprintf(key, 64, "bytesOut%" PRIu32, i);
+                break;
+            default:
+                snprintf(key, 64, "%" PRIu32, i);
+        }
+        keys[i] = strdup(key);
+        ASSERT(keys[i]);
+        ASSERT(qsDictionaryInsert(d, keys[i], keys[i], 0) == 0);
+    }
+
+    fd = qsDictionaryFreeze(d);
+
+    for(uint32_t i=0; i<NUM_KEYS; ++i) {
+        ASSERT(qsFrozenDictionaryFind(fd, keys[i]) == keys[i],
+                "key=\"%s\" not found", keys[i]);
+        ASSERT(qsDictionaryFind(d, keys[i]) == keys[i]);
+    }
+
+    const char *missing[] = {
+        "tests/sequenceGen_1", "bytesIn", "bytesOut2Rate", "x", "10000",
+        "tests/sequenceGen_0 ", 0
+    };
+    for(const char **key = missing; *key; ++key) {
+        ASSERT(qsFrozenDictionaryFind(fd, *key) == 0, "key=\"%s\"", *key);
+        ASSERT(qsDictionaryFind(d, *key) == 0, "key=\"%s\"", *key);
+    }
+
+    // Benchmark
+    uint64_t sum = 0;
+    double t = GetTime();
+    for(uint32_t j=0; j<NUM_LOOPS; ++j)
+        for(uint32_t i=0; i<NUM_KEYS; ++i)
+            sum += (uintptr_t) qsDictionaryFind(d, keys[i]);
+    double trieTime = GetTime() - t;
+
+    t = GetTime();
+    for(uint32_t j=0; j<NUM_LOOPS; ++j)
+        for(uint32_t i=0; i<NUM_KEYS; ++i)
+            sum -= (uintptr_t) qsFrozenDictionaryFind(fd, keys[i]);
+    double frozenTime = GetTime() - t;
+
+    ASSERT(sum == 0);
+
+    fprintf(stderr, "Find() of %d keys: trie %lg, frozen %lg"
+            " seconds per call\n", NUM_KEYS,
+            trieTime/(NUM_LOOPS*NUM_KEYS),
+            frozenTime/(NUM_LOOPS*NUM_KEYS));
+
+    qsFrozenDictionaryDestroy(fd);
+    qsDictionaryDestroy(d);
+
+    for(uint32_t i=0; i<NUM_KEYS; ++i)
+        free(keys[i]);
+
+    fprintf(stderr, "%s SUCCESS\n", argv[0]);
+
+    return 0;
+}
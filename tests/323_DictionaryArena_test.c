@@ -0,0 +1,171 @@
+// Tests qsDictionaryCreateArena(), and compares the time to find keys
+// and to destroy an arena dictionary with the time for a dictionary from
+// qsDictionaryCreate().
+
+#include <stdio.h>
+#include <signal.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <time.h>
+
+#include "../lib/Dictionary.h"
+#include "../lib/debug.h"
+
+static
+void catchSegv(int sig) {
+    fprintf(stderr, "\nCaught signal %d\n"
+            "\nsleeping:  gdb -pid %u\n",
+            sig, getpid());
+    while(true) usleep(100000);
+}
+
+
+static double
+GetTime(void) {
+
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + 1.0e-9*t.tv_nsec;
+}
+
+
+#define NUM_KEYS  (4000)
+#define NUM_LOOPS (100)
+
+
+static char *keys[NUM_KEYS];
+
+static uint32_t numFreed = 0;
+
+
+static void
+FreeValue(void *value) {
+    ++numFreed;
+}
+
+
+static void
+MakeKeys(void) {
+
+    for(uint32_t i=0; i<NUM_KEYS; ++i) {
+        char key[64];
+        switch(i%4) {
+            case 0:
+                snprintf(key, 64, "tests/sequenceGen_%" PRIu32, i);
+                break;
+            case 1:
+                snprintf(key, 64, "bytesIn%" PRIu32 "Rate", i);
+                break;
+            case 2:
+                snprintf(key, 64, "bytesOut%" PRIu32, i);
+                break;
+            default:
+                snprintf(key, 64, "%" PRIu32, i);
+        }
+        keys[i] = strdup(key);
+        ASSERT(keys[i]);
+    }
+}
+
+
+static void
+Check(struct QsDictionary *d, bool removedOdd) {
+
+    for(uint32_t i=0; i<NUM_KEYS; ++i) {
+        void *val = qsDictionaryFind(d, keys[i]);
+        if(removedOdd && i%2)
+            ASSERT(val == 0, "key=\"%s\" was found", keys[i]);
+        else
+            ASSERT(val == keys[i], "key=\"%s\" not found", keys[i]);
+    }
+}
+
+
+// Remove and insert again, many times, so that the arena uses the freed
+// memory.
+static void
+Churn(struct QsDictionary *d) {
+
+    for(uint32_t j=0; j<4; ++j) {
+        for(uint32_t i=1; i<NUM_KEYS; i+=2)
+            ASSERT(qsDictionaryRemove(d, keys[i]) == 0);
+        Check(d, true);
+        for(uint32_t i=1; i<NUM_KEYS; i+=2)
+            ASSERT(qsDictionaryInsert(d, keys[i], keys[i], 0) == 0);
+        Check(d, false);
+    }
+}
+
+
+static double
+FindTime(struct QsDictionary *d) {
+
+    uint64_t sum = 0;
+    double t = GetTime();
+    for(uint32_t j=0; j<NUM_LOOPS; ++j)
+        for(uint32_t i=0; i<NUM_KEYS; ++i)
+            sum += (uintptr_t) qsDictionaryFind(d, keys[i]);
+    t = GetTime() - t;
+    ASSERT(sum);
+    return t/(NUM_LOOPS*NUM_KEYS);
+}
+
+
+int main(int argc, const char **argv) {
+
+    signal(SIGSEGV, catchSegv);
+
+    MakeKeys();
+
+    // Values that are cleaned up by the arena dictionary destroy.
+    struct QsDictionary *d = qsDictionaryCreateArena();
+    for(uint32_t i=0; i<10; ++i) {
+        struct QsDictionary *idict;
+        ASSERT(qsDictionaryInsert(d, keys[i], keys[i], &idict) == 0);
+        qsDictionarySetFreeValueOnDestroy(idict, FreeValue);
+    }
+    ASSERT(qsDictionaryRemove(d, keys[3]) == 0);
+    ASSERT(numFreed == 1);
+    qsDictionaryDestroy(d);
+    ASSERT(numFreed == 10);
+
+    // Fill the two kinds of dictionary in a mixed order, like the
+    // parameters of many filters being made at the same time, so that
+    // the malloc() nodes are spread out.
+    struct QsDictionary *h = qsDictionaryCreate();
+    d = qsDictionaryCreateArena();
+    for(uint32_t i=0; i<NUM_KEYS; ++i) {
+        ASSERT(qsDictionaryInsert(h, keys[i], keys[i], 0) == 0);
+        ASSERT(qsDictionaryInsert(d, keys[i], keys[i], 0) == 0);
+    }
+    Check(h, false);
+    Check(d, false);
+    Churn(h);
+    Churn(d);
+
+    double heapFind = FindTime(h);
+    double arenaFind = FindTime(d);
+
+    double t = GetTime();
+    qsDictionaryDestroy(h);
+    double heapDestroy = GetTime() - t;
+
+    t = GetTime();
+    qsDictionaryDestroy(d);
+    double arenaDestroy = GetTime() - t;
+
+    fprintf(stderr, "Find() of %d keys: malloc %lg, arena %lg"
+            " seconds per call\n", NUM_KEYS, heapFind, arenaFind);
+    fprintf(stderr, "Destroy() of %d keys: malloc %lg, arena %lg"
+            " seconds\n", NUM_KEYS, heapDestroy, arenaDestroy);
+
+    for(uint32_t i=0; i<NUM_KEYS; ++i)
+        free(keys[i]);
+
+    fprintf(stderr, "%s SUCCESS\n", argv[0]);
+
+    return 0;
+}
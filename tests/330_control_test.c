@@ -28,8 +28,12 @@ void catcher(int sig) {
 }
 
 
-double t = 2.32435;
+double t = 0.00232435;
 
+// The get callback is called from the thread that calls the passThrough
+// input(), because "sleep" is a deferred parameter.
+static atomic_int getCount = 0;
+static pthread_t mainThread;
 
 
 static
@@ -45,6 +49,8 @@ int getCallback(
             type, (uintptr_t) userData);
 
     ASSERT(t == *(double *) value);
+    ASSERT(!pthread_equal(mainThread, pthread_self()));
+    ++getCount;
 
     return 0;
 }
@@ -54,13 +60,25 @@ int getCallback(
 int main(int argc, char **argv) {
 
     signal(SIGSEGV, catcher);
+    mainThread = pthread_self();
 
     struct QsApp *app = qsAppCreate();
     ASSERT(app);
     struct QsStream *s = qsAppStreamCreate(app);
     ASSERT(s);
 
+    const char *genArgv[] = { "--length", "30000" };
+    struct QsFilter *gen = qsStreamFilterLoad(s, "tests/sequenceGen",
+            0, 2, genArgv);
+    ASSERT(gen);
     struct QsFilter *f = qsStreamFilterLoad(s, "tests/passThrough", "passThrough", 0, 0);
+    ASSERT(f);
+    struct QsFilter *check = qsStreamFilterLoad(s, "tests/sequenceCheck",
+            0, 0, 0);
+    ASSERT(check);
+
+    qsFiltersConnect(gen, f, 0, 0);
+    qsFiltersConnect(f, check, 0, 0);
 
     ASSERT(qsParameterGet(s, "passThrough", "sleep",
                 QsDouble, getCallback, 0, 0) == 1);
@@ -74,6 +92,17 @@ int main(int argc, char **argv) {
     ASSERT(qsParameterSet(s, "passThrough",
                 "sleep", QsDouble, &t) == 0);
 
+    // The set is staged until the filter input() is called.
+    ASSERT(getCount == 0);
+
+    ASSERT(qsStreamReady(s) == 0);
+    ASSERT(qsStreamLaunch(s, 2) == 0);
+    qsStreamWait(s);
+    ASSERT(qsStreamStop(s) == 0);
+
+    // It was applied once, and pushed to all 3 get callbacks.
+    ASSERT(getCount == 3, "getCount=%d", getCount);
+
 
     qsDictionaryPrintDot(f->parameters, stdout);
 
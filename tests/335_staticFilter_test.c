@@ -0,0 +1,140 @@
+// Tests filter modules that are linked into the program and registered
+// with qsFilterRegisterStatic(), so there is no dlopen().
+
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "../lib/debug.h"
+#include "../include/quickstream/filter.h"
+#include "../include/quickstream/app.h"
+
+
+#define LENGTH  ((size_t) 100000)
+
+
+static size_t sourceTotal, sinkTotal;
+static int destroyCount;
+
+
+static
+int sourceStart(uint32_t numInPorts, uint32_t numOutPorts) {
+    ASSERT(numInPorts == 0);
+    ASSERT(numOutPorts == 1);
+    qsCreateOutputBuffer(0, 1024);
+    sourceTotal = 0;
+    return 0;
+}
+
+static
+int sourceInput(void *buffers[], const size_t lens[],
+        const bool isFlushing[],
+        uint32_t numInputs, uint32_t numOutputs) {
+
+    size_t n = 1024;
+    if(sourceTotal + n > LENGTH)
+        n = LENGTH - sourceTotal;
+    uint8_t *buf = qsGetOutputBuffer(0, n, n);
+    for(size_t i=0; i<n; ++i)
+        buf[i] = (uint8_t) (sourceTotal + i);
+    qsOutput(0, n);
+    sourceTotal += n;
+
+    if(sourceTotal == LENGTH)
+        return 1; // we are finished
+    return 0;
+}
+
+static
+int sinkInput(void *buffers[], const size_t lens[],
+        const bool isFlushing[],
+        uint32_t numInputs, uint32_t numOutputs) {
+
+    ASSERT(numInputs == 1);
+    const uint8_t *buf = buffers[0];
+    for(size_t i=0; i<lens[0]; ++i)
+        ASSERT(buf[i] == (uint8_t) (sinkTotal + i));
+    sinkTotal += lens[0];
+    qsAdvanceInput(0, lens[0]);
+    return 0;
+}
+
+static
+int sinkDestroy(void) {
+    ++destroyCount;
+    return 0;
+}
+
+static
+void sinkHelp(FILE *f) {
+    fprintf(f, "a static test sink\n");
+}
+
+
+static const struct QsStaticFilter source = {
+    .name = "staticSource",
+    .start = sourceStart,
+    .input = sourceInput
+};
+
+static const struct QsStaticFilter sink = {
+    .name = "staticSink",
+    .destroy = sinkDestroy,
+    .input = sinkInput,
+    .help = sinkHelp
+};
+
+static const struct QsStaticFilter noInput = {
+    .name = "noInput"
+};
+
+
+
+int main(int argc, char **argv) {
+
+    ASSERT(qsFilterRegisterStatic(&source) == 0);
+    ASSERT(qsFilterRegisterStatic(&sink) == 0);
+    // Again is not an error.
+    ASSERT(qsFilterRegisterStatic(&sink) == 1);
+    ASSERT(qsFilterRegisterStatic(&noInput) < 0);
+
+    ASSERT(qsFilterPrintHelp("staticSink.so", stderr) == 0);
+
+    struct QsApp *app = qsAppCreate();
+    ASSERT(app);
+    struct QsStream *s = qsAppStreamCreate(app);
+    ASSERT(s);
+
+    struct QsFilter *src = qsStreamFilterLoad(s, "staticSource", 0, 0, 0);
+    ASSERT(src);
+    struct QsFilter *dst = qsStreamFilterLoad(s, "staticSink.so", 0, 0, 0);
+    ASSERT(dst);
+    ASSERT(strcmp(qsFilterName(dst), "staticSink") == 0);
+
+    // The static data in a module can only be used by one filter.
+    ASSERT(qsStreamFilterLoad(s, "staticSink", "sink2", 0, 0) == 0);
+
+    qsFiltersConnect(src, dst, 0, 0);
+
+    for(int i=0; i<2; ++i) {
+        sinkTotal = 0;
+        ASSERT(qsStreamReady(s) == 0);
+        ASSERT(qsStreamLaunch(s, 2) == 0);
+        qsStreamWait(s);
+        ASSERT(qsStreamStop(s) == 0);
+        ASSERT(sinkTotal == LENGTH, "sinkTotal=%zu", sinkTotal);
+    }
+
+    ASSERT(qsAppDestroy(app) == 0);
+
+    ASSERT(destroyCount == 1);
+
+    fprintf(stderr, "SUCCESS\n");
+
+    return 0;
+}
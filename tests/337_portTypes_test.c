@@ -0,0 +1,183 @@
+// Tests qsSetInputType() and qsSetOutputType() using statically linked
+// filter modules.
+
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "../lib/debug.h"
+#include "../include/quickstream/filter.h"
+#include "../include/quickstream/app.h"
+
+
+// A multiple of 32, unless we test a trailing partial element.
+static size_t length = 320000;
+static size_t sourceTotal, sinkTotal;
+static const char *sourceType = 0, *sinkType = "uint32_t";
+
+
+static
+int sourceStart(uint32_t numInPorts, uint32_t numOutPorts) {
+    qsCreateOutputBuffer(0, 1024);
+    if(sourceType)
+        qsSetOutputType(0, sourceType, 4, 0);
+    sourceTotal = 0;
+    return 0;
+}
+
+static
+int sourceInput(void *buffers[], const size_t lens[],
+        const bool isFlushing[],
+        uint32_t numInputs, uint32_t numOutputs) {
+
+    // If untyped, write odd lengths so the reader must not get them.
+    size_t n = sourceType?1000:1001;
+    if(sourceTotal + n > length)
+        n = length - sourceTotal;
+    uint8_t *buf = qsGetOutputBuffer(0, n, n);
+    for(size_t i=0; i<n; ++i)
+        buf[i] = (uint8_t) (sourceTotal + i);
+    qsOutput(0, n);
+    sourceTotal += n;
+
+    if(sourceTotal == length)
+        return 1; // we are finished
+    return 0;
+}
+
+static
+int sinkStart(uint32_t numInPorts, uint32_t numOutPorts) {
+    qsSetInputType(0, sinkType, sizeof(uint32_t), 32);
+    return 0;
+}
+
+static
+int sinkInput(void *buffers[], const size_t lens[],
+        const bool isFlushing[],
+        uint32_t numInputs, uint32_t numOutputs) {
+
+    ASSERT(((uintptr_t) buffers[0]) % 32 == 0,
+            "buffer %p is not aligned", buffers[0]);
+    ASSERT(lens[0] % 32 == 0, "lens[0]=%zu", lens[0]);
+    const uint8_t *buf = buffers[0];
+    for(size_t i=0; i<lens[0]; ++i)
+        ASSERT(buf[i] == (uint8_t) (sinkTotal + i));
+    sinkTotal += lens[0];
+    qsAdvanceInput(0, lens[0]);
+    return 0;
+}
+
+
+static const struct QsStaticFilter source = {
+    .name = "typedSource",
+    .start = sourceStart,
+    .input = sourceInput
+};
+
+static const struct QsStaticFilter sink = {
+    .name = "typedSink",
+    .start = sinkStart,
+    .input = sinkInput
+};
+
+
+// Returns the qsStreamReady() return value.
+static
+int Run(void) {
+
+    struct QsApp *app = qsAppCreate();
+    ASSERT(app);
+    struct QsStream *s = qsAppStreamCreate(app);
+    ASSERT(s);
+
+    struct QsFilter *src = qsStreamFilterLoad(s, "typedSource", 0, 0, 0);
+    ASSERT(src);
+    struct QsFilter *dst = qsStreamFilterLoad(s, "typedSink", 0, 0, 0);
+    ASSERT(dst);
+    qsFiltersConnect(src, dst, 0, 0);
+
+    sinkTotal = 0;
+    int ret = qsStreamReady(s);
+    if(ret == 0) {
+        ASSERT(qsStreamLaunch(s, 2) == 0);
+        qsStreamWait(s);
+        ASSERT(qsStreamStop(s) == 0);
+    }
+
+    ASSERT(qsAppDestroy(app) == 0);
+
+    return ret;
+}
+
+
+// Calls Run() with stderr going to a temporary file, and checks that
+// it has the string warning in it.  The stderr text is passed on.
+static
+int RunWarn(const char *warning) {
+
+    FILE *tmp = tmpfile();
+    ASSERT(tmp);
+    fflush(stderr);
+    int stderrFd = dup(2);
+    ASSERT(stderrFd >= 0);
+    ASSERT(dup2(fileno(tmp), 2) == 2);
+
+    int ret = Run();
+
+    fflush(stderr);
+    ASSERT(dup2(stderrFd, 2) == 2);
+    close(stderrFd);
+
+    bool found = false;
+    char *line = 0;
+    size_t size = 0;
+    rewind(tmp);
+    while(getline(&line, &size, tmp) > 0) {
+        fputs(line, stderr);
+        if(strstr(line, warning))
+            found = true;
+    }
+    free(line);
+    fclose(tmp);
+    if(qsGetLibSpewLevel() >= 2)
+        // The library was compiled with WARN().
+        ASSERT(found, "no \"%s\" warning", warning);
+
+    return ret;
+}
+
+
+int main(int argc, char **argv) {
+
+    ASSERT(qsFilterRegisterStatic(&source) == 0);
+    ASSERT(qsFilterRegisterStatic(&sink) == 0);
+
+    // An untyped output feeding an aligned uint32_t input.
+    ASSERT(Run() == 0);
+    ASSERT(sinkTotal == length, "sinkTotal=%zu", sinkTotal);
+
+    // The untyped output ends with a partial element, which the reader
+    // does not get, and qsStreamStop() must warn about it.
+    length = 320000 + 33;
+    ASSERT(RunWarn("dropped 1 trailing bytes") == 0);
+    ASSERT(sinkTotal == 320000 + 32, "sinkTotal=%zu", sinkTotal);
+    length = 320000;
+
+    // The same type.
+    sourceType = "uint32_t";
+    ASSERT(Run() == 0);
+    ASSERT(sinkTotal == length, "sinkTotal=%zu", sinkTotal);
+
+    // Mismatched types must fail in qsStreamReady().
+    sinkType = "float";
+    ASSERT(Run() < 0);
+
+    fprintf(stderr, "SUCCESS\n");
+
+    return 0;
+}
@@ -0,0 +1,144 @@
+// Tests that a filter that reads all its input is never given more than
+// the ring buffer overhang mapping to read.
+//
+// The source writes just less than its write promise in each input()
+// call, so it is called again before the sink reads, and the sink
+// readLength grows to nearly twice the overhang length.  Without the
+// overhang limit in GetReadableLength() the sink would read past the end
+// of the overhang memory mapping.
+
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "../lib/debug.h"
+#include "../include/quickstream/filter.h"
+#include "../include/quickstream/app.h"
+
+
+#define PROMISE  ((size_t) 4096) // the write and read promise
+#define LENGTH   ((size_t) 4000000)
+
+
+static size_t sourceTotal, sinkTotal, maxRead;
+
+
+static
+void catchSegv(int sig) {
+    fprintf(stderr, "\nCaught signal %d\n"
+            "\nsleeping:  gdb -pid %u\n",
+            sig, getpid());
+    while(true) usleep(100000);
+}
+
+
+static
+int sourceStart(uint32_t numInPorts, uint32_t numOutPorts) {
+    qsCreateOutputBuffer(0, PROMISE);
+    sourceTotal = 0;
+    return 0;
+}
+
+static
+int sourceInput(void *buffers[], const size_t lens[],
+        const bool isFlushing[],
+        uint32_t numInputs, uint32_t numOutputs) {
+
+    // Odd lengths that are less than the promise walk the read
+    // pointer to all parts of the ring buffer.
+    size_t n = PROMISE - 1 - 2*(sourceTotal % 7);
+    if(sourceTotal + n > LENGTH)
+        n = LENGTH - sourceTotal;
+    uint8_t *buf = qsGetOutputBuffer(0, n, n);
+    for(size_t i=0; i<n; ++i)
+        buf[i] = (uint8_t) (sourceTotal + i);
+    qsOutput(0, n);
+    sourceTotal += n;
+
+    if(sourceTotal == LENGTH)
+        return 1; // we are finished
+    return 0;
+}
+
+static
+int sinkStart(uint32_t numInPorts, uint32_t numOutPorts) {
+    qsSetInputReadPromise(0, PROMISE);
+    return 0;
+}
+
+static
+int sinkInput(void *buffers[], const size_t lens[],
+        const bool isFlushing[],
+        uint32_t numInputs, uint32_t numOutputs) {
+
+    ASSERT(lens[0] <= PROMISE, "lens[0]=%zu", lens[0]);
+    const uint8_t *buf = buffers[0];
+    for(size_t i=0; i<lens[0]; ++i)
+        ASSERT(buf[i] == (uint8_t) (sinkTotal + i),
+                "at byte %zu", sinkTotal + i);
+    if(maxRead < lens[0])
+        maxRead = lens[0];
+    sinkTotal += lens[0];
+    qsAdvanceInput(0, lens[0]);
+    return 0;
+}
+
+
+static const struct QsStaticFilter source = {
+    .name = "overhangSource",
+    .start = sourceStart,
+    .input = sourceInput
+};
+
+static const struct QsStaticFilter sink = {
+    .name = "overhangSink",
+    .start = sinkStart,
+    .input = sinkInput
+};
+
+
+static
+void Run(uint32_t numThreads) {
+
+    struct QsApp *app = qsAppCreate();
+    ASSERT(app);
+    struct QsStream *s = qsAppStreamCreate(app);
+    ASSERT(s);
+
+    struct QsFilter *src = qsStreamFilterLoad(s, "overhangSource", 0, 0, 0);
+    ASSERT(src);
+    struct QsFilter *dst = qsStreamFilterLoad(s, "overhangSink", 0, 0, 0);
+    ASSERT(dst);
+    qsFiltersConnect(src, dst, 0, 0);
+
+    sinkTotal = 0;
+    maxRead = 0;
+    ASSERT(qsStreamReady(s) == 0);
+    ASSERT(qsStreamLaunch(s, numThreads) == 0);
+    qsStreamWait(s);
+    ASSERT(qsStreamStop(s) == 0);
+
+    ASSERT(qsAppDestroy(app) == 0);
+
+    ASSERT(sinkTotal == LENGTH, "sinkTotal=%zu", sinkTotal);
+}
+
+
+int main(int argc, char **argv) {
+
+    signal(SIGSEGV, catchSegv);
+
+    ASSERT(qsFilterRegisterStatic(&source) == 0);
+    ASSERT(qsFilterRegisterStatic(&sink) == 0);
+
+    Run(1);
+    Run(2);
+
+    fprintf(stderr, "SUCCESS\n");
+
+    return 0;
+}